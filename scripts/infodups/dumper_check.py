@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+# coding=UTF-8
+
+# Regression check for infodups -o/-d: every packet written to either file must be
+# byte-identical (timestamp, sizes and bytes) to a packet of the input trace, even for
+# fragments merged with their first copy (packets dropped as errors are not written).
+# Without -i, the trace of window_check.py is used. The trace is read both mapped and
+# through a pipe (where packets are copied instead of referenced).
+
+import argparse, collections, os, shutil, struct, subprocess, sys, tempfile
+from window_check import trace
+
+def records(path):
+    data = open(path, 'rb').read()
+    magic = struct.unpack('<I', data[:4])[0]
+    end = '<' if magic in (0xa1b2c3d4, 0xa1b23c4d) else '>'
+    nsec = struct.unpack(end + 'I', data[:4])[0] == 0xa1b23c4d
+    off, recs = 24, []
+    while off + 16 <= len(data):
+        sec, frac, caplen, size = struct.unpack(end + 'IIII', data[off:off+16])
+        # timestamps in ns (the files may be written with another precision)
+        recs.append((sec * 1000000000 + frac * (1 if nsec else 1000), size, data[off+16:off+16+caplen]))
+        off += 16 + caplen
+    return recs
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Checks the traces written by infodups -o and -d.')
+    parser.add_argument('-b', dest='infodups', default='infodups', help='infodups binary')
+    parser.add_argument('-i', dest='infile', help='PCAP input file (default: a trace with fragment merges)')
+    parser.add_argument('-n', dest='count', type=int, default=5000, help='number of original packets of the default trace')
+    parser.add_argument('-T', dest='threads', default='4', help='number of threads')
+    args = parser.parse_args()
+
+    tmp = tempfile.mkdtemp()
+    path = args.infile
+    if not path:
+        path = os.path.join(tmp, 'trace.pcap')
+        trace(path, 1, args.count, 0.1)
+    kept, removed = os.path.join(tmp, 'kept.pcap'), os.path.join(tmp, 'removed.pcap')
+    inputs = collections.Counter(records(path))
+
+    failed = 0
+    for mode, cmd in [('mapped', '"$0" -i "$1" -o "$2" -d "$3" -T "$4"'),
+                      ('piped', '"$0" -i <(cat "$1") -o "$2" -d "$3" -T "$4"')]:
+        out = subprocess.check_output(['bash', '-c', cmd, args.infodups, path, kept, removed, args.threads], stderr=subprocess.DEVNULL).decode()
+        dups = len(out.splitlines())
+        written = collections.Counter(records(kept)) + collections.Counter(records(removed))
+        unknown, missing = written - inputs, inputs - written
+        print('%s: %d packets, %d kept, %d removed (%d duplicates), %d not written, %d not in the input' % (mode,
+              sum(inputs.values()), len(records(kept)), len(records(removed)), dups, sum(missing.values()), sum(unknown.values())))
+        failed |= bool(unknown)
+    shutil.rmtree(tmp)
+    sys.exit(failed)
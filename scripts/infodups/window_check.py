@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+# coding=UTF-8
+
+# Regression check for the time window of infodups: builds a trace with routed and
+# fragmented copies (which infodups merges back into the original packet), switched
+# copies around the edge of the window and timestamps going backwards, and checks that
+# no duplicate is reported farther apart than the window. With a window in positions,
+# it also checks that no duplicate is reported across a merged fragment that fell out of
+# the window when it was set back to the position of its first copy (where a backward
+# scan stops).
+
+import argparse, bisect, os, random, struct, subprocess, sys, tempfile
+
+def csum(b):
+    if len(b) % 2: b += b'\0'
+    s = sum(struct.unpack('!%dH' % (len(b) // 2), b))
+    s = (s >> 16) + (s & 0xffff)
+    s += s >> 16
+    return ~s & 0xffff
+
+def ip(src, dst, ident, ttl, payload, mf=0, off=0):
+    h = struct.pack('!BBHHHBBH4s4s', 0x45, 0, 20 + len(payload), ident, (mf << 13) | off, ttl, 17, 0, src, dst)
+    return h[:10] + struct.pack('!H', csum(h)) + h[12:] + payload
+
+def udp(data):
+    return struct.pack('!HHHH', 4000, 53, 8 + len(data), 0) + data
+
+def eth(src, dst, payload):
+    return dst + src + b'\x08\x00' + payload
+
+def trace(path, seed, count, window):
+    rnd = random.Random(seed)
+    macs = [bytes([0, 1, 2, 3, 4, i]) for i in range(8)]
+    hosts = [bytes([10, 0, 0, i]) for i in range(64)]
+    out = open(path, 'wb')
+    out.write(struct.pack('<IHHiIII', 0xa1b2c3d4, 2, 4, 0, 0, 262144, 1))
+
+    def dump(ts, frame):
+        usec = int(round(ts * 1e6))
+        out.write(struct.pack('<IIII', usec // 1000000, usec % 1000000, len(frame), len(frame)) + frame)
+
+    t, queue = 1000.0, []
+    for i in range(count):
+        t += rnd.expovariate(5.0 / window)
+        while queue and queue[0][0] <= t:
+            dump(*queue.pop(0))
+        src, dst = rnd.sample(hosts, 2)
+        msrc, mdst = rnd.sample(macs[:5], 2)
+        ident = rnd.randrange(65536)
+        pl = udp(bytes(rnd.randrange(256) for _ in range(rnd.choice([20, 100, 1400, 3000]))))
+        # some timestamps go backwards
+        dump(t - rnd.uniform(0, window / 2) if rnd.random() < 0.05 else t, eth(msrc, mdst, ip(src, dst, ident, 64, pl)))
+        r = rnd.random()
+        if len(pl) > 1480 and r < 0.5:
+            # routed and fragmented copy
+            for off in range(0, len(pl), 1480):
+                frag = ip(src, dst, ident, 63, pl[off:off+1480], int(off + 1480 < len(pl)), off // 8)
+                queue.append((t + rnd.uniform(0, window / 2), eth(macs[7], macs[6], frag)))
+        elif r < 0.8:
+            # switched copy around the edge of the window
+            queue.append((t + rnd.uniform(0.9 * window, 1.1 * window), eth(msrc, mdst, ip(src, dst, ident, 64, pl))))
+        queue.sort(key=lambda e: e[0])
+    for e in queue: dump(*e)
+    out.close()
+
+def across_merged(dups, maxpos):
+    # merged fragments: (position, position of the first copy)
+    merged = sorted((int(d[0]), int(d[0]) - int(d[1])) for d in dups if int(d[2]) >= 4)
+    # a duplicate of a merged fragment is reported from the position of its first copy
+    orig = {}
+    for p, r in merged: orig[r] = max(orig.get(r, r), p)
+    across = []
+    for d in dups:
+        q = int(d[0])
+        start = orig.get(q - int(d[1]), q - int(d[1]))
+        for p, r in merged[bisect.bisect_right(merged, (start, q)):bisect.bisect_left(merged, (q, 0))]:
+            if q - r > maxpos - 1:
+                across.append(d)
+                break
+    return across
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Checks that infodups never reports duplicates outside the time window.')
+    parser.add_argument('-b', dest='infodups', default='infodups', help='infodups binary')
+    parser.add_argument('-n', dest='count', type=int, default=20000, help='number of original packets')
+    parser.add_argument('-s', dest='seed', type=int, default=1, help='random seed')
+    parser.add_argument('-t', dest='window', type=float, default=0.1, help='time window (s)')
+    parser.add_argument('-p', dest='maxpos', type=int, nargs='+', default=[5, 50], help='windows in positions (without threads)')
+    parser.add_argument('-w', dest='outfile', help='keep the trace in this PCAP file')
+    args = parser.parse_args()
+
+    path = args.outfile or tempfile.mkstemp(suffix='.pcap')[1]
+    trace(path, args.seed, args.count, args.window)
+    failed = 0
+    for threads in ['2', '4']:
+        out = subprocess.check_output([args.infodups, '-i', path, '-t', str(args.window), '-T', threads], stderr=subprocess.DEVNULL).decode()
+        dups = [l.split() for l in out.splitlines()]
+        merged = sum(1 for d in dups if int(d[2]) >= 4)
+        outside = [d for d in dups if float(d[6]) > args.window]
+        print('-T %s: %d duplicates (%d fragments), %d outside the window' % (threads, len(dups), merged, len(outside)))
+        for d in outside[:10]: print('  ' + ' '.join(d))
+        failed |= bool(outside) or not merged
+    for maxpos in args.maxpos:
+        out = subprocess.check_output([args.infodups, '-i', path, '-n', str(maxpos)], stderr=subprocess.DEVNULL).decode()
+        dups = [l.split() for l in out.splitlines()]
+        outside = [d for d in dups if int(d[1]) > maxpos - 1]
+        across = across_merged(dups, maxpos)
+        print('-n %d: %d duplicates, %d outside the window, %d across a merged fragment' % (maxpos, len(dups), len(outside), len(across)))
+        for d in across[:10]: print('  ' + ' '.join(d))
+        failed |= bool(outside) or bool(across)
+    if not args.outfile: os.remove(path)
+    sys.exit(failed)
@@ -11,6 +11,7 @@
 #define ETH_H
 
 #define ETH_PROTO_IPv4 0x0800
+#define ETH_PROTO_IPv6 0x86DD
 
 #include <sys/time.h>
 
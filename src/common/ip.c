@@ -8,6 +8,7 @@
  */
 
 #include "ip.h"
+#include "parse.h"
 #include <stdlib.h>
 #include <string.h>
 #include <arpa/inet.h>
@@ -78,26 +79,17 @@ char ip_get_MF(IPPacket_t *pkt) {
 }
 
 const char *ip_get_data(IPPacket_t *pkt, int *newSize, int *ipDataLength) {
-    if (!pkt) return NULL;
-    
-    if (pkt->caplen < 4) { // No se puede calcular la longitud de los datos asi que se devuelve NULL y longitudes a -1 para marcar que no es que no hubiera sino que ni se sabe los que habia
-        *newSize = *ipDataLength = -1;
-        return NULL;
-    }
-    
-    unsigned char   headerLength = pkt->bytes->version_HeaderLength & 0x0F;
-    unsigned short  totalLength = ntohs(pkt->bytes->totalLength);
-    
-    *ipDataLength = totalLength-headerLength*4;
+    parsed_hdr_t    hdr = { .l3 = 0 };
 
-    if (pkt->caplen <= headerLength*4) {
-        *newSize = 0;
-        return NULL;
-    }
-    
-    *newSize = (pkt->caplen-headerLength*4 < *ipDataLength)?(pkt->caplen-headerLength*4):*ipDataLength;
-    
-    return (const char*)(((char*)pkt->bytes)+headerLength*4);
+    if (!pkt) return NULL;
+    hdr.l3Caplen = pkt->caplen;
+    nan_parse_ipv4((const char*)pkt->bytes, &hdr);
+
+    // caplen < 4: both lengths are -1 (not even known)
+    *newSize = hdr.l4Caplen;
+    *ipDataLength = hdr.l4Size;
+    if (hdr.l4 < 0) return NULL;
+    return ((const char*)pkt->bytes)+hdr.l4;
 }
 
 int ip_is_fragment(IPPacket_t *pkt) {
@@ -0,0 +1,91 @@
+/*
+ * ip6.c
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#include "ip6.h"
+#include "parse.h"
+#include <stdlib.h>
+#include <arpa/inet.h>
+
+// parse the header and its extension headers (see nan_parse_ipv6())
+static inline void ip6_parse(IPv6Packet_t *pkt, parsed_hdr_t *hdr) {
+    hdr->l3 = 0;
+    hdr->l3Caplen = pkt->caplen;
+    nan_parse_ipv6((const char*)pkt->bytes, hdr);
+}
+
+int ip6_is_header_complete(IPv6Packet_t *pkt) {
+    if (!pkt) return 0;
+    if (pkt->caplen < IP6_HEADER_LENGTH) return 0;
+    return 1;
+}
+
+char *ip6_get_src_txt(IPv6Packet_t *pkt) {
+    static char txt[INET6_ADDRSTRLEN];
+    if (pkt->caplen < 24) return NULL;
+    return (char*)inet_ntop(AF_INET6, pkt->bytes->srcAddr, txt, sizeof(txt));
+}
+
+char *ip6_get_dst_txt(IPv6Packet_t *pkt) {
+    static char txt[INET6_ADDRSTRLEN];
+    if (!ip6_is_header_complete(pkt)) return NULL;
+    return (char*)inet_ntop(AF_INET6, pkt->bytes->dstAddr, txt, sizeof(txt));
+}
+
+int ip6_get_flow_label(IPv6Packet_t *pkt) {
+    if (pkt->caplen < 4) return -1;
+    return ntohl(pkt->bytes->version_Class_Flow)&0x000FFFFF;
+}
+
+int ip6_get_traffic_class(IPv6Packet_t *pkt) {
+    if (pkt->caplen < 4) return -1;
+    return (ntohl(pkt->bytes->version_Class_Flow)>>20)&0xFF;
+}
+
+int ip6_get_hop_limit(IPv6Packet_t *pkt) {
+    if (pkt->caplen < 8) return -1;
+    return pkt->bytes->hopLimit;
+}
+
+int ip6_get_proto(IPv6Packet_t *pkt) {
+    parsed_hdr_t    hdr;
+
+    if (!pkt) return -1;
+    ip6_parse(pkt, &hdr);
+    return hdr.protocol;
+}
+
+int ip6_get_offset(IPv6Packet_t *pkt) {
+    parsed_hdr_t    hdr;
+
+    if (!pkt) return -1;
+    ip6_parse(pkt, &hdr);
+    return hdr.fragOffset;
+}
+
+int ip6_is_fragment(IPv6Packet_t *pkt) {
+    parsed_hdr_t    hdr;
+
+    if (!pkt) return -1;
+    if (pkt->caplen < IP6_HEADER_LENGTH) return -1;
+    ip6_parse(pkt, &hdr);
+    return hdr.frag >= 0;
+}
+
+const char *ip6_get_data(IPv6Packet_t *pkt, int *newSize, int *ipDataLength) {
+    parsed_hdr_t    hdr;
+
+    if (!pkt) return NULL;
+    ip6_parse(pkt, &hdr);
+
+    // caplen < 6: both lengths are -1 (not even known)
+    *newSize = hdr.l4Caplen;
+    *ipDataLength = hdr.l4Size;
+    if (hdr.l4 < 0) return NULL;
+    return ((const char*)pkt->bytes)+hdr.l4;
+}
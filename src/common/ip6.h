@@ -0,0 +1,102 @@
+/*
+ * ip6.h
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#ifndef IP6_H
+#define IP6_H
+
+#define IP6_HEADER_LENGTH 40
+
+// extension headers (next header values)
+#define IP6_EXT_HOPOPTS     0
+#define IP6_EXT_ROUTING     43
+#define IP6_EXT_FRAGMENT    44
+#define IP6_EXT_AUTH        51
+#define IP6_EXT_DSTOPTS     60
+
+// IPv6 header
+typedef struct {
+    unsigned int    version_Class_Flow;     // 4 bits version, 8 bits traffic class, 20 bits flow label
+    unsigned short  payloadLength;          // extension headers included
+    unsigned char   nextHeader;
+    unsigned char   hopLimit;
+    unsigned char   srcAddr[16];
+    unsigned char   dstAddr[16];
+} IPv6header_t;
+/*
+ 0                   1                   2                   3
+ 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ |Version| Traffic Class |           Flow Label                  |
+ +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ |         Payload Length        |  Next Header  |   Hop Limit   |
+ +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ |                                                               |
+ +                         Source Address                        +
+ |                           (16 bytes)                          |
+ +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ |                                                               |
+ +                      Destination Address                      +
+ |                           (16 bytes)                          |
+ +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+
+ Extension headers (Hop-by-Hop, Routing, Destination Options, AH) start
+ with their next header and their length; the Fragment header is:
+
+ +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ |  Next Header  |   Reserved    |      Fragment Offset    |Res|M|
+ +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ |                         Identification                        |
+ +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+*/
+
+// Fragment extension header
+typedef struct {
+    unsigned char   nextHeader;
+    unsigned char   reserved;
+    unsigned short  offset_Flags;           // 13 bits fragmentOffset, 2 bits reserved, 1 bit M
+    unsigned int    identification;
+} IPv6fragment_t;
+
+// packet
+typedef struct {
+    IPv6header_t    *bytes; // packet bytes
+    int             caplen; // captured size
+} IPv6Packet_t;
+
+// true if captured bytes cover the fixed IPv6 header
+int ip6_is_header_complete(IPv6Packet_t *pkt);
+
+// get formatted source IP (from inet_ntop(), overwritten by the next call)
+char *ip6_get_src_txt(IPv6Packet_t *pkt);
+
+// get formatted destination IP (from inet_ntop(), overwritten by the next call)
+char *ip6_get_dst_txt(IPv6Packet_t *pkt);
+
+// get flow label (error: -1)
+int ip6_get_flow_label(IPv6Packet_t *pkt);
+
+// get traffic class (error: -1)
+int ip6_get_traffic_class(IPv6Packet_t *pkt);
+
+// get hop limit (error: -1)
+int ip6_get_hop_limit(IPv6Packet_t *pkt);
+
+// get upper-layer protocol, after the extension headers (error: -1)
+int ip6_get_proto(IPv6Packet_t *pkt);
+
+// get fragment offset (error: -1)
+int ip6_get_offset(IPv6Packet_t *pkt);
+
+// true, false (error: -1)
+int ip6_is_fragment(IPv6Packet_t *pkt);
+
+// get upper-layer payload, captured size and real size
+const char *ip6_get_data(IPv6Packet_t *pkt, int *newSize, int *ipDataLength);
+
+#endif /* IP6_H_ */
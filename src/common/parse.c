@@ -0,0 +1,192 @@
+/*
+ * parse.c
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#include "parse.h"
+#include "tcp.h"
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+static const char LLCSNAPHEADERSTART[6] = { 1, 1, 1, 0, 0, 0};
+
+int nan_parse_eth(const char *bytes, int caplen, parsed_hdr_t *hdr) {
+    unsigned short  type;
+
+    hdr->vlan = 0;
+    hdr->ethertype = 0;
+    if (!bytes || caplen < 14) {
+        hdr->frameType = ETH_FRAMETYPE_ERROR;
+        hdr->src = hdr->dst = hdr->l3 = -1;
+        hdr->l3Caplen = 0;
+        return -1;
+    }
+
+    hdr->src = 6;
+    hdr->dst = 0;
+    type = ntohs(*(unsigned short*)(bytes+12));
+
+    // tags and ethertypes are read only if captured
+    switch (type) {
+        case 0x8100:
+            hdr->frameType = ETH_FRAMETYPE_8021Q;
+            hdr->vlan = (caplen < 16) ? -1 : 14;
+            hdr->l3 = 18;
+            if (caplen >= 18) hdr->ethertype = ntohs(*(unsigned short*)(bytes+16));
+            break;
+        case 0x88a8:
+            hdr->frameType = ETH_FRAMETYPE_8021ad;
+            hdr->vlan = (caplen < 20) ? -1 : 18;
+            hdr->l3 = 22;
+            if (caplen >= 22) hdr->ethertype = ntohs(*(unsigned short*)(bytes+20));
+            break;
+        case 0x88e7:
+            hdr->frameType = ETH_FRAMETYPE_8021ah;
+            hdr->src = (caplen < 30) ? -1 : 24;
+            hdr->dst = 18;
+            hdr->vlan = (caplen < 38) ? -1 : 36;
+            hdr->l3 = 40;
+            if (caplen >= 40) hdr->ethertype = ntohs(*(unsigned short*)(bytes+38));
+            break;
+        default:
+            hdr->l3 = 14;
+            if (type > 0x05DC) {
+                hdr->frameType = ETH_FRAMETYPE_DIX;
+                hdr->ethertype = type;
+            } else {
+                // length field: the ethertype is in the LLC/SNAP header, if any
+                hdr->frameType = ETH_FRAMETYPE_8023;
+                if (caplen >= 22 && memcmp(bytes+14, LLCSNAPHEADERSTART, 6) == 0)
+                    hdr->ethertype = ntohs(*(unsigned short*)(bytes+20));
+            }
+    }
+    hdr->l3Caplen = caplen - hdr->l3;
+
+    return 0;
+}
+
+void nan_parse_ipv4(const char *bytes, parsed_hdr_t *hdr) {
+    const IPheader_t    *ip = (const IPheader_t*)(bytes+hdr->l3);
+    int                 caplen = hdr->l3Caplen;
+    int                 headerLength;
+
+    hdr->srcIP = (caplen < 16) ? -1 : ip->srcAddr;
+    hdr->dstIP = (caplen < 20) ? -1 : ip->dstAddr;
+    hdr->protocol = (caplen < 10) ? -1 : ip->protocol;
+    hdr->fragOffset = (caplen < 8) ? -1 : ntohs(ip->flags_Offset&htons(0x1FFF))*8;
+    hdr->flowLabel = -1;
+    hdr->frag = hdr->l4 = -1;
+
+    // without the length field, the size of the data is not known
+    if (caplen < 4) {
+        hdr->l4Caplen = hdr->l4Size = -1;
+        return;
+    }
+
+    headerLength = (ip->version_HeaderLength & 0x0F)*4;
+    hdr->l4Size = ntohs(ip->totalLength) - headerLength;
+    if (caplen <= headerLength) {
+        hdr->l4Caplen = 0;
+        return;
+    }
+    hdr->l4Caplen = (caplen - headerLength < hdr->l4Size) ? caplen - headerLength : hdr->l4Size;
+    hdr->l4 = hdr->l3 + headerLength;
+}
+
+void nan_parse_ipv6(const char *bytes, parsed_hdr_t *hdr) {
+    const IPv6header_t  *ip6 = (const IPv6header_t*)(bytes+hdr->l3);
+    const unsigned char *ext;
+    int                 caplen = hdr->l3Caplen;
+    int                 headerLength = IP6_HEADER_LENGTH;
+    unsigned char       next;
+
+    hdr->srcIP = hdr->dstIP = -1;
+    hdr->flowLabel = (caplen < 4) ? -1 : ntohl(ip6->version_Class_Flow)&0x000FFFFF;
+    hdr->protocol = hdr->fragOffset = -1;
+    hdr->frag = hdr->l4 = -1;
+
+    // without the length field, the size of the data is not known
+    if (caplen < 6) {
+        hdr->l4Caplen = hdr->l4Size = -1;
+        return;
+    }
+    hdr->l4Size = ntohs(ip6->payloadLength);
+    hdr->l4Caplen = 0;
+    if (caplen < IP6_HEADER_LENGTH) return;
+
+    // extension headers, up to the upper-layer protocol (each one is 8 bytes at least)
+    hdr->fragOffset = 0;
+    for (next = ip6->nextHeader; next == IP6_EXT_HOPOPTS || next == IP6_EXT_ROUTING || next == IP6_EXT_FRAGMENT ||
+                                 next == IP6_EXT_AUTH || next == IP6_EXT_DSTOPTS; next = ext[0]) {
+        if (caplen < headerLength + 8) {
+            hdr->l4Size -= headerLength - IP6_HEADER_LENGTH;
+            return;
+        }
+        ext = (const unsigned char*)ip6 + headerLength;
+        if (next == IP6_EXT_FRAGMENT) {
+            hdr->frag = hdr->l3 + headerLength;
+            hdr->fragOffset = ntohs(((const IPv6fragment_t*)ext)->offset_Flags)&0xFFF8;
+            headerLength += 8;
+        } else if (next == IP6_EXT_AUTH) headerLength += (ext[1] + 2)*4;
+        else headerLength += (ext[1] + 1)*8;
+    }
+    hdr->protocol = next;
+
+    hdr->l4Size -= headerLength - IP6_HEADER_LENGTH;
+    if (caplen <= headerLength) return;
+    hdr->l4Caplen = (caplen - headerLength < hdr->l4Size) ? caplen - headerLength : hdr->l4Size;
+    hdr->l4 = hdr->l3 + headerLength;
+}
+
+void nan_parse_l4(const char *bytes, parsed_hdr_t *hdr) {
+    const TCPheader_t   *tcp = (const TCPheader_t*)(bytes+hdr->l4);    // same ports as UDP
+    int                 caplen = hdr->l4Caplen;
+    int                 headerLength = 8;
+
+    hdr->srcPort = (caplen < 2) ? -1 : ntohs(tcp->srcPort);
+    hdr->dstPort = (caplen < 4) ? -1 : ntohs(tcp->dstPort);
+    hdr->payload = -1;
+    hdr->payloadCaplen = hdr->payloadSize = 0;
+
+    if (hdr->protocol == IP_PROTO_TCP) {
+        if (caplen < 13) return;
+        headerLength = ((tcp->dataOffset_Reserved >> 4)&0x0F)*4;
+        if (caplen < headerLength) return;
+        if ((hdr->payloadSize = hdr->l4Size - headerLength) <= 0) return;
+        if ((hdr->payloadCaplen = caplen - headerLength) <= 0) return;
+    } else {
+        if (caplen < headerLength) return;
+        hdr->payloadSize = hdr->l4Size - headerLength;
+        hdr->payloadCaplen = caplen - headerLength;
+        if (hdr->payloadSize <= 0 || hdr->payloadCaplen <= 0) return;
+    }
+    hdr->payload = hdr->l4 + headerLength;
+}
+
+int nan_parse(const char *bytes, int caplen, parsed_hdr_t *hdr) {
+    if (nan_parse_eth(bytes, caplen, hdr)) return -1;
+
+    hdr->protocol = hdr->fragOffset = -1;
+    hdr->srcIP = hdr->dstIP = hdr->flowLabel = -1;
+    hdr->frag = -1;
+    hdr->l4 = hdr->l4Caplen = hdr->l4Size = -1;
+    hdr->srcPort = hdr->dstPort = -1;
+    hdr->payload = -1;
+    hdr->payloadCaplen = hdr->payloadSize = 0;
+
+    if (hdr->ethertype == ETH_PROTO_IPv4) nan_parse_ipv4(bytes, hdr);
+    else if (hdr->ethertype == ETH_PROTO_IPv6) nan_parse_ipv6(bytes, hdr);
+    else return 0;
+
+    if (hdr->protocol != IP_PROTO_TCP && hdr->protocol != IP_PROTO_UDP) return 0;
+    // later IPv6 fragments don't start with the TCP or UDP header
+    if (hdr->ethertype == ETH_PROTO_IPv6 && hdr->fragOffset) return 0;
+    nan_parse_l4(bytes, hdr);
+
+    return 0;
+}
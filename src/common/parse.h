@@ -0,0 +1,62 @@
+/*
+ * parse.h
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#ifndef PARSE_H_
+#define PARSE_H_
+
+#include "eth.h"
+#include "ip.h"
+#include "ip6.h"
+
+// headers of a frame, walked once (offsets from the first byte of the frame)
+typedef struct {
+    // Ethernet
+    int             frameType;      /**< frame type (ETH_FRAMETYPE_ERROR: the rest is not set) */
+    int             src;            /**< source MAC (-1: not captured) */
+    int             dst;            /**< destination MAC */
+    int             vlan;           /**< VLAN tag (0: untagged, -1: not captured) */
+    unsigned short  ethertype;      /**< ethertype (0: unknown or not captured) */
+    int             l3;             /**< Ethernet payload */
+    int             l3Caplen;       /**< its captured size (negative: truncated Ethernet header) */
+
+    // IPv4 or IPv6 (ethertype ETH_PROTO_IPv4 or ETH_PROTO_IPv6)
+    int             protocol;       /**< underlying protocol, after IPv6 extension headers (-1: not captured) */
+    int             fragOffset;     /**< fragment offset in bytes (-1: not captured) */
+    unsigned int    srcIP;          /**< IPv4 source IP, network order (-1: not captured) */
+    unsigned int    dstIP;          /**< IPv4 destination IP, network order (-1: not captured) */
+    unsigned int    flowLabel;      /**< IPv6 flow label (-1: not captured) */
+    int             frag;           /**< IPv6 fragment header (-1: none or not captured) */
+    int             l4;             /**< IP payload (-1: none) */
+    int             l4Caplen;       /**< its captured size (-1: unknown) */
+    int             l4Size;         /**< its real size (-1: unknown) */
+
+    // TCP or UDP (protocol IP_PROTO_TCP or IP_PROTO_UDP, not in a later IPv6 fragment)
+    int             srcPort;        /**< source port (-1: not captured) */
+    int             dstPort;        /**< destination port (-1: not captured) */
+    int             payload;        /**< TCP or UDP payload (-1: none) */
+    int             payloadCaplen;  /**< its captured size */
+    int             payloadSize;    /**< its real size */
+} parsed_hdr_t;
+
+// parse every header of a frame in one pass (error: -1, ETH_FRAMETYPE_ERROR)
+int nan_parse(const char *bytes, int caplen, parsed_hdr_t *hdr);
+
+// parse the Ethernet header only (error: -1)
+int nan_parse_eth(const char *bytes, int caplen, parsed_hdr_t *hdr);
+
+// parse the IPv4 header at hdr->l3 (hdr->l3Caplen bytes captured)
+void nan_parse_ipv4(const char *bytes, parsed_hdr_t *hdr);
+
+// parse the IPv6 header and its extension headers at hdr->l3 (hdr->l3Caplen bytes captured)
+void nan_parse_ipv6(const char *bytes, parsed_hdr_t *hdr);
+
+// parse the TCP or UDP header (hdr->protocol) at hdr->l4 (hdr->l4Caplen bytes captured out of hdr->l4Size)
+void nan_parse_l4(const char *bytes, parsed_hdr_t *hdr);
+
+#endif /* PARSE_H_ */
@@ -8,6 +8,7 @@
  */
 
 #include "tcp.h"
+#include "parse.h"
 #include <stdlib.h>
 #include <arpa/inet.h>
 
@@ -42,24 +43,18 @@ int tcp_get_window(TCPSegment_t *sgmt) {
 }
 
 const char *tcp_get_data(TCPSegment_t *sgmt, int *newSize, int *tcpDataLength) {
+    parsed_hdr_t    hdr = { .protocol = IP_PROTO_TCP, .l4 = 0 };
+
     if (newSize) *newSize = 0;
     if (tcpDataLength) *tcpDataLength = 0;
     if (!sgmt) return NULL;
-    
-    if (sgmt->caplen < 13) return NULL; // No llega hasta el campo de longitud
-    
-    unsigned char   headerLength = ((sgmt->bytes->dataOffset_Reserved >> 4)&0x0F)*4;
 
-    if (sgmt->caplen < headerLength) return NULL;
-    
-    if (tcpDataLength) {
-        *tcpDataLength = sgmt->size - headerLength;
-        if (*tcpDataLength<=0) return NULL;
-    }
-    if (newSize) {
-        *newSize = sgmt->caplen - headerLength;
-        if (*newSize<=0) return NULL;
-    }
-    
-    return (const char*)(((char*)sgmt->bytes)+headerLength);
+    hdr.l4Caplen = sgmt->caplen;
+    hdr.l4Size = sgmt->size;
+    nan_parse_l4((const char*)sgmt->bytes, &hdr);
+
+    if (newSize) *newSize = hdr.payloadCaplen;
+    if (tcpDataLength) *tcpDataLength = hdr.payloadSize;
+    if (hdr.payload < 0) return NULL;
+    return ((const char*)sgmt->bytes)+hdr.payload;
 }
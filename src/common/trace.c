@@ -0,0 +1,207 @@
+/*
+ * trace.c
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+// classic PCAP magic numbers
+#define TRACE_MAGIC_USEC            0xa1b2c3d4
+#define TRACE_MAGIC_NSEC            0xa1b23c4d
+#define TRACE_MAGIC_USEC_SWAPPED    0xd4c3b2a1
+#define TRACE_MAGIC_NSEC_SWAPPED    0x4d3cb2a1
+
+#define TRACE_FILE_HEADER   24  /**< magic, version, thiszone, sigfigs, snaplen, linktype */
+#define TRACE_REC_HEADER    16  /**< ts_sec, ts_frac, caplen, len */
+
+struct trace {
+    pcap_t              *pcap;      /**< libpcap handle (file not mapped) */
+    const u_char        *map;       /**< mapped file */
+    size_t              size;       /**< size of the file */
+    size_t              offset;     /**< offset of the next record */
+    int                 swapped;    /**< byte order differs from ours */
+    int                 nsec;       /**< nanosecond timestamps */
+    int                 snaplen;    /**< snaplen from the file header */
+    int                 linktype;   /**< link-layer header type */
+    int                 filtered;   /**< a BPF filter is installed */
+    struct bpf_program  bpf;        /**< BPF filter */
+};
+
+static inline unsigned int trace_u32(trace_t *trace, const u_char *ptr) {
+    unsigned int x;
+    memcpy(&x, ptr, sizeof(x));
+    return trace->swapped ? __builtin_bswap32(x) : x;
+}
+
+// private: maps a classic PCAP file and checks its header (0 on success)
+static int trace_map(trace_t *trace, const char *file) {
+    struct stat st;
+    void *map = MAP_FAILED;
+
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) return -1;
+    if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size >= TRACE_FILE_HEADER)
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    trace->map = map;
+    trace->size = st.st_size;
+    switch (*(const unsigned int *)map) {
+        case TRACE_MAGIC_USEC:          trace->swapped = 0; trace->nsec = 0; break;
+        case TRACE_MAGIC_NSEC:          trace->swapped = 0; trace->nsec = 1; break;
+        case TRACE_MAGIC_USEC_SWAPPED:  trace->swapped = 1; trace->nsec = 0; break;
+        case TRACE_MAGIC_NSEC_SWAPPED:  trace->swapped = 1; trace->nsec = 1; break;
+        default:
+            munmap(map, st.st_size);
+            trace->map = NULL;
+            return -1;
+    }
+    trace->snaplen = trace_u32(trace, trace->map + 16);
+    trace->linktype = trace_u32(trace, trace->map + 20) & 0x03FFFFFF;
+    trace->offset = TRACE_FILE_HEADER;
+
+    // hints: read ahead and, where supported, back it with huge pages
+#ifdef MADV_SEQUENTIAL
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_HUGEPAGE
+    madvise(map, st.st_size, MADV_HUGEPAGE);
+#endif
+
+    return 0;
+}
+
+trace_t *trace_open(const char *file, char *errbuf) {
+    if (!file) return NULL;
+
+    trace_t *trace = calloc(1, sizeof(trace_t));
+    if (!trace) {
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "trace_open > calloc failed");
+        return NULL;
+    }
+
+    if (trace_map(trace, file)) {
+        trace->pcap = pcap_open_offline_with_tstamp_precision(file, PCAP_TSTAMP_PRECISION_NANO, errbuf);
+        if (!trace->pcap) {
+            free(trace);
+            return NULL;
+        }
+        trace->linktype = pcap_datalink(trace->pcap);
+    }
+
+    return trace;
+}
+
+inline int trace_is_mapped(trace_t *trace) {
+    if (!trace) return 0;
+    return trace->map != NULL;
+}
+
+inline int trace_datalink(trace_t *trace) {
+    if (!trace) return -1;
+    return trace->linktype;
+}
+
+inline int trace_snaplen(trace_t *trace) {
+    if (!trace) return -1;
+    if (trace->pcap) return pcap_snapshot(trace->pcap);
+    return trace->snaplen;
+}
+
+inline int trace_tstamp_precision(trace_t *trace) {
+    if (!trace) return -1;
+    return trace->pcap || trace->nsec ? PCAP_TSTAMP_PRECISION_NANO : PCAP_TSTAMP_PRECISION_MICRO;
+}
+
+int trace_setfilter(trace_t *trace, const char *filter, char *errbuf) {
+    if (!trace) return -1;
+    if (!filter) return 0;
+    if (trace->filtered) {
+        pcap_freecode(&trace->bpf);
+        trace->filtered = 0;
+    }
+
+    if (trace->pcap) {
+        if (pcap_compile(trace->pcap, &trace->bpf, filter, 1, 0) || pcap_setfilter(trace->pcap, &trace->bpf)) {
+            snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s", pcap_geterr(trace->pcap));
+            return -1;
+        }
+    } else if (pcap_compile_nopcap(trace->snaplen, trace->linktype, &trace->bpf, filter, 1, 0)) {
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "syntax error in filter expression");
+        return -1;
+    }
+    trace->filtered = 1;
+
+    return 0;
+}
+
+int trace_loop(trace_t *trace, int cnt, pcap_handler callback, u_char *user) {
+    if (!trace || !callback) return -1;
+    if (trace->pcap) return pcap_loop(trace->pcap, cnt, callback, user);
+
+    struct pcap_pkthdr header;
+    const u_char *rec, *bytes;
+    int n = 0;
+
+    while (cnt <= 0 || n < cnt) {
+        if (trace->offset == trace->size) break;
+        if (trace->offset + TRACE_REC_HEADER > trace->size) {
+            fprintf(stderr, "Error: trace_loop > truncated record header at offset %zu\n", trace->offset);
+            return -1;
+        }
+        rec = trace->map + trace->offset;
+        bytes = rec + TRACE_REC_HEADER;
+
+        header.ts.tv_sec = trace_u32(trace, rec);
+        header.ts.tv_usec = trace_u32(trace, rec + 4);
+        header.caplen = trace_u32(trace, rec + 8);
+        header.len = trace_u32(trace, rec + 12);
+        if (!trace->nsec) header.ts.tv_usec *= 1000;
+        if (header.caplen > TRACE_MAX_CAPLEN || trace->offset + TRACE_REC_HEADER + header.caplen > trace->size) {
+            fprintf(stderr, "Error: trace_loop > truncated or corrupt record at offset %zu\n", trace->offset);
+            return -1;
+        }
+        trace->offset += TRACE_REC_HEADER + header.caplen;
+
+        if (trace->filtered && !bpf_filter(trace->bpf.bf_insns, bytes, header.len, header.caplen)) continue;
+        callback(user, &header, bytes);
+        n++;
+    }
+
+    return 0;
+}
+
+int trace_seek(trace_t *trace, unsigned long long offset) {
+    if (!trace || !trace->map) return -1;
+    if (offset < TRACE_FILE_HEADER || offset > trace->size) return -1;
+
+    trace->offset = offset;
+    return 0;
+}
+
+inline unsigned long long trace_tell(trace_t *trace) {
+    if (!trace) return 0;
+    if (trace->pcap) return (unsigned long long)ftello(pcap_file(trace->pcap));
+    return trace->offset;
+}
+
+void trace_close(trace_t *trace) {
+    if (!trace) return;
+
+    if (trace->filtered) pcap_freecode(&trace->bpf);
+    if (trace->pcap) pcap_close(trace->pcap);
+    if (trace->map) munmap((void *)trace->map, trace->size);
+    free(trace);
+}
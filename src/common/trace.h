@@ -0,0 +1,56 @@
+/*
+ * trace.h
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#ifndef TRACE_MAX_CAPLEN
+#define TRACE_MAX_CAPLEN 262144     /**< larger records are considered corrupt */
+#endif
+
+#include <pcap/pcap.h>
+
+// PCAP file reader: classic PCAP files (any byte order, micro- or nanosecond
+// timestamps) are mapped into memory and packets are handed out without copies;
+// anything else (pcapng, pipes...) is read through libpcap
+//
+// Timestamps always have nanosecond resolution: ts.tv_usec holds nanoseconds,
+// as with libpcap's PCAP_TSTAMP_PRECISION_NANO (see utils_ts2ns())
+typedef struct trace trace_t;
+
+// open a file (errbuf: at least PCAP_ERRBUF_SIZE bytes)
+trace_t *trace_open(const char *file, char *errbuf);
+
+// is the file mapped? (if so, packet bytes remain valid until trace_close())
+int trace_is_mapped(trace_t *trace);
+
+// link-layer header type
+int trace_datalink(trace_t *trace);
+
+// snapshot length
+int trace_snaplen(trace_t *trace);
+
+// timestamp precision of the file (PCAP_TSTAMP_PRECISION_MICRO/NANO; NANO if read through libpcap)
+int trace_tstamp_precision(trace_t *trace);
+
+// install a BPF filter (NULL: every packet)
+int trace_setfilter(trace_t *trace, const char *filter, char *errbuf);
+
+// process packets like pcap_loop() (nanosecond timestamps): 0 at the end of the file, -1 on error
+int trace_loop(trace_t *trace, int cnt, pcap_handler callback, u_char *user);
+
+// current offset in the file
+unsigned long long trace_tell(trace_t *trace);
+
+// move to the record at a given offset (mapped files only): 0 on success, -1 on error
+int trace_seek(trace_t *trace, unsigned long long offset);
+
+void trace_close(trace_t *trace);
+
+#endif /* TRACE_H_ */
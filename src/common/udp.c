@@ -8,6 +8,7 @@
  */
 
 #include "udp.h"
+#include "parse.h"
 #include <stdlib.h>
 #include <arpa/inet.h>
 
@@ -24,17 +25,17 @@ int udp_get_dst(UDPDatagram_t *datagrama) {
 }
 
 const char *udp_get_data(UDPDatagram_t *datagrama, int *newSize, int *udpDataLength) {
+    parsed_hdr_t    hdr = { .protocol = IP_PROTO_UDP, .l4 = 0 };
+
     if (!datagrama) return NULL;
-    
-    if (datagrama->caplen < 6) return NULL; // No llega hasta el campo de longitud
-    
-    unsigned char   headerLength = 8;
+    if (datagrama->caplen < 8) return NULL; // No llega al final de la cabecera: las longitudes no se tocan
+
+    hdr.l4Caplen = datagrama->caplen;
+    hdr.l4Size = datagrama->size;
+    nan_parse_l4((const char*)datagrama->bytes, &hdr);
 
-    if (datagrama->caplen < headerLength) return NULL;
-    
-    *udpDataLength = datagrama->size - headerLength;
-    *newSize = datagrama->caplen - headerLength;
-    
-    if ((*newSize<=0)||(*udpDataLength<=0)) return NULL;
-    return (const char*)(((char*)datagrama->bytes)+headerLength);
+    *udpDataLength = hdr.payloadSize;
+    *newSize = hdr.payloadCaplen;
+    if (hdr.payload < 0) return NULL;
+    return ((const char*)datagrama->bytes)+hdr.payload;
 }
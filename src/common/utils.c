@@ -25,21 +25,164 @@ inline long double utils_timespec2float(struct timespec *tv) {
     return ret;
 }
 
-inline void utils_mac2txt(const char *macAddress, char *txt) {
-    //static char txt[20];
-    unsigned char *mac = (unsigned char*)macAddress;    
-    char aux[5];
-    int i = 0;
-    
-    txt[0] = 0;
-    for (i = 0; i < 5; i++) {
-        if (mac[i] < 16) sprintf(aux, "0%x:", mac[i]&0xFF);
-        else sprintf(aux, "%x:", mac[i]&0xFF);
-        strcat(txt, aux);
+inline int64_t utils_ts2ns(const struct timeval *ts) {
+    if (!ts) return -1;
+    return (int64_t)ts->tv_sec*1000000000 + ts->tv_usec;
+}
+
+// decimal digits, two at a time
+static const char utils_digits2[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// lowercase hex digits
+static const char utils_hex[17] = "0123456789abcdef";
+
+// decimal text of a byte (dotted quads): digits, length
+static const char utils_dec8[256][4] = {
+    {'0',0,0,1}, {'1',0,0,1}, {'2',0,0,1}, {'3',0,0,1}, {'4',0,0,1}, {'5',0,0,1}, {'6',0,0,1}, {'7',0,0,1},
+    {'8',0,0,1}, {'9',0,0,1}, {'1','0',0,2}, {'1','1',0,2}, {'1','2',0,2}, {'1','3',0,2}, {'1','4',0,2}, {'1','5',0,2},
+    {'1','6',0,2}, {'1','7',0,2}, {'1','8',0,2}, {'1','9',0,2}, {'2','0',0,2}, {'2','1',0,2}, {'2','2',0,2}, {'2','3',0,2},
+    {'2','4',0,2}, {'2','5',0,2}, {'2','6',0,2}, {'2','7',0,2}, {'2','8',0,2}, {'2','9',0,2}, {'3','0',0,2}, {'3','1',0,2},
+    {'3','2',0,2}, {'3','3',0,2}, {'3','4',0,2}, {'3','5',0,2}, {'3','6',0,2}, {'3','7',0,2}, {'3','8',0,2}, {'3','9',0,2},
+    {'4','0',0,2}, {'4','1',0,2}, {'4','2',0,2}, {'4','3',0,2}, {'4','4',0,2}, {'4','5',0,2}, {'4','6',0,2}, {'4','7',0,2},
+    {'4','8',0,2}, {'4','9',0,2}, {'5','0',0,2}, {'5','1',0,2}, {'5','2',0,2}, {'5','3',0,2}, {'5','4',0,2}, {'5','5',0,2},
+    {'5','6',0,2}, {'5','7',0,2}, {'5','8',0,2}, {'5','9',0,2}, {'6','0',0,2}, {'6','1',0,2}, {'6','2',0,2}, {'6','3',0,2},
+    {'6','4',0,2}, {'6','5',0,2}, {'6','6',0,2}, {'6','7',0,2}, {'6','8',0,2}, {'6','9',0,2}, {'7','0',0,2}, {'7','1',0,2},
+    {'7','2',0,2}, {'7','3',0,2}, {'7','4',0,2}, {'7','5',0,2}, {'7','6',0,2}, {'7','7',0,2}, {'7','8',0,2}, {'7','9',0,2},
+    {'8','0',0,2}, {'8','1',0,2}, {'8','2',0,2}, {'8','3',0,2}, {'8','4',0,2}, {'8','5',0,2}, {'8','6',0,2}, {'8','7',0,2},
+    {'8','8',0,2}, {'8','9',0,2}, {'9','0',0,2}, {'9','1',0,2}, {'9','2',0,2}, {'9','3',0,2}, {'9','4',0,2}, {'9','5',0,2},
+    {'9','6',0,2}, {'9','7',0,2}, {'9','8',0,2}, {'9','9',0,2}, {'1','0','0',3}, {'1','0','1',3}, {'1','0','2',3}, {'1','0','3',3},
+    {'1','0','4',3}, {'1','0','5',3}, {'1','0','6',3}, {'1','0','7',3}, {'1','0','8',3}, {'1','0','9',3}, {'1','1','0',3}, {'1','1','1',3},
+    {'1','1','2',3}, {'1','1','3',3}, {'1','1','4',3}, {'1','1','5',3}, {'1','1','6',3}, {'1','1','7',3}, {'1','1','8',3}, {'1','1','9',3},
+    {'1','2','0',3}, {'1','2','1',3}, {'1','2','2',3}, {'1','2','3',3}, {'1','2','4',3}, {'1','2','5',3}, {'1','2','6',3}, {'1','2','7',3},
+    {'1','2','8',3}, {'1','2','9',3}, {'1','3','0',3}, {'1','3','1',3}, {'1','3','2',3}, {'1','3','3',3}, {'1','3','4',3}, {'1','3','5',3},
+    {'1','3','6',3}, {'1','3','7',3}, {'1','3','8',3}, {'1','3','9',3}, {'1','4','0',3}, {'1','4','1',3}, {'1','4','2',3}, {'1','4','3',3},
+    {'1','4','4',3}, {'1','4','5',3}, {'1','4','6',3}, {'1','4','7',3}, {'1','4','8',3}, {'1','4','9',3}, {'1','5','0',3}, {'1','5','1',3},
+    {'1','5','2',3}, {'1','5','3',3}, {'1','5','4',3}, {'1','5','5',3}, {'1','5','6',3}, {'1','5','7',3}, {'1','5','8',3}, {'1','5','9',3},
+    {'1','6','0',3}, {'1','6','1',3}, {'1','6','2',3}, {'1','6','3',3}, {'1','6','4',3}, {'1','6','5',3}, {'1','6','6',3}, {'1','6','7',3},
+    {'1','6','8',3}, {'1','6','9',3}, {'1','7','0',3}, {'1','7','1',3}, {'1','7','2',3}, {'1','7','3',3}, {'1','7','4',3}, {'1','7','5',3},
+    {'1','7','6',3}, {'1','7','7',3}, {'1','7','8',3}, {'1','7','9',3}, {'1','8','0',3}, {'1','8','1',3}, {'1','8','2',3}, {'1','8','3',3},
+    {'1','8','4',3}, {'1','8','5',3}, {'1','8','6',3}, {'1','8','7',3}, {'1','8','8',3}, {'1','8','9',3}, {'1','9','0',3}, {'1','9','1',3},
+    {'1','9','2',3}, {'1','9','3',3}, {'1','9','4',3}, {'1','9','5',3}, {'1','9','6',3}, {'1','9','7',3}, {'1','9','8',3}, {'1','9','9',3},
+    {'2','0','0',3}, {'2','0','1',3}, {'2','0','2',3}, {'2','0','3',3}, {'2','0','4',3}, {'2','0','5',3}, {'2','0','6',3}, {'2','0','7',3},
+    {'2','0','8',3}, {'2','0','9',3}, {'2','1','0',3}, {'2','1','1',3}, {'2','1','2',3}, {'2','1','3',3}, {'2','1','4',3}, {'2','1','5',3},
+    {'2','1','6',3}, {'2','1','7',3}, {'2','1','8',3}, {'2','1','9',3}, {'2','2','0',3}, {'2','2','1',3}, {'2','2','2',3}, {'2','2','3',3},
+    {'2','2','4',3}, {'2','2','5',3}, {'2','2','6',3}, {'2','2','7',3}, {'2','2','8',3}, {'2','2','9',3}, {'2','3','0',3}, {'2','3','1',3},
+    {'2','3','2',3}, {'2','3','3',3}, {'2','3','4',3}, {'2','3','5',3}, {'2','3','6',3}, {'2','3','7',3}, {'2','3','8',3}, {'2','3','9',3},
+    {'2','4','0',3}, {'2','4','1',3}, {'2','4','2',3}, {'2','4','3',3}, {'2','4','4',3}, {'2','4','5',3}, {'2','4','6',3}, {'2','4','7',3},
+    {'2','4','8',3}, {'2','4','9',3}, {'2','5','0',3}, {'2','5','1',3}, {'2','5','2',3}, {'2','5','3',3}, {'2','5','4',3}, {'2','5','5',3}
+};
+
+inline char *utils_fmt_u64(char *txt, unsigned long long value) {
+    char aux[20], *p = aux + sizeof(aux);
+
+    while (value >= 100) {
+        p -= 2;
+        memcpy(p, utils_digits2 + 2*(value % 100), 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        p -= 2;
+        memcpy(p, utils_digits2 + 2*value, 2);
+    } else *--p = '0' + value;
+
+    memcpy(txt, p, aux + sizeof(aux) - p);
+    return txt + (aux + sizeof(aux) - p);
+}
+
+inline char *utils_fmt_i64(char *txt, long long value) {
+    if (value < 0) {
+        *txt++ = '-';
+        return utils_fmt_u64(txt, -(unsigned long long)value);
+    }
+    return utils_fmt_u64(txt, value);
+}
+
+inline char *utils_fmt_ns(char *txt, int64_t ns) {
+    uint64_t abs = ns < 0 ? -(uint64_t)ns : (uint64_t)ns;
+    unsigned int frac = abs % 1000000000;
+
+    if (ns < 0) *txt++ = '-';
+    txt = utils_fmt_u64(txt, abs / 1000000000);
+    *txt++ = '.';
+    // 9 digits, zero-padded
+    txt[8] = '0' + frac % 10;
+    frac /= 10;
+    for (int i = 6; i >= 0; i -= 2, frac /= 100)
+        memcpy(txt + i, utils_digits2 + 2*(frac % 100), 2);
+    return txt + 9;
+}
+
+inline char *utils_fmt_mac(char *txt, const char *macAddress) {
+    const unsigned char *mac = (const unsigned char *)macAddress;
+
+    for (int i = 0; i < 6; i++) {
+        *txt++ = utils_hex[mac[i] >> 4];
+        *txt++ = utils_hex[mac[i] & 0x0f];
+        *txt++ = ':';
     }
-    if (mac[i] < 16) sprintf(aux, "0%x", mac[i]&0xFF);
-    else sprintf(aux, "%x", mac[i]&0xFF);
-    strcat(txt, aux);
+    return txt - 1;
+}
+
+inline char *utils_fmt_ip4(char *txt, const void *addr) {
+    const unsigned char *ip = (const unsigned char *)addr;
+
+    for (int i = 0; i < 4; i++) {
+        memcpy(txt, utils_dec8[ip[i]], 3);
+        txt += utils_dec8[ip[i]][3];
+        *txt++ = '.';
+    }
+    return txt - 1;
+}
+
+inline char *utils_fmt_ip6(char *txt, const void *addr) {
+    // rare enough to leave the :: compression to libc
+    inet_ntop(AF_INET6, addr, txt, INET6_ADDRSTRLEN);
+    return txt + strlen(txt);
+}
+
+void utils_ns2txt(int64_t ns, char *txt) {
+    *utils_fmt_ns(txt, ns) = 0;
+}
+
+// private: 64-bit finalizer (MurmurHash3)
+static inline unsigned long long utils_fmix64(unsigned long long h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+inline unsigned long long utils_hash64(const void *data, size_t size, unsigned long long seed) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    unsigned long long h = seed ^ (size * 0x9e3779b97f4a7c15ULL);
+    unsigned long long word;
+
+    // a negative size converted to size_t
+    UTILS_CHECK((ssize_t)size < 0, EINVAL, return utils_fmix64(seed));
+
+    for (; size >= 8; size -= 8, bytes += 8) {
+        memcpy(&word, bytes, 8);
+        word *= 0x87c37b91114253d5ULL;
+        word = (word << 31) | (word >> 33);
+        h ^= word * 0x4cf5ad432745937fULL;
+        h = ((h << 27) | (h >> 37)) * 5 + 0x52dce729;
+    }
+    word = 0;
+    if (size) memcpy(&word, bytes, size);
+    h ^= word * 0x87c37b91114253d5ULL;
+
+    return utils_fmix64(h);
+}
+
+inline void utils_mac2txt(const char *macAddress, char *txt) {
+    *utils_fmt_mac(txt, macAddress) = 0;
 }
 
 unsigned long long utils_fsize(char *file) {
@@ -48,7 +191,7 @@ unsigned long long utils_fsize(char *file) {
     return (unsigned long long)buf.st_size;
 }
 
-inline void utils_print_progress(pcap_t *cap, unsigned long long size) {
+inline int utils_print_progress(unsigned long long pos, unsigned long long size) {
     static double realTimeLastLog = 0;
     static int lastPercent = -1;
     
@@ -57,14 +200,15 @@ inline void utils_print_progress(pcap_t *cap, unsigned long long size) {
     double presentTime = presentTime_tv.tv_sec+presentTime_tv.tv_usec/1000000.0;
 
     if (realTimeLastLog == 0) realTimeLastLog = presentTime;
-    if (presentTime-realTimeLastLog <= UTILS_MAXTIME_SHOWPROGRESS) return;
+    if (presentTime-realTimeLastLog <= UTILS_MAXTIME_SHOWPROGRESS) return 0;
     realTimeLastLog = presentTime;
 
     // Calculate the ratio of complete-to-incomplete.
-    unsigned long long x = (unsigned long long)ftello(pcap_file(cap));
+    unsigned long long x = pos;
     int percent = (int)(x * 10000 / (float)size);
-    if (percent <= lastPercent) return;
+    if (percent <= lastPercent) return 0;
     lastPercent = percent;
 
     fprintf(stderr, "Progress: %0.2f %% (%llu of %llu)\n", percent/(float)100, x, size);
+    return 1;
 }
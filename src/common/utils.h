@@ -15,11 +15,14 @@
 #endif
 
 #include <stdio.h>
+#include <stdint.h>
 #include <sys/time.h>
 #include <string.h>
 #include <errno.h>
 #include <pcap/pcap.h>
 
+#define UTILS_NS_TXTLEN 24  // buffer size for utils_ns2txt()
+
 #define UTILS_CHECK(cond, err, ret) \
     if (cond) { \
         fprintf(stderr, "Error: %s : %s\n", __func__, strerror(err)); \
@@ -30,11 +33,30 @@ double utils_timeval2float(struct timeval *tv);
 
 long double utils_timespec2float(struct timespec *tv);
 
+// PCAP timestamp with nanosecond resolution (tv_usec holds nanoseconds) to nanoseconds
+int64_t utils_ts2ns(const struct timeval *ts);
+
+// get formatted nanoseconds as seconds: [-]S.NNNNNNNNN (txt: UTILS_NS_TXTLEN bytes)
+void utils_ns2txt(int64_t ns, char *txt);
+
+// allocation-free formatters: write the text at txt (no terminating NUL) and return its end
+// (utils_fmt_ip4() may write up to 2 bytes past the end, utils_fmt_ip6() the terminating NUL)
+char *utils_fmt_u64(char *txt, unsigned long long value);
+char *utils_fmt_i64(char *txt, long long value);
+char *utils_fmt_ns(char *txt, int64_t ns);              // as utils_ns2txt()
+char *utils_fmt_mac(char *txt, const char *mac);        // as utils_mac2txt()
+char *utils_fmt_ip4(char *txt, const void *addr);       // as inet_ntop(AF_INET, addr, ...)
+char *utils_fmt_ip6(char *txt, const void *addr);       // as inet_ntop(AF_INET6, addr, ...)
+
+// fast non-cryptographic 64-bit hash
+unsigned long long utils_hash64(const void *data, size_t size, unsigned long long seed);
+
 // get formatted MAC: AA:AA:AA:AA:AA:AA (always in the same buffer)
 void utils_mac2txt(const char *mac, char *txt);
 
 unsigned long long utils_fsize(char *file);
 
-void utils_print_progress(pcap_t *cap, unsigned long long size);
+// pos: current offset in the file (see trace_tell()); returns 1 if a line was printed
+int utils_print_progress(unsigned long long pos, unsigned long long size);
 
 #endif /* UTILS_H_ */
@@ -17,21 +17,37 @@
 #define obstack_chunk_alloc malloc
 #define obstack_chunk_free free
 
+#define BUFFER_CHUNK        (1ULL << BUFFER_CHUNK_SHIFT)        /**< nodes per chunk */
+#define BUFFER_ALIGN(x)     (((x) + 15) & ~(size_t)15)          /**< 16-byte alignment */
+#define BUFFER_NODE_SIZE    BUFFER_ALIGN(sizeof(node_t))        /**< node header, before its inline load */
+
 /**
  * Private buffer structure
+ *
+ * Nodes live in a ring of chunks, each one an array of BUFFER_CHUNK nodes. A node is
+ * identified by its sequence number (n-th node appended): nodes [head, tail) are in the
+ * buffer, and node n is the slot n%BUFFER_CHUNK of the chunk (n/BUFFER_CHUNK)%chunks.
  */
 struct buffer {
     unsigned int        id;                         /**< buffer/obstack identifier */
     unsigned int        workers;                    /**< number of threads that works with the node.inUse flag */
 
+    char                **chunk;                    /**< ring of chunks (NULL: not allocated yet) */
+    unsigned long long  chunks;                     /**< number of chunks in the ring (power of two) */
+    unsigned long long  allocated;                  /**< number of chunks allocated */
+    size_t              stride;                     /**< bytes per node (header and inline load) */
+    unsigned int        load_size;                  /**< bytes of inline load per node */
+
+    unsigned long long  head;                       /**< sequence number of the first node */
+    unsigned long long  tail;                       /**< sequence number of the next node */
     node_t              *first;                     /**< first node */
     node_t              *last;                      /**< last node */
-    node_t              *res;                       /**< resources: pointer to a list of free nodes */
     node_t              *mark[BUFFER_MAX_WORKERS];  /**< markers for workers */
 
-    unsigned long long  count;                      /**< number of nodes in the buffer */
-    unsigned long long  max_count;                  /**< maximum number of nodes allowed */
-    unsigned long long  free;                       /**< number of free nodes */
+    unsigned long long  size;                       /**< memory held by the nodes in the buffer */
+    unsigned long long  max_size;                   /**< maximum memory allowed */
+
+    void                (*release)(void *load);     /**< callback for releasing the content of removed nodes */
 
     pthread_mutex_t     mutex;                      /**< buffer mutex */
     pthread_mutex_t     cond_mutex;                 /**< buffer condition mutex */
@@ -85,12 +101,18 @@ inline void buffer_signal(buffer_t *buffer) {
  * This library is intended for sliding windows and uses GNU obstack.h in order to efficiently allocate large chunks of memory.
  * Each buffer is internally allocated in a separate obstack.
  *
+ * Nodes are stored in order in a ring of contiguous chunks, which doubles when it is full, so that
+ * walking the list touches consecutive memory. Each node may carry its content inline (load_size bytes,
+ * zeroed the first time, with node.load pointing to it).
+ *
  * @param workers number of concurrent threads
  * @see BUFFER_MAX_WORKERS
- * @param max_count maximum number of nodes allowed (in order to control memory usage with threads)
+ * @param max_size maximum memory held by the nodes (in order to control memory usage with threads)
+ * @see node.size
+ * @param load_size bytes of inline content per node (0: node.load is managed by the caller)
  * @return a pointer to the buffer (NULL if error)
  */
-buffer_t *buffer_init(unsigned int workers, unsigned long long max_count) {
+buffer_t *buffer_init(unsigned int workers, unsigned long long max_size, unsigned int load_size) {
     UTILS_CHECK(workers > BUFFER_MAX_WORKERS, EINVAL, return NULL);
 
     /* new pointer to struct obstack */
@@ -117,14 +139,24 @@ buffer_t *buffer_init(unsigned int workers, unsigned long long max_count) {
         perror("Error: buffer_init > obstack_alloc");
         return NULL;
     }
+    buffer->chunk = calloc(1, sizeof(char *));
+    if (!buffer->chunk) {
+        perror("Error: buffer_init > calloc");
+        return NULL;
+    }
     buffer->id = i;
     buffer->workers = workers;
-    buffer->count = 0;
-    buffer->max_count = max_count;
-    buffer->free = 0;
+    buffer->chunks = 1;
+    buffer->allocated = 0;
+    buffer->load_size = load_size;
+    buffer->stride = BUFFER_NODE_SIZE + BUFFER_ALIGN(load_size);
+    buffer->head = 0;
+    buffer->tail = 0;
+    buffer->size = 0;
+    buffer->max_size = max_size;
+    buffer->release = NULL;
     buffer->first = NULL;
     buffer->last = NULL;
-    buffer->res = NULL;
     pthread_mutex_init(&buffer->mutex, NULL);
     pthread_mutex_init(&buffer->cond_mutex, NULL);
     pthread_cond_init(&buffer->cond, NULL);
@@ -133,34 +165,97 @@ buffer_t *buffer_init(unsigned int workers, unsigned long long max_count) {
 }
 
 /**
- * @brief Creates a node (without modifying the current buffer)
- * @see buffer_append()
+ * @brief Sets a callback for releasing the content of removed nodes
+ * @see buffer_remove()
+ *
+ * The node keeps its load pointer, so the callback must leave it ready to be filled again.
+ *
+ * @param buffer the buffer
+ * @param release the callback (NULL to disable it)
+ */
+void buffer_set_release(buffer_t *buffer, void (*release)(void *load)) {
+    UTILS_CHECK(!buffer, EINVAL, return);
+
+    buffer->release = release;
+}
+
+/**
+ * @brief Doubles the ring of chunks
+ *
+ * It is called when every chunk holds nodes: they keep their memory and are placed
+ * where their sequence numbers belong in the new ring.
+ *
+ * @param buffer the buffer
+ * @return 0 on success, -1 on error
+ */
+static int buffer_grow(buffer_t *buffer) {
+    unsigned long long chunks = 2*buffer->chunks;
+    char **chunk = calloc(chunks, sizeof(char *));
+    if (!chunk) {
+        perror("Error: buffer_grow > calloc");
+        return -1;
+    }
+
+    for (unsigned long long c = buffer->head >> BUFFER_CHUNK_SHIFT; c < (buffer->tail >> BUFFER_CHUNK_SHIFT); c++)
+        chunk[c & (chunks-1)] = buffer->chunk[c & (buffer->chunks-1)];
+    free(buffer->chunk);
+    buffer->chunk = chunk;
+    buffer->chunks = chunks;
+
+    return 0;
+}
+
+/**
+ * @brief Gets the slot of a node in the ring
  *
- * This function pulls a node from resources (if available) or allocates a new one.
+ * Chunks are allocated (and zeroed) the first time they are needed.
  *
  * @param buffer the buffer
+ * @param seq sequence number of the node
  * @return a pointer to the node (NULL if error)
  */
-inline node_t *buffer_new(buffer_t *buffer) {
-    UTILS_CHECK(!buffer, EINVAL, return NULL);
+static inline node_t *buffer_slot(buffer_t *buffer, unsigned long long seq) {
+    char **chunk = &buffer->chunk[(seq >> BUFFER_CHUNK_SHIFT) & (buffer->chunks-1)];
 
-    node_t *node_new;
-    if (!buffer->free) {
-        node_new = obstack_alloc(buffer_obstack[buffer->id], sizeof(node_t));
-        if (!node_new) {
-            perror("Error: buffer_new > obstack_alloc");
+    if (!*chunk) {
+        *chunk = obstack_alloc(buffer_obstack[buffer->id], BUFFER_CHUNK*buffer->stride);
+        if (!*chunk) {
+            perror("Error: buffer_slot > obstack_alloc");
             return NULL;
         }
-        node_new->buffer = buffer;
-        node_new->load = NULL;
-        node_new->prev = NULL;
-        pthread_mutex_init(&node_new->mutex, NULL);
-    } else {
-        node_new = buffer->res;
-        buffer->res = buffer->res->next;
-        if (buffer->res) buffer->res->prev = NULL;
-        buffer->free--;
+        memset(*chunk, 0, BUFFER_CHUNK*buffer->stride);
+        for (unsigned long long i = 0; i < BUFFER_CHUNK; i++) {
+            node_t *node = (node_t *)(*chunk + i*buffer->stride);
+            node->buffer = buffer;
+            if (buffer->load_size) node->load = (char *)node + BUFFER_NODE_SIZE;
+        }
+        buffer->allocated++;
     }
+
+    return (node_t *)(*chunk + (seq & (BUFFER_CHUNK-1))*buffer->stride);
+}
+
+/**
+ * @brief Gets the next free node (without modifying the current buffer)
+ * @see buffer_append()
+ *
+ * This function returns the slot that follows the last node, growing the ring if needed.
+ * Until that node is appended, every call returns the same one.
+ *
+ * @param buffer the buffer
+ * @return a pointer to the node (NULL if error)
+ */
+inline node_t *buffer_new(buffer_t *buffer) {
+    UTILS_CHECK(!buffer, EINVAL, return NULL);
+
+    // the next chunk is the first one: every chunk is in use
+    if ((buffer->tail >> BUFFER_CHUNK_SHIFT) - (buffer->head >> BUFFER_CHUNK_SHIFT) == buffer->chunks)
+        if (buffer_grow(buffer)) return NULL;
+
+    node_t *node_new = buffer_slot(buffer, buffer->tail);
+    if (!node_new) return NULL;
+    node_new->seq = buffer->tail;
+    node_new->prev = NULL;
     node_new->next = NULL;
     node_new->inUse = 0;
 
@@ -168,63 +263,53 @@ inline node_t *buffer_new(buffer_t *buffer) {
 }
 
 /**
- * @brief Appends a node previously created
+ * @brief Appends the node previously returned by buffer_new()
  * @see buffer_new()
  *
- * This function doesn't check if the node passed belongs to the buffer.
- *
  * @param buffer the buffer
  * @param node the node to append
  * @return 0 on success, -1 on error
  */
 inline int buffer_append(buffer_t *buffer, node_t *node) {
-    UTILS_CHECK(!buffer || !node, EINVAL, return -1);
+    UTILS_CHECK(!buffer || !node || node->buffer != buffer, EINVAL, return -1);
 
-    if (!buffer->count) buffer->first = node;
+    if (buffer->head == buffer->tail) buffer->first = node;
     else {
         buffer->last->next = node;
         node->prev = buffer->last;
     }
     buffer->last = node;
-    buffer->count++;
+    buffer->tail++;
+    buffer->size += node->size;
 
     return 0;
 }
 
 /**
- * @brief Removes a node
+ * @brief Removes the first node
  *
- * Its memory is not freed: the node is pushed to the resources list.
+ * Its memory is not freed: the slot becomes free again, and its content is handed to
+ * the release callback (if any).
  *
- * @param node the node
+ * @param node the node (it must be the first one)
  * @return 0 on success, -1 on error
  */
 inline int buffer_remove(node_t *node) {
-    UTILS_CHECK(!node || !node->buffer->count, EINVAL, return -1);
+    UTILS_CHECK(!node || node != node->buffer->first, EINVAL, return -1);
 
     buffer_t *buffer = node->buffer;
-    if (buffer->count==1) {
+    buffer->head++;
+    if (buffer->head == buffer->tail) {
         buffer->first = NULL;
         buffer->last = NULL;
     } else {
-        if (node == buffer->first) {
-            buffer->first = buffer->first->next;
-            buffer->first->prev = NULL;
-        }
-        else if (node == buffer->last) {
-            buffer->last = buffer->last->prev;
-            buffer->last->next = NULL;
-        } else {
-            node->prev->next = node->next;
-            node->next->prev = node->prev;
-        }
+        buffer->first = node->next;
+        buffer->first->prev = NULL;
     }
-    node->prev = NULL;
-    node->next = buffer->res;
-    if (buffer->free) buffer->res->prev = node;
-    buffer->res = node;
-    buffer->free++;
-    buffer->count--;
+    node->next = NULL;
+    buffer->size -= node->size;
+    node->size = 0;
+    if (buffer->release && node->load) buffer->release(node->load);
 
     return 0;
 }
@@ -237,7 +322,7 @@ inline int buffer_remove(node_t *node) {
 inline void buffer_print(buffer_t *buffer) {
     UTILS_CHECK(!buffer, EINVAL, return);
 
-    fprintf(stderr, "#bufferID: %u count: %llu free: %llu\n", buffer->id, buffer->count, buffer->free);
+    fprintf(stderr, "#bufferID: %u count: %llu free: %llu size: %llu\n", buffer->id, buffer_get_count(buffer), buffer_get_free(buffer), buffer->size);
 }
 
 /**
@@ -245,27 +330,22 @@ inline void buffer_print(buffer_t *buffer) {
  *
  * @param node the node
  * @param id thread identifier
- * @return 0 on success, -1 on error
  */
 static inline void buffer_set_inUse(node_t *node, unsigned int id) {
-    pthread_mutex_lock(&node->mutex);
-    node->inUse |= (1<<id);
-    //node->inUse++;
-    pthread_mutex_unlock(&node->mutex);
+    __atomic_fetch_or(&node->inUse, 1ULL<<id, __ATOMIC_RELEASE);
 }
 
 /**
  * @brief Unsets the node.inUse flag
  *
+ * The release pairs with the acquire in buffer_trim(): once the old marker is seen
+ * unset, the new one (set before) is visible too.
+ *
  * @param node the node
  * @param id thread identifier
- * @return 0 on success, -1 on error
  */
 static inline void buffer_unset_inUse(node_t *node, unsigned int id) {
-    pthread_mutex_lock(&node->mutex);
-    node->inUse &= ~(1<<id);
-    //node->inUse--;
-    pthread_mutex_unlock(&node->mutex);
+    __atomic_fetch_and(&node->inUse, ~(1ULL<<id), __ATOMIC_RELEASE);
 }
 
 /**
@@ -292,6 +372,25 @@ int buffer_init_markers(node_t *node) {
     return 0;
 }
 
+/**
+ * @brief Sets this node in use for a single worker
+ * @see buffer_init_markers()
+ *
+ * This is intended for buffers owned by one worker only.
+ *
+ * @param node the node
+ * @param id thread identifier
+ * @return 0 on success, -1 on error
+ */
+int buffer_init_marker(node_t *node, unsigned int id) {
+    UTILS_CHECK(!node || id >= BUFFER_MAX_WORKERS, EINVAL, return -1);
+
+    buffer_set_inUse(node, id);
+    node->buffer->mark[id] = node;
+
+    return 0;
+}
+
 /**
  * @brief Stores a marker for a particular worker
  *
@@ -300,7 +399,7 @@ int buffer_init_markers(node_t *node) {
  * @return 0 on success, -1 on error
  */
 inline int buffer_set_marker(node_t *node, unsigned int id) {
-    UTILS_CHECK(!node, EINVAL, return -1);
+    UTILS_CHECK(!node || id >= BUFFER_MAX_WORKERS, EINVAL, return -1);
 
     buffer_set_inUse(node, id);
     buffer_unset_inUse(node->buffer->mark[id], id);
@@ -325,16 +424,19 @@ inline node_t *buffer_get_marker(buffer_t *buffer, unsigned int id) {
 /**
  * @brief Trims the buffer starting from the first node until the first node in use
  *
+ * Lock-free with respect to the workers: markers only move forward and a new one is
+ * set before the old one is unset, so the walk never goes past a node in use.
+ *
  * @param buffer the buffer
  * @return 0 on success, -1 on error, 1 if there are no nodes
  */
 inline int buffer_trim(buffer_t *buffer) {
     UTILS_CHECK(!buffer, EINVAL, return -1);
 
-    if (!buffer->count) return 1;
+    if (buffer->head == buffer->tail) return 1;
 
     node_t *node = buffer->first;
-    while (!node->inUse) {
+    while (!__atomic_load_n(&node->inUse, __ATOMIC_ACQUIRE)) {
         node = node->next;
         buffer_remove(node->prev);
     }
@@ -357,18 +459,7 @@ static inline void buffer_obstack_free(unsigned int id) {
 void buffer_destroy(buffer_t *buffer) {
     UTILS_CHECK(!buffer, EINVAL, return);
 
-    node_t *node = buffer->first;
-    while (node) {
-        pthread_mutex_destroy(&node->mutex);
-        node = node->next;
-    }
-
-    node = buffer->res;
-    while (node) {
-        pthread_mutex_destroy(&node->mutex);
-        node = node->next;
-    }
-
+    free(buffer->chunk);
     pthread_mutex_destroy(&buffer->mutex);
     pthread_mutex_destroy(&buffer->cond_mutex);
     pthread_cond_destroy(&buffer->cond);
@@ -388,17 +479,7 @@ inline void buffer_debug(buffer_t *buffer, void (*print_node)(void *load)) {
 
     node_t *node = buffer->first;
     fprintf(stderr, "########################");
-    for (int i=0; i<buffer->count; i++) {
-        if (i%4 == 0) fprintf(stderr, "\n");
-        fprintf(stderr, "|%llu|", node->inUse);
-        if (print_node) print_node(node->load);
-        fprintf(stderr, "| <--> ");
-        node = node->next;
-    }
-
-    node = buffer->res;
-    fprintf(stderr, "\n########################");
-    for (int i=0; i<buffer->free; i++) {
+    for (int i=0; node; i++) {
         if (i%4 == 0) fprintf(stderr, "\n");
         fprintf(stderr, "|%llu|", node->inUse);
         if (print_node) print_node(node->load);
@@ -467,7 +548,19 @@ inline int buffer_is_last(node_t *node) {
 inline unsigned long long buffer_get_count(buffer_t *buffer) {
     UTILS_CHECK(!buffer, EINVAL, return 0);
 
-    return buffer->count;
+    return buffer->tail - buffer->head;
+}
+
+/**
+ * @brief Gets the memory held by the nodes in a buffer
+ *
+ * @param buffer the buffer
+ * @return the sum of node.size
+ */
+inline unsigned long long buffer_get_size(buffer_t *buffer) {
+    UTILS_CHECK(!buffer, EINVAL, return 0);
+
+    return buffer->size;
 }
 
 /**
@@ -479,18 +572,18 @@ inline unsigned long long buffer_get_count(buffer_t *buffer) {
 inline int buffer_is_full(buffer_t *buffer) {
     UTILS_CHECK(!buffer, EINVAL, return -1);
 
-    if (buffer->count == buffer->max_count) return 1;
+    if (buffer->size >= buffer->max_size) return 1;
     return 0;
 }
 
 /**
- * @brief Gets the number of resources in a buffer
+ * @brief Gets the number of free slots in a buffer
  *
  * @param buffer the buffer
- * @return the number of free nodes
+ * @return the number of allocated nodes not in use
  */
 inline unsigned long long buffer_get_free(buffer_t *buffer) {
     UTILS_CHECK(!buffer, EINVAL, return 0);
 
-    return buffer->free;
+    return buffer->allocated*BUFFER_CHUNK - (buffer->tail - buffer->head);
 }
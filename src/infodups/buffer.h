@@ -12,21 +12,26 @@
 
 #define BUFFER_MAX_WORKERS 64   /**< maximum number of workers */
 
+#ifndef BUFFER_CHUNK_SHIFT
+#define BUFFER_CHUNK_SHIFT 12   /**< nodes per chunk of the ring (log2) */
+#endif
+
 #include <pthread.h>
 
 typedef struct node node_t;
 typedef struct buffer buffer_t;
 
 /**
- * Double-linked list
+ * Double-linked list over a ring of contiguous nodes (neighbours are adjacent in memory)
  */
 struct node {
-    unsigned long long  inUse;      /**< this flag can be used to mark the lower bound of a thread's window */
-    void                *load;      /**< Pointer to the node's content */
+    unsigned long long  inUse;      /**< bitmask (one bit per thread) marking the lower bound of the threads' windows (atomic) */
+    void                *load;      /**< Pointer to the node's content (stored inline if load_size > 0) */
+    unsigned long long  size;       /**< memory held by the node's content (set before appending the node) */
+    unsigned long long  seq;        /**< sequence number in the buffer (n-th node appended) */
     node_t              *prev;      /**< previous node */
     node_t              *next;      /**< next node */
     buffer_t            *buffer;    /**< pointer to the buffer */
-    pthread_mutex_t     mutex;      /**< node mutex */
 };
 
 // with threads
@@ -36,22 +41,26 @@ void buffer_wait(buffer_t *buffer);
 void buffer_signal(buffer_t *buffer);
 
 // initializer
-buffer_t *buffer_init(unsigned int workers, unsigned long long max_count);
+buffer_t *buffer_init(unsigned int workers, unsigned long long max_size, unsigned int load_size);
+
+// callback for releasing the content of removed nodes
+void buffer_set_release(buffer_t *buffer, void (*release)(void *load));
 
 // delete buffer and free the associated obstack
 void buffer_destroy(buffer_t *buffer);
 
-// create a new node
+// get the next free node (it must be appended before asking for another one)
 node_t *buffer_new(buffer_t *buffer);
 
 // append the new node
 int buffer_append(buffer_t *buffer, node_t *node);
 
-// remove node (move to resources)
+// remove the first node (back to free slots)
 int buffer_remove(node_t *node);
 
 // set/get markers
 int buffer_init_markers(node_t *node);
+int buffer_init_marker(node_t *node, unsigned int id);
 int buffer_set_marker(node_t *node, unsigned int id);
 node_t *buffer_get_marker(buffer_t *buffer, unsigned int id);
 
@@ -73,10 +82,13 @@ int buffer_is_last(node_t *node);
 // number of nodes in buffer
 unsigned long long buffer_get_count(buffer_t *buffer);
 
-// count reaches max_count
+// memory held by the nodes in buffer
+unsigned long long buffer_get_size(buffer_t *buffer);
+
+// size reaches max_size
 int buffer_is_full(buffer_t *buffer);
 
-// number of free nodes
+// number of free slots
 unsigned long long buffer_get_free(buffer_t *buffer);
 
 #endif /* BUFFER_H_ */
@@ -0,0 +1,537 @@
+/*
+ * chunk.c
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#include "chunk.h"
+#include "buffer.h"
+#include "dups.h"
+#include "../common/utils.h"
+#include "../common/trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#ifndef CHUNK_COPY
+#define CHUNK_COPY 65536    /**< bytes copied at once from the output of a chunk */
+#endif
+
+/**
+ * Checkpoint of the index
+ */
+typedef struct {
+    unsigned long long  offset;     /**< offset of the packet */
+    unsigned long long  pos;        /**< its position */
+    int64_t             maxTime;    /**< latest timestamp of the packets before it (ns) */
+} checkpoint_t;
+
+/**
+ * Chunk of a trace
+ */
+typedef struct chunk {
+    unsigned int        id;         /**< thread identifier */
+    pthread_t           thread;     /**< its thread */
+    trace_t             *trace;     /**< its own reader */
+    buffer_t            *window;    /**< its own window */
+    FILE                *output;    /**< records (a temporary file, except for the first chunk) */
+
+    unsigned long long  first;      /**< position of its first packet */
+    int64_t             time;       /**< earliest timestamp of its first packet and the previous one (ns) */
+    unsigned long long  count;      /**< number of packets */
+    unsigned long long  cp;         /**< checkpoint where the warm-up starts */
+    unsigned long long  warmup;     /**< packets before the chunk, read again to fill the window */
+    unsigned long long  pos;        /**< position of the last packet read */
+
+    unsigned long long  *head;      /**< signatures of the window after the warm-up */
+    unsigned long long  numHead;    /**< number of signatures */
+    unsigned long long  *tail;      /**< signatures of the window at the end (seen by the next chunk) */
+    unsigned long long  numTail;    /**< number of signatures */
+
+    pktStats_t          stats;      /**< packet statistics */
+    pktStats_t          *cur;       /**< statistics being updated (NULL while warming up) */
+    int                 ret;        /**< reader result (0 on success, -1 on error) */
+    struct chunk        *next;      /**< next chunk with packets */
+} chunk_t;
+
+/**
+ * Pool of chunks
+ */
+struct chunkPool {
+    chunk_t             chunks[BUFFER_MAX_WORKERS]; /**< array of chunks */
+    unsigned int        num;                        /**< number of chunks */
+
+    trace_t             *trace;     /**< index reader */
+    checkpoint_t        *cp;        /**< index: one checkpoint every CHUNK_CHECKPOINT packets */
+    unsigned long long  numCp;      /**< number of checkpoints */
+    unsigned long long  total;      /**< number of packets */
+    unsigned long long  size;       /**< size of the file */
+    unsigned long long  offset;     /**< offset of the next packet */
+    int64_t             lastTime;   /**< timestamp of the last packet (ns) */
+    int64_t             maxTime;    /**< latest timestamp so far (ns) */
+    unsigned int        next;       /**< next chunk to be found */
+};
+
+/**
+ * @brief Index callback: takes checkpoints and finds the first packet of every chunk
+ *
+ * A chunk starts at the first packet from its share of the file on.
+ */
+static void chunk_index(u_char *user, const struct pcap_pkthdr *header, const u_char *bytes) {
+    chunkPool_t *pool = (chunkPool_t *)user;
+    chunk_t *chunk;
+    unsigned long long offset = pool->offset;
+    int64_t time = utils_ts2ns(&header->ts);
+
+    pool->offset = trace_tell(pool->trace);
+    pool->total++;
+
+    if ((pool->total - 1) % CHUNK_CHECKPOINT == 0) {
+        if (pool->numCp % 1024 == 0) {
+            void *tmp = realloc(pool->cp, (pool->numCp + 1024)*sizeof(checkpoint_t));
+            if (!tmp) {
+                perror("Error: chunk_index > realloc");
+                exit(EXIT_FAILURE);
+            }
+            pool->cp = (checkpoint_t *)tmp;
+        }
+        pool->cp[pool->numCp].offset = offset;
+        pool->cp[pool->numCp].pos = pool->total;
+        pool->cp[pool->numCp].maxTime = pool->total > 1 ? pool->maxTime : INT64_MIN;
+        pool->numCp++;
+    }
+
+    while (pool->next < pool->num && offset >= pool->size*pool->next/pool->num) {
+        chunk = &pool->chunks[pool->next++];
+        chunk->first = pool->total;
+        chunk->time = (pool->total > 1 && pool->lastTime < time) ? pool->lastTime : time;
+    }
+
+    if (pool->total == 1 || time > pool->maxTime) pool->maxTime = time;
+    pool->lastTime = time;
+}
+
+/**
+ * @brief Finds where the warm-up of a chunk starts
+ *
+ * The last checkpoint that leaves out of the window of the packet before the chunk (and of its
+ * first packet) every packet before it.
+ *
+ * @param pool  the pool
+ * @param chunk the chunk
+ * @return index of the checkpoint
+ */
+static unsigned long long chunk_warmup(chunkPool_t *pool, chunk_t *chunk) {
+    unsigned long long length, i = (chunk->first - 1)/CHUNK_CHECKPOINT;
+
+    if (dups_get_window(&length)) {
+        unsigned long long limit = chunk->first > length ? chunk->first - length : 1;
+        while (i && pool->cp[i].pos > limit) i--;
+    } else
+        while (i && pool->cp[i].maxTime >= chunk->time - (int64_t)length) i--;
+
+    return i;
+}
+
+/**
+ * @brief Positions a chunk at the start of its warm-up, with an empty window
+ *
+ * @param pool  the pool
+ * @param chunk the chunk
+ * @param cp    index of the checkpoint where the warm-up starts
+ * @return 0 on success, -1 on error
+ */
+static int chunk_rewind(chunkPool_t *pool, chunk_t *chunk, unsigned long long cp) {
+    while (buffer_get_count(chunk->window))
+        buffer_remove(buffer_get_first(chunk->window));
+    dups_clear_window(chunk->id);
+
+    chunk->cp = cp;
+    chunk->warmup = chunk->first - pool->cp[cp].pos;
+    chunk->pos = pool->cp[cp].pos - 1;
+    memset(&chunk->stats, 0, sizeof(pktStats_t));
+    chunk->cur = NULL;
+    free(chunk->head);
+    free(chunk->tail);
+    chunk->head = chunk->tail = NULL;
+    chunk->numHead = chunk->numTail = 0;
+
+    return trace_seek(chunk->trace, pool->cp[cp].offset);
+}
+
+/**
+ * @brief Initializes the library
+ *
+ * The file is indexed first: only record headers are read.
+ *
+ * @param file      classic PCAP file
+ * @param num       number of chunks
+ * @see BUFFER_MAX_WORKERS
+ * @param max_size  memory limit for the packets in the windows (shared by all chunks)
+ * @param errbuf    error message (at least PCAP_ERRBUF_SIZE bytes)
+ * @return a pointer to a new pool of chunks or NULL
+ */
+chunkPool_t *chunk_init(const char *file, unsigned int num, unsigned long long max_size, char *errbuf) {
+    UTILS_CHECK(!file || !num || num > BUFFER_MAX_WORKERS, EINVAL, return NULL);
+
+    chunkPool_t *pool = (chunkPool_t *) calloc(1, sizeof(chunkPool_t));
+    if (!pool) {
+        perror("Error: chunk_init > calloc");
+        return NULL;
+    }
+    pool->num = num;
+
+    // index
+    pool->trace = trace_open(file, errbuf);
+    if (!pool->trace) {
+        free(pool);
+        return NULL;
+    }
+    if (!trace_is_mapped(pool->trace)) {
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "not a classic PCAP file");
+        chunk_destroy(pool);
+        return NULL;
+    }
+    pool->size = utils_fsize((char *)file);
+    pool->offset = trace_tell(pool->trace);
+    if (trace_loop(pool->trace, -1, chunk_index, (u_char *)pool) < 0) {
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "corrupt PCAP file");
+        chunk_destroy(pool);
+        return NULL;
+    }
+
+    // chunks past the last packet are empty
+    for (; pool->next < num; pool->next++)
+        pool->chunks[pool->next].first = pool->total + 1;
+
+    for (int i=0; i<num; i++) {
+        chunk_t *chunk = &pool->chunks[i];
+
+        chunk->id = i;
+        chunk->count = (i+1 < num ? pool->chunks[i+1].first : pool->total + 1) - chunk->first;
+        if (!chunk->count) continue;
+
+        chunk->trace = trace_open(file, errbuf);
+        if (!chunk->trace) {
+            chunk_destroy(pool);
+            return NULL;
+        }
+        chunk->window = buffer_init(0, max_size/num, sizeof(pktRecord_t));
+        if (!chunk->window) {
+            snprintf(errbuf, PCAP_ERRBUF_SIZE, "buffer_init failed");
+            chunk_destroy(pool);
+            return NULL;
+        }
+        buffer_set_release(chunk->window, pkt_release);
+        if (chunk_rewind(pool, chunk, chunk_warmup(pool, chunk))) {
+            snprintf(errbuf, PCAP_ERRBUF_SIZE, "trace_seek failed");
+            chunk_destroy(pool);
+            return NULL;
+        }
+        if (i && !(chunk->output = tmpfile())) {
+            snprintf(errbuf, PCAP_ERRBUF_SIZE, "tmpfile failed");
+            chunk_destroy(pool);
+            return NULL;
+        }
+    }
+
+    // link the chunks with packets
+    for (int i=num-1, next=-1; i>=0; i--) {
+        if (!pool->chunks[i].count) continue;
+        if (next >= 0) pool->chunks[i].next = &pool->chunks[next];
+        next = i;
+    }
+
+    return pool;
+}
+
+/**
+ * @brief Cleaner
+ *
+ * @param pool the pool
+ */
+void chunk_destroy(chunkPool_t *pool) {
+    UTILS_CHECK(!pool, EINVAL, return);
+
+    for (int i=0; i<pool->num; i++) {
+        chunk_t *chunk = &pool->chunks[i];
+        if (chunk->window) buffer_destroy(chunk->window);
+        if (chunk->trace) trace_close(chunk->trace);
+        if (i && chunk->output) fclose(chunk->output);
+        free(chunk->head);
+        free(chunk->tail);
+    }
+    if (pool->trace) trace_close(pool->trace);
+    free(pool->cp);
+    free(pool);
+}
+
+/**
+ * @brief Reader callback: the same steps as the sequential mode, within the window of the chunk
+ */
+static void chunk_update(u_char *user, const struct pcap_pkthdr *header, const u_char *bytes) {
+    chunk_t *chunk = (chunk_t *)user;
+    pktStats_t *stats = chunk->cur;
+
+    chunk->pos++;
+    if (stats) {
+        if (!stats->numPkts) stats->startTime = utils_ts2ns(&header->ts);
+        stats->numPkts++;
+        stats->endTime = utils_ts2ns(&header->ts);
+    }
+
+    // create packet
+    node_t *node_new = buffer_new(chunk->window);
+    if (!node_new) {
+        if (stats) stats->numErrors++;
+        return;
+    }
+    node_new->load = (void *) pkt_fill(node_new, chunk->pos, (void*)bytes, header->len, header->caplen, (struct timeval*)&header->ts);
+    if (!node_new->load) {
+        if (stats) stats->numErrors++;
+        return;
+    }
+    pkt_dissect((pkt_t *)node_new->load);
+    buffer_append(chunk->window, node_new);
+    if (buffer_get_count(chunk->window) == 1) buffer_init_marker(node_new, chunk->id);
+
+    // search for duplicates
+    dups_search(node_new, chunk->id, NULL);
+
+    // trim window (nobody else releases packets: the memory limit can't be enforced here)
+    buffer_trim(chunk->window);
+}
+
+/**
+ * @brief Reads a number of packets
+ *
+ * @param chunk the chunk
+ * @param count number of packets
+ * @return 0 on success, -1 on error
+ */
+static int chunk_read(chunk_t *chunk, unsigned long long count) {
+    int n;
+
+    while (count) {
+        n = count > INT_MAX ? INT_MAX : count;
+        if (trace_loop(chunk->trace, n, chunk_update, (u_char *)chunk) < 0) return -1;
+        count -= n;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Checks if a packet of the window may be compared with the packets of a chunk
+ *
+ * @param chunk the chunk
+ * @param pkt   the packet
+ * @return 1 (TRUE) or 0 (FALSE)
+ */
+static inline int chunk_in_window(chunk_t *chunk, pkt_t *pkt) {
+    unsigned long long length;
+
+    if (dups_get_window(&length)) return pkt->pos + length >= chunk->first;
+    return chunk->time - pkt->time <= (int64_t)length;
+}
+
+/**
+ * @brief Takes the signatures of the packets in a window that the packets of a chunk may be compared with
+ *
+ * Position, timestamp and frame (after any fragment merge) of every packet, in window order.
+ *
+ * @param window    the window
+ * @param chunk     the chunk
+ * @param count     output: number of signatures
+ * @return an array of signatures (NULL if empty)
+ */
+static unsigned long long *chunk_signature(buffer_t *window, chunk_t *chunk, unsigned long long *count) {
+    unsigned long long *sig = NULL, h[5];
+    node_t *node;
+    pkt_t *pkt;
+
+    *count = 0;
+    if (!buffer_get_count(window)) return NULL;
+    sig = malloc(buffer_get_count(window)*sizeof(unsigned long long));
+    if (!sig) {
+        perror("Error: chunk_signature > malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (node = buffer_get_first(window); node; node = buffer_is_last(node) ? NULL : node->next) {
+        pkt = (pkt_t *)node->load;
+        if (!chunk_in_window(chunk, pkt)) continue;
+        h[0] = pkt->pos;
+        h[1] = pkt->time;
+        h[2] = pkt->frame->size;
+        h[3] = pkt->frame->caplen;
+        h[4] = pkt_digest(pkt->frame->bytes, pkt->frame->caplen);
+        sig[(*count)++] = pkt_digest(h, sizeof(h));
+    }
+
+    return sig;
+}
+
+/**
+ * @brief Checks if a chunk starts with the window the previous one ended with
+ *
+ * If so, the chunk reports the same as a sequential run.
+ *
+ * @param prev  previous chunk
+ * @param chunk the chunk
+ * @return 1 (TRUE) or 0 (FALSE)
+ */
+static int chunk_stitched(chunk_t *prev, chunk_t *chunk) {
+    return prev->numTail == chunk->numHead &&
+           (!prev->numTail || !memcmp(prev->tail, chunk->head, prev->numTail*sizeof(unsigned long long)));
+}
+
+/**
+ * @brief Thread function
+ *
+ * The window is filled with the packets before the chunk first, with nothing reported or counted.
+ *
+ * @param arg a chunk
+ * @return NULL
+ */
+static void *chunk_searcher(void *arg) {
+    chunk_t *chunk = (chunk_t *)arg;
+
+    // warm-up
+    pkt_set_stats(NULL);
+    dups_set_stream(chunk->id, NULL);
+    chunk->ret = chunk_read(chunk, chunk->warmup);
+    dups_clear_stats(chunk->id);
+    chunk->head = chunk_signature(chunk->window, chunk, &chunk->numHead);
+
+    // the chunk
+    chunk->cur = &chunk->stats;
+    pkt_set_stats(chunk->cur);
+    dups_set_stream(chunk->id, chunk->output);
+    if (!chunk->ret) chunk->ret = chunk_read(chunk, chunk->count);
+    if (fflush(chunk->output)) chunk->ret = -1;
+
+    // what the next chunk should start with
+    if (chunk->next) chunk->tail = chunk_signature(chunk->window, chunk->next, &chunk->numTail);
+
+    return NULL;
+}
+
+/**
+ * @brief Searches a chunk again with a warm-up twice as long (or from the first packet)
+ *
+ * It runs in the calling thread.
+ *
+ * @param pool  the pool
+ * @param chunk the chunk (finished)
+ * @return 0 on success, -1 on error
+ */
+static int chunk_retry(chunkPool_t *pool, chunk_t *chunk) {
+    unsigned long long span = (chunk->first - 1)/CHUNK_CHECKPOINT - chunk->cp + 1;
+
+    if (chunk_rewind(pool, chunk, chunk->cp > 2*span ? chunk->cp - 2*span : 0)) return -1;
+    rewind(chunk->output);
+    if (ftruncate(fileno(chunk->output), 0)) {
+        perror("Error: chunk_retry > ftruncate");
+        return -1;
+    }
+
+    chunk_searcher(chunk);
+    return chunk->ret;
+}
+
+/**
+ * @brief Searches for duplicates in every chunk, in parallel
+ *
+ * The first chunk prints its records straight to the stream; the output of the rest
+ * is appended to it, in order, as soon as they finish. Fragments merged with older copies
+ * can carry a packet beyond the warm-up of the next chunk: if a chunk didn't start with the
+ * window the previous one ended with, it is searched again with a longer warm-up.
+ *
+ * @param pool      the pool
+ * @param stream    the stream
+ * @return 0 on success, -1 on error
+ */
+int chunk_run(chunkPool_t *pool, FILE *stream) {
+    UTILS_CHECK(!pool || !stream, EINVAL, return -1);
+
+    char buf[CHUNK_COPY];
+    size_t n;
+    int ret = 0;
+    chunk_t *prev = NULL;
+
+    pool->chunks[0].output = stream;
+    for (int i=0; i<pool->num; i++) {
+        if (!pool->chunks[i].count) continue;
+        if (pthread_create(&pool->chunks[i].thread, NULL, chunk_searcher, (void *)&pool->chunks[i])) {
+            perror("Error: chunk_run > pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int i=0; i<pool->num; i++) {
+        chunk_t *chunk = &pool->chunks[i];
+        if (!chunk->count) continue;
+
+        pthread_join(chunk->thread, NULL);
+        while (prev && !chunk->ret && chunk->cp && !chunk_stitched(prev, chunk))
+            chunk_retry(pool, chunk);
+        if (chunk->ret) ret = -1;
+        prev = chunk;
+        if (!i) continue;
+
+        rewind(chunk->output);
+        while ((n = fread(buf, 1, sizeof(buf), chunk->output)) > 0)
+            if (fwrite(buf, 1, n, stream) != n) {
+                perror("Error: chunk_run > fwrite");
+                return -1;
+            }
+        if (ferror(chunk->output)) {
+            perror("Error: chunk_run > fread");
+            return -1;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Gets the number of chunks in a pool
+ *
+ * @param pool the pool
+ * @return number of chunks
+ */
+inline unsigned int chunk_get_num(chunkPool_t *pool) {
+    UTILS_CHECK(!pool, EINVAL, return 0);
+
+    return pool->num;
+}
+
+/**
+ * @brief Gets the packet statistics, added up over all chunks
+ *
+ * @param pool  the pool
+ * @param stats output
+ */
+void chunk_get_stats(chunkPool_t *pool, pktStats_t *stats) {
+    UTILS_CHECK(!pool || !stats, EINVAL, return);
+
+    memset(stats, 0, sizeof(pktStats_t));
+    for (int i=0; i<pool->num; i++) {
+        pktStats_t *cur = &pool->chunks[i].stats;
+        if (!cur->numPkts) continue;
+
+        if (!stats->numPkts) stats->startTime = cur->startTime;
+        stats->endTime = cur->endTime;
+        stats->numPkts += cur->numPkts;
+        stats->numErrors += cur->numErrors;
+        stats->numIP += cur->numIP;
+        stats->numTCP += cur->numTCP;
+        stats->numUDP += cur->numUDP;
+    }
+}
@@ -0,0 +1,38 @@
+/*
+ * chunk.h
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#ifndef CHUNK_H_
+#define CHUNK_H_
+
+#include <stdio.h>
+#include "pkt.h"
+
+#ifndef CHUNK_CHECKPOINT
+#define CHUNK_CHECKPOINT 1024   /**< packets between two checkpoints of the index (warm-up granularity) */
+#endif
+
+typedef struct chunkPool chunkPool_t;
+
+// initializer: split a classic PCAP file into num chunks at packet boundaries
+// (max_size: memory limit shared by the windows of the chunks; errbuf: at least PCAP_ERRBUF_SIZE bytes)
+chunkPool_t *chunk_init(const char *file, unsigned int num, unsigned long long max_size, char *errbuf);
+
+// free all memory
+void chunk_destroy(chunkPool_t *pool);
+
+// search every chunk in a thread of its own and print the records in position order (0 on success, -1 on error)
+int chunk_run(chunkPool_t *pool, FILE *stream);
+
+// number of chunks
+unsigned int chunk_get_num(chunkPool_t *pool);
+
+// packet statistics, added up over all chunks
+void chunk_get_stats(chunkPool_t *pool, pktStats_t *stats);
+
+#endif /* CHUNK_H_ */
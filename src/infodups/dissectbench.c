@@ -0,0 +1,215 @@
+/*
+ * dissectbench.c
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#include "../config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "../common/trace.h"
+#include "../common/utils.h"
+#include "buffer.h"
+#include "pkt.h"
+
+#ifndef DISSECTBENCH_EVICT
+#define DISSECTBENCH_EVICT 67108864 // bytes written between runs to evict the caches
+#endif
+
+void print_options() {
+    fprintf(stderr, "\ndissectbench %s\n", INFODUPS_VERSION);
+    fputs(  "Measures the cost of dissecting packets in infodups, one by one (pkt_dissect)\n"
+            "or in batches with prefetch (pkt_dissect_batch).\n"
+            "http://github.com/Enchufa2/nantools\n"
+            "\n"
+            "Usage: dissectbench [options] -i <file>\n"
+            "\n"
+            "Options:\n"
+            "  -h               show help\n"
+            "  -i <file>        input file (its packets are repeated up to '-n')\n"
+            "  -n <packets>     number of packets (default: 1048576)\n"
+            "  -r <runs>        number of runs, the best one is reported (default: 15)\n"
+            "  -b <packets>     batch size (default: 0, one by one)\n"
+            "  -F               fast mode\n"
+            "  -s               copy the packets to slab blocks taken in random order, as\n"
+            "                   with a pipe after a while (default: referenced, laid out\n"
+            "                   as in a mapped file)\n"
+            "\n"
+            "The result is given in cycles per packet (TSC) on x86, and in nanoseconds\n"
+            "per packet elsewhere.\n"
+            "\n"
+            "Copyright (C) 2013 Iñaki Úcar <i.ucar86@gmail.com>\n"
+            "Distributed under the GNU General Public License v3.0\n"
+            "This is free software: you are free to change and redistribute it.\n"
+            "There is NO WARRANTY, to the extent permitted by law.\n\n",
+    stderr);
+}
+
+/**
+ * Packets read from the file
+ */
+typedef struct {
+    struct pcap_pkthdr  *header;    /**< headers */
+    char                **bytes;    /**< bytes */
+    unsigned long long  count;      /**< number of packets */
+} input_t;
+
+// private: collects the packets of the file
+static void collect(u_char *user, const struct pcap_pkthdr *header, const u_char *bytes) {
+    input_t *input = (input_t *)user;
+    input->header = realloc(input->header, (input->count+1)*sizeof(struct pcap_pkthdr));
+    input->bytes = realloc(input->bytes, (input->count+1)*sizeof(char *));
+    if (!input->header || !input->bytes) {
+        perror("Error: collect > realloc");
+        exit(EXIT_FAILURE);
+    }
+    input->header[input->count] = *header;
+    input->bytes[input->count] = malloc(header->caplen);
+    if (!input->bytes[input->count]) {
+        perror("Error: collect > malloc");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(input->bytes[input->count], bytes, header->caplen);
+    input->count++;
+}
+
+// private: timestamp counter (cycles) or monotonic clock (ns)
+static inline unsigned long long ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+int main (int argc, char **argv) {
+    char option, *path = NULL, errbuf[PCAP_ERRBUF_SIZE];
+    unsigned long long numPkts = 1048576, total = 0, offset = 0, best = ~0ULL, t;
+    int runs = 15, batch = 0, fast = 0, scatter = 0;
+    input_t input = {0};
+    pktStats_t stats = {0};
+
+    while ((option = getopt(argc, argv, "hi:n:r:b:Fs")) != -1) {
+        switch (option) {
+            case 'h':
+                print_options();
+                exit(0);
+            case 'i':
+                path = optarg;
+                break;
+            case 'n':
+                numPkts = strtoull(optarg, NULL, 10);
+                break;
+            case 'r':
+                runs = atoi(optarg);
+                break;
+            case 'b':
+                batch = atoi(optarg);
+                break;
+            case 'F':
+                fast = 1;
+                break;
+            case 's':
+                scatter = 1;
+                break;
+            default:
+                print_options();
+                return EXIT_FAILURE;
+        }
+    }
+    if (!path || !numPkts || runs < 1 || batch < 0) {
+        print_options();
+        return EXIT_FAILURE;
+    }
+
+    trace_t *trace = trace_open(path, errbuf);
+    if (!trace) {
+        fprintf(stderr, "Error: cannot open trace file %s\n%s\n", path, errbuf);
+        return EXIT_FAILURE;
+    }
+    trace_loop(trace, -1, collect, (u_char *)&input);
+    trace_close(trace);
+    if (!input.count) {
+        fprintf(stderr, "Error: no packets in %s\n", path);
+        return EXIT_FAILURE;
+    }
+
+    // referenced packets: laid out in memory as in a mapped file
+    for (unsigned long long i=0; i<numPkts; i++) total += input.header[i % input.count].caplen;
+    char *mem = scatter ? NULL : malloc(total);
+    node_t **nodes = malloc(numPkts*sizeof(node_t *));
+    pkt_t **pkts = malloc(numPkts*sizeof(pkt_t *));
+    char *evict = malloc(DISSECTBENCH_EVICT);
+    if ((!mem && !scatter) || !nodes || !pkts || !evict) {
+        perror("Error: main > malloc");
+        return EXIT_FAILURE;
+    }
+
+    pkt_init(fast, scatter ? PKT_STORE_COPY : PKT_STORE_REF, &stats);
+    buffer_t *buffer = buffer_init(0, ~0ULL, sizeof(pktRecord_t));
+    if (!buffer) return EXIT_FAILURE;
+    for (unsigned long long i=0; i<numPkts; i++) {
+        struct pcap_pkthdr *header = &input.header[i % input.count];
+        char *bytes = input.bytes[i % input.count];
+        if (!scatter) {
+            bytes = memcpy(mem + offset, bytes, header->caplen);
+            offset += header->caplen;
+        }
+        nodes[i] = buffer_new(buffer);
+        if (!nodes[i]) return EXIT_FAILURE;
+        nodes[i]->load = pkts[i] = pkt_fill(nodes[i], i+1, bytes, header->len, header->caplen, &header->ts);
+        if (!pkts[i]) return EXIT_FAILURE;
+        buffer_append(buffer, nodes[i]);
+    }
+
+    // copied packets: their blocks are given back in random order and taken again,
+    // so that consecutive packets end up scattered in memory
+    if (scatter) {
+        srand(1);
+        for (unsigned long long i=numPkts-1; i>0; i--) {
+            unsigned long long j = (((unsigned long long)rand() << 31) | rand()) % (i+1);
+            pkt_t *aux = pkts[i];
+            pkts[i] = pkts[j];
+            pkts[j] = aux;
+        }
+        for (unsigned long long i=0; i<numPkts; i++) pkt_release(pkts[i]);
+        for (unsigned long long i=0; i<numPkts; i++) {
+            struct pcap_pkthdr *header = &input.header[i % input.count];
+            pkts[i] = pkt_fill(nodes[i], i+1, input.bytes[i % input.count], header->len, header->caplen, &header->ts);
+            if (!pkts[i]) return EXIT_FAILURE;
+        }
+    }
+
+    // best run, with cold caches
+    for (int r=0; r<runs; r++) {
+        memset(evict, r, DISSECTBENCH_EVICT);
+        for (unsigned long long i=0; i<numPkts; i++) pkts[i]->frame->frameType = ETH_FRAMETYPE_NOTCHECKED;
+
+        t = ticks();
+        if (batch) {
+            for (unsigned long long i=0; i<numPkts; i+=batch)
+                pkt_dissect_batch(pkts+i, numPkts-i < batch ? numPkts-i : batch);
+        } else {
+            for (unsigned long long i=0; i<numPkts; i++)
+                pkt_dissect(pkts[i]);
+        }
+        t = ticks() - t;
+        if (t < best) best = t;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    printf("%.1f cycles/packet", (double)best/numPkts);
+#else
+    printf("%.1f ns/packet", (double)best/numPkts);
+#endif
+    printf(" (%llu packets, %llu IP, best of %d runs)\n", numPkts, stats.numIP/runs, runs);
+
+    return 0;
+}
@@ -0,0 +1,225 @@
+/*
+ * dumper.c
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#include "dumper.h"
+#include "pkt.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <pcap/pcap.h>
+
+/**
+ * Pending packet
+ */
+typedef struct {
+    unsigned long long  pos;        /**< position */
+    unsigned int        window;     /**< window holding it */
+} pending_t;
+
+/**
+ * Packets of a window not written yet
+ */
+typedef struct {
+    node_t              *next;      /**< oldest one (NULL: none, the marker stays on the last one written) */
+    unsigned int        id;         /**< marker that holds them in the window */
+    int                 held;       /**< the marker has been initialized */
+} dumperWindow_t;
+
+/**
+ * Private dumper structure
+ *
+ * Packets are written in position order, once they have been searched, straight from
+ * the window: a marker per window keeps the packets not written yet from being trimmed.
+ * Packets of different windows (shards) are interleaved through a queue of positions.
+ */
+struct dumper {
+    pcap_t              *pcap;      /**< dead handle for the dump files */
+    pcap_dumper_t       *kept;      /**< trace without duplicates */
+    pcap_dumper_t       *removed;   /**< duplicates (NULL: not written) */
+    int                 precision;  /**< timestamp precision of the files */
+
+    pending_t           *pending;   /**< queue of pending packets (ring indexed by sequence number) */
+    unsigned long long  mask;       /**< number of entries - 1 (power of two) */
+    unsigned long long  head;       /**< sequence number of the oldest pending packet */
+    unsigned long long  tail;       /**< sequence number of the next pending packet */
+
+    dumperWindow_t      win[BUFFER_MAX_WORKERS];    /**< windows */
+};
+
+/**
+ * @brief Initializes a dumper
+ *
+ * @param kept      file for the trace without duplicates
+ * @param removed   file for the duplicates (NULL: not written)
+ * @param linktype  link-layer header type
+ * @param snaplen   snapshot length
+ * @param precision timestamp precision (PCAP_TSTAMP_PRECISION_MICRO or PCAP_TSTAMP_PRECISION_NANO)
+ * @return a pointer to a new dumper or NULL
+ */
+dumper_t *dumper_init(const char *kept, const char *removed, int linktype, int snaplen, int precision) {
+    UTILS_CHECK(!kept, EINVAL, return NULL);
+
+    dumper_t *dumper = calloc(1, sizeof(dumper_t));
+    if (!dumper) {
+        perror("Error: dumper_init > calloc");
+        return NULL;
+    }
+    dumper->pending = malloc(DUMPER_INIT_SIZE * sizeof(pending_t));
+    if (!dumper->pending) {
+        perror("Error: dumper_init > malloc");
+        free(dumper);
+        return NULL;
+    }
+    dumper->mask = DUMPER_INIT_SIZE - 1;
+    dumper->precision = precision;
+
+    dumper->pcap = pcap_open_dead_with_tstamp_precision(linktype, snaplen, precision);
+    if (!dumper->pcap) {
+        fprintf(stderr, "Error: dumper_init > pcap_open_dead_with_tstamp_precision failed\n");
+        dumper_destroy(dumper);
+        return NULL;
+    }
+    dumper->kept = pcap_dump_open(dumper->pcap, kept);
+    if (!dumper->kept) {
+        fprintf(stderr, "Error: cannot open %s: %s\n", kept, pcap_geterr(dumper->pcap));
+        dumper_destroy(dumper);
+        return NULL;
+    }
+    if (removed) {
+        dumper->removed = pcap_dump_open(dumper->pcap, removed);
+        if (!dumper->removed) {
+            fprintf(stderr, "Error: cannot open %s: %s\n", removed, pcap_geterr(dumper->pcap));
+            dumper_destroy(dumper);
+            return NULL;
+        }
+    }
+
+    return dumper;
+}
+
+/**
+ * @brief Destroys a dumper (pending packets are not written)
+ *
+ * @param dumper the dumper
+ */
+void dumper_destroy(dumper_t *dumper) {
+    UTILS_CHECK(!dumper, EINVAL, return);
+
+    if (dumper->kept) pcap_dump_close(dumper->kept);
+    if (dumper->removed) pcap_dump_close(dumper->removed);
+    if (dumper->pcap) pcap_close(dumper->pcap);
+    free(dumper->pending);
+    free(dumper);
+}
+
+/**
+ * @brief Doubles the queue of pending packets
+ *
+ * @param dumper the dumper
+ * @return 0 on success, -1 on error
+ */
+static int dumper_grow(dumper_t *dumper) {
+    unsigned long long size = 2*(dumper->mask+1);
+    pending_t *new = malloc(size * sizeof(pending_t));
+    if (!new) {
+        perror("Error: dumper_grow > malloc");
+        return -1;
+    }
+
+    for (unsigned long long seq = dumper->head; seq < dumper->tail; seq++)
+        new[seq & (size-1)] = dumper->pending[seq & dumper->mask];
+    free(dumper->pending);
+    dumper->pending = new;
+    dumper->mask = size-1;
+
+    return 0;
+}
+
+/**
+ * @brief Adds a new packet (packets must be added in position order)
+ *
+ * The packet is held in its window until it is written.
+ *
+ * @param dumper    the dumper
+ * @param node      node of the packet, already appended
+ * @param window    window identifier (shard)
+ * @param id        marker of the dumper in that window (not used by any worker)
+ * @return 0 on success, -1 on error
+ */
+inline int dumper_add(dumper_t *dumper, node_t *node, unsigned int window, unsigned int id) {
+    UTILS_CHECK(!dumper || !node || window >= BUFFER_MAX_WORKERS, EINVAL, return -1);
+
+    dumperWindow_t *win = &dumper->win[window];
+
+    if (dumper->tail - dumper->head > dumper->mask)
+        if (dumper_grow(dumper)) return -1;
+    dumper->pending[dumper->tail & dumper->mask].pos = ((pkt_t *)node->load)->pos;
+    dumper->pending[dumper->tail & dumper->mask].window = window;
+    dumper->tail++;
+
+    if (!win->next) {
+        win->next = node;
+        win->id = id;
+        if (win->held) buffer_set_marker(node, id);
+        else buffer_init_marker(node, id);
+        win->held = 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Writes the pending packets up to a position
+ *
+ * Kept packets go to the trace without duplicates and the rest to the file of
+ * duplicates, as they were read (a fragment merged with its first copy is written
+ * from its original bytes, see pkt_keep_original()).
+ *
+ * @param dumper    the dumper
+ * @param bound     every packet up to this position has been searched
+ * @return number of packets written, -1 on error
+ */
+inline int dumper_write(dumper_t *dumper, unsigned long long bound) {
+    UTILS_CHECK(!dumper, EINVAL, return -1);
+
+    struct pcap_pkthdr header;
+    pending_t *pending;
+    dumperWindow_t *win;
+    node_t *node;
+    pkt_t *pkt;
+    const char *bytes;
+    int count = 0;
+
+    while (dumper->head != dumper->tail) {
+        pending = &dumper->pending[dumper->head & dumper->mask];
+        if (pending->pos > bound) break;
+        win = &dumper->win[pending->window];
+        node = win->next;
+        pkt = (pkt_t *)node->load;
+
+        header.ts = pkt->frame->timestamp;
+        if (dumper->precision != PCAP_TSTAMP_PRECISION_NANO) header.ts.tv_usec /= 1000;
+        header.caplen = pkt->orig ? pkt->origCaplen : pkt->frame->caplen;
+        header.len = pkt->orig ? pkt->origSize : pkt->frame->size;
+        bytes = pkt->orig ? pkt->orig : pkt->frame->bytes;
+        if (!pkt->dupe) pcap_dump((u_char *)dumper->kept, &header, (const u_char *)bytes);
+        else if (dumper->removed) pcap_dump((u_char *)dumper->removed, &header, (const u_char *)bytes);
+
+        // release it
+        if (buffer_is_last(node)) win->next = NULL;
+        else {
+            win->next = node->next;
+            buffer_set_marker(win->next, win->id);
+        }
+        dumper->head++;
+        count++;
+    }
+
+    return count;
+}
@@ -0,0 +1,34 @@
+/*
+ * dumper.h
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#ifndef DUMPER_H_
+#define DUMPER_H_
+
+#include "buffer.h"
+
+#ifndef DUMPER_INIT_SIZE
+#define DUMPER_INIT_SIZE 4096   /**< initial number of pending packets (power of two) */
+#endif
+
+typedef struct dumper dumper_t;
+
+// initializer: trace without duplicates (kept) and, optionally, the duplicates (removed)
+// precision: PCAP_TSTAMP_PRECISION_MICRO/NANO
+dumper_t *dumper_init(const char *kept, const char *removed, int linktype, int snaplen, int precision);
+
+// free all memory and close the files
+void dumper_destroy(dumper_t *dumper);
+
+// a new packet (in order), appended to a window; id: marker that holds it in the window
+int dumper_add(dumper_t *dumper, node_t *node, unsigned int window, unsigned int id);
+
+// write the packets up to a position (every packet up to it has been searched)
+int dumper_write(dumper_t *dumper, unsigned long long bound);
+
+#endif /* DUMPER_H_ */
@@ -8,27 +8,127 @@
  */
 
 #include "dups.h"
+#include "hashidx.h"
 #include "../common/ip.h"
+#include "../common/ip6.h"
 #include "../common/tcp.h"
 #include "../common/udp.h"
 #include "../common/utils.h"
 #include <string.h>
 #include <stdlib.h>
+#include <sched.h>
 #include <arpa/inet.h>
-#include <pthread.h>
 
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 
+#define DUPS_KEY_NULL 0x6e756c6c7061796cULL  /**< salt for the key of NULL payloads */
+
+#define DUPS_LINE_MAX 512           /**< longest output line (extended) */
+
+#define DUPS_CACHELINE 64           /**< counters of different workers don't share cache lines */
+
+#define DUPS_ENABLED_ANY 0          /**< set of comparators only known at runtime (see DUPS_TYPE) */
+
+// specialized search loops: name, enabled comparators (bit n: comparator_n())
+#define DUPS_SEARCH_VARIANTS(X) \
+    X(all,          0x3f)   /* all types */ \
+    X(nofrag,       0x0f)   /* no fragmentation types (e.g. header-only mode) */ \
+    X(switching,    0x01)   /* switching only */ \
+    X(routing,      0x3e)   /* routing only */
+
+#ifndef DUPS_HOT_INIT_SIZE
+#define DUPS_HOT_INIT_SIZE 1024     /**< initial number of entries of the hot columns (power of two) */
+#endif
+#define DUPS_HOT_BLOCK 8            /**< entries tested per iteration of the scan */
+
+#define DUPS_HOT_IPV4   0x01        /**< IPv4 packet */
+#define DUPS_HOT_FRAG   0x02        /**< IPv4 fragment (only set when fragments are compared) */
+#define DUPS_HOT_NULL   0x04        /**< NULL payload */
+#define DUPS_HOT_IPV6   0x08        /**< IPv6 packet */
+
+// layout of the tag column: len (32 bits) | IP ID (16, IPv6: folded flow ID) | protocol (8) | flags (8)
+#define DUPS_HOT_TAG(len, ipid, proto, flags) \
+    (((unsigned long long)(unsigned int)(len) << 32) | ((unsigned long long)(ipid) << 16) | ((unsigned long long)(proto) << 8) | (flags))
+#define DUPS_HOT_TAG_LEN    0xffffffff00000000ULL
+#define DUPS_HOT_TAG_FAST   (0xffffffffffffff00ULL | DUPS_HOT_IPV4 | DUPS_HOT_IPV6)  /**< len, IP ID, protocol and IP version */
+
+// scan kernels are built for several SIMD targets and chosen at runtime, where supported
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 6 && defined(__x86_64__) && defined(__linux__)
+#define DUPS_HOT_CLONES __attribute__((target_clones("avx2", "sse4.2", "default")))
+#else
+#define DUPS_HOT_CLONES
+#endif
+
+/**
+ * Hot fields of the packets in a window (structure of arrays, indexed by node.seq)
+ *
+ * The backward scan filters candidates on these columns, without touching the packets.
+ */
+typedef struct {
+    unsigned long long  mask;       /**< number of entries - 1 (power of two) */
+    int64_t             *bound;     /**< window coordinate: timestamp (ns) or position, see dups_window_mode */
+    unsigned long long  *digest;    /**< payload hash */
+    unsigned long long  *tag;       /**< payload size (fast mode: IP total length), IP ID, protocol and flags (DUPS_HOT_TAG) */
+    unsigned long long  *addr;      /**< source and destination IP addresses (IPv6: their hash) */
+    node_t              **node;     /**< the node */
+} dupsHot_t;
+
+/**
+ * Hot fields of the current packet
+ */
+typedef struct {
+    int64_t             bound;      /**< window coordinate */
+    int64_t             limit;      /**< window size in the same units */
+    unsigned long long  digest;     /**< payload hash */
+    unsigned long long  tag;        /**< see DUPS_HOT_TAG */
+    unsigned long long  addr;       /**< source and destination IP addresses */
+} dupsHotKey_t;
+
+/**
+ * Statistics counters of a worker (written by the worker only)
+ */
+typedef struct {
+    unsigned long long  numSuspicious;              /**< number of suspicious pairs */
+    unsigned long long  numDup[DUPS_COMPARATORS];   /**< number of duplicates of each type */
+} __attribute__((aligned(DUPS_CACHELINE))) dupsCounters_t;
+
+/**
+ * Window index of a worker
+ */
+typedef struct {
+    hashidx_t           *idx;       /**< packets in the window, by key */
+    dupsHot_t           hot;        /**< hot columns of the packets in the window */
+    unsigned int        id;         /**< thread identifier */
+    node_t              *indexed;   /**< last node indexed */
+    node_t              *lo;        /**< oldest node within the window in the last search */
+    unsigned long long  inversion;  /**< index position of the last window coordinate going backwards (see DUPS_WINDOW_POS) */
+    int64_t             last;       /**< window coordinate of the last node indexed (see in_window()) */
+} dupsWindow_t;
+
+// index position of a node: its sequence number, from 1 (0 means none in hashidx)
+// (not pkt.pos, which pkt_copy() sets back to the first copy when fragments are merged)
+#define DUPS_WINDOW_POS(node) ((node)->seq + 1)
+
+// counters are only written by their worker: relaxed atomics are enough for readers
+#define DUPS_COUNT(counter) __atomic_store_n(&(counter), (counter) + 1, __ATOMIC_RELAXED)
+
 // private variables
 static int dups_window_mode = 0;            /**< window mode (0=time, 1=pos) */
-static float dups_window_time = 0.1;        /**< window size in seconds */
+static int64_t dups_window_time = 100000000;    /**< window size in nanoseconds */
 static unsigned int dups_window_pos = 0;    /**< window size in positions */
 
+static int dups_fast;                       /**< fast mode flag */
+static int dups_headers;                    /**< header-only mode flag (payloads are compared by digest) */
 static int dups_extended;                   /**< extended output flag */
+static int dups_binary;                     /**< binary output flag */
+static int dups_sources;                    /**< input file flag (extended output) */
 static int dups_suspicious;                 /**< suspcious duplicates flag */
 
-static stats_t *dups_stats;                 /**< statistics */
-static pthread_mutex_t dups_mutex;          /**< statistics mutex */
+static dupsCounters_t dups_counters[BUFFER_MAX_WORKERS];  /**< statistics (one set per worker) */
+
+static FILE *dups_stream[BUFFER_MAX_WORKERS];   /**< where records are printed without an output ring (NULL: discarded) */
+
+static dupsWindow_t dups_window[BUFFER_MAX_WORKERS];    /**< window indexes (one per worker) */
 
 dup_t DUPS_TYPE[DUPS_COMPARATORS] = {
     {.description = "Switching",                        .comparator = NULL},
@@ -39,7 +139,7 @@ dup_t DUPS_TYPE[DUPS_COMPARATORS] = {
     {.description = "NAT Routing with fragmentation",   .comparator = NULL}
 };
 
-int (*dups_search)(node_t *node, unsigned int id, char *output, int *bufSize) = NULL;
+int (*dups_search)(node_t *node, unsigned int id, ring_t *output) = NULL;
 
 /**
  * @brief Compares source and destination MACs of two packets
@@ -64,22 +164,24 @@ static inline int compareMacs(pkt_t *cur, pkt_t *pkt) {
 }
 
 /**
- * @brief Compares two buffers
+ * @brief Compares the payloads of two packets
+ *
+ * Payload digests are checked first, so that bytes are only compared to confirm a match
+ * (unless only headers are stored).
  *
- * @param data1 first buffer
- * @param size1 size of the first buffer
- * @param data2 second buffer
- * @param size2 size of the second buffer
+ * @param cur one packet
+ * @param pkt another packet
  * @return
  * - 0 if not equal
  * - 1 if equal
  * - -1 if NULL buffers
  */
-static inline int sameData(void *data1, size_t size1, void *data2, size_t size2) {
-    if (size1 != size2) return 0;
-    //if (size1 <= 0) return -1;
-    if (data1 == NULL || data2 == NULL) return -1;
-    if (memcmp(data1, data2, size1)) return 0;
+static inline int sameData(pkt_t *cur, pkt_t *pkt) {
+    if (cur->dis.bufSize != pkt->dis.bufSize) return 0;
+    //if (cur->dis.bufSize <= 0) return -1;
+    if (cur->dis.data == NULL || pkt->dis.data == NULL) return -1;
+    if (cur->dis.digest != pkt->dis.digest) return 0;
+    if (!dups_headers && memcmp(cur->dis.data, pkt->dis.data, cur->dis.bufSize)) return 0;
     return 1;
 }
 
@@ -102,6 +204,122 @@ static inline int fragmentInData(void *data, size_t size, void *dataFrag, size_t
     return 1;
 }
 
+/**
+ * @brief Compares the TCP fields of two IP packets of the same version
+ *
+ * @param cur       one packet
+ * @param pkt       another packet
+ * @param checksum  compare the checksums too
+ * @param seqOrAck  the sequence or the acknowledgement number is enough (proxying)
+ * @return          1 (TRUE) or 0 (FALSE)
+ */
+static inline int sameTCP(pkt_t *cur, pkt_t *pkt, int checksum, int seqOrAck) {
+    const TCPSegment_t *a = (TCPSegment_t *)cur->dis.sgmt, *b = (TCPSegment_t *)pkt->dis.sgmt;
+
+    if (cur->dis.ip6) {
+        if (cur->dis.ip6->payloadLength != pkt->dis.ip6->payloadLength) return 0;
+    } else if (cur->dis.ipPkt->bytes->totalLength != pkt->dis.ipPkt->bytes->totalLength) return 0;
+    // truncated headers: only their sizes can be compared
+    if (a->caplen < 20 || b->caplen < 20) return a->caplen == b->caplen;
+    if (checksum && a->bytes->checksum != b->bytes->checksum) return 0;
+    if (seqOrAck) {
+        if (a->bytes->seqNumber != b->bytes->seqNumber && a->bytes->ackNumber != b->bytes->ackNumber) return 0;
+    } else if (a->bytes->seqNumber != b->bytes->seqNumber || a->bytes->ackNumber != b->bytes->ackNumber) return 0;
+    if (a->bytes->window != b->bytes->window) return 0;
+    return 1;
+}
+
+/**
+ * @brief Switching comparator (IPv6)
+ *
+ * @param cur   one packet
+ * @param pkt   another packet
+ * @return      1 (TRUE) or 0 (FALSE)
+ */
+static inline int comparator6_0(pkt_t *cur, pkt_t *pkt) {
+    // compare flow ID, protocol and offset
+    if (cur->dis.flowId != pkt->dis.flowId) return 0;
+    if (cur->dis.protocol != pkt->dis.protocol) return 0;
+    if (cur->dis.offset != pkt->dis.offset) return 0;
+    // compare TCP/UDP fields (not in later fragments)
+    if ((cur->dis.protocol == IP_PROTO_TCP || cur->dis.protocol == IP_PROTO_UDP) && !cur->dis.offset) {
+        if (cur->dis.srcPort != pkt->dis.srcPort || cur->dis.dstPort != pkt->dis.dstPort) return 0;
+        if (cur->dis.protocol == IP_PROTO_TCP && !sameTCP(cur, pkt, 1, 0)) return 0;
+    }
+    // compare IP addresses
+    if (memcmp(cur->dis.ip6->srcAddr, pkt->dis.ip6->srcAddr, 16) || memcmp(cur->dis.ip6->dstAddr, pkt->dis.ip6->dstAddr, 16)) return 0;
+    // compare hop limit
+    if (cur->dis.ip6->hopLimit != pkt->dis.ip6->hopLimit) return 0;
+    return 1;
+}
+
+/**
+ * @brief Routing comparator (IPv6)
+ *
+ * @param cur   one packet
+ * @param pkt   another packet
+ * @return      1 (TRUE) or 0 (FALSE)
+ */
+static inline int comparator6_1(pkt_t *cur, pkt_t *pkt) {
+    // compare offset (later fragments don't carry the TCP/UDP header)
+    if (cur->dis.offset != pkt->dis.offset) return 0;
+    // compare TCP/UDP fields
+    if ((cur->dis.protocol == IP_PROTO_TCP || cur->dis.protocol == IP_PROTO_UDP) && !cur->dis.offset) {
+        if (cur->dis.srcPort != pkt->dis.srcPort || cur->dis.dstPort != pkt->dis.dstPort) return 0;
+        if (cur->dis.protocol == IP_PROTO_TCP && !sameTCP(cur, pkt, 0, 0)) return 0;
+    }
+    // compare IP addresses
+    if (memcmp(cur->dis.ip6->srcAddr, pkt->dis.ip6->srcAddr, 16) || memcmp(cur->dis.ip6->dstAddr, pkt->dis.ip6->dstAddr, 16)) return 0;
+    return 1;
+}
+
+/**
+ * @brief NAT Routing comparator (IPv6)
+ *
+ * @param cur   one packet
+ * @param pkt   another packet
+ * @return      1 (TRUE) or 0 (FALSE)
+ */
+static inline int comparator6_2(pkt_t *cur, pkt_t *pkt) {
+    int sameSrc = !memcmp(cur->dis.ip6->srcAddr, pkt->dis.ip6->srcAddr, 16);
+    int sameDst = !memcmp(cur->dis.ip6->dstAddr, pkt->dis.ip6->dstAddr, 16);
+
+    // compare offset (later fragments don't carry the TCP/UDP header)
+    if (cur->dis.offset != pkt->dis.offset) return 0;
+    // compare TCP/UDP fields
+    if ((cur->dis.protocol == IP_PROTO_TCP || cur->dis.protocol == IP_PROTO_UDP) && !cur->dis.offset) {
+        if ((cur->dis.srcPort == pkt->dis.srcPort) == (cur->dis.dstPort == pkt->dis.dstPort)) return 0;
+        // port and IP matching
+        if ((cur->dis.srcPort == pkt->dis.srcPort && !sameSrc) || (cur->dis.dstPort == pkt->dis.dstPort && !sameDst)) return 0;
+        if (cur->dis.protocol == IP_PROTO_TCP && !sameTCP(cur, pkt, 0, 0)) return 0;
+    // compare IP addresses
+    } else if (sameSrc == sameDst) return 0;
+    return 1;
+}
+
+/**
+ * @brief Proxying comparator (IPv6)
+ *
+ * @param cur   one packet
+ * @param pkt   another packet
+ * @return      1 (TRUE) or 0 (FALSE)
+ */
+static inline int comparator6_3(pkt_t *cur, pkt_t *pkt) {
+    int sameSrc = !memcmp(cur->dis.ip6->srcAddr, pkt->dis.ip6->srcAddr, 16);
+    int sameDst = !memcmp(cur->dis.ip6->dstAddr, pkt->dis.ip6->dstAddr, 16);
+
+    // compare offset (later fragments don't carry the TCP/UDP header)
+    if (cur->dis.offset != pkt->dis.offset) return 0;
+    // compare TCP/UDP fields
+    if ((cur->dis.protocol == IP_PROTO_TCP || cur->dis.protocol == IP_PROTO_UDP) && !cur->dis.offset) {
+        if (cur->dis.srcPort != pkt->dis.srcPort || cur->dis.dstPort != pkt->dis.dstPort) return 0;
+        if (cur->dis.protocol == IP_PROTO_TCP && !sameTCP(cur, pkt, 0, 1)) return 0;
+    }
+    // compare IP addresses
+    if (sameSrc == sameDst) return 0;
+    return 1;
+}
+
 /**
  * @brief Switching comparator
  *
@@ -111,8 +329,12 @@ static inline int fragmentInData(void *data, size_t size, void *dataFrag, size_t
  * @return            1 (TRUE) or 0 (FALSE)
  */
 static inline int comparator_0(pkt_t *cur, pkt_t *pkt, int dataCmp) {
+    // is IPv6?
+    if (cur->dis.ip6 || pkt->dis.ip6) return cur->dis.ip6 && pkt->dis.ip6 && comparator6_0(cur, pkt);
     // is IP?
     if (cur->dis.ethertype == ETH_PROTO_IPv4) {
+        // truncated headers can't be compared
+        if (!cur->dis.ip4 || !pkt->dis.ip4) return 0;
         // compare IP ID
         if (cur->dis.ipPkt->bytes->identification != pkt->dis.ipPkt->bytes->identification) return 0;
         // compare protocol
@@ -120,13 +342,7 @@ static inline int comparator_0(pkt_t *cur, pkt_t *pkt, int dataCmp) {
         // compare TCP/UDP fields
         if (cur->dis.protocol == IP_PROTO_TCP || cur->dis.protocol == IP_PROTO_UDP) {
             if (cur->dis.srcPort != pkt->dis.srcPort || cur->dis.dstPort != pkt->dis.dstPort) return 0;
-            if (cur->dis.protocol == IP_PROTO_TCP) {
-                if (cur->dis.ipPkt->bytes->totalLength != pkt->dis.ipPkt->bytes->totalLength) return 0;
-                if (((TCPSegment_t *)cur->dis.sgmt)->bytes->checksum != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->checksum) return 0;
-                if (((TCPSegment_t *)cur->dis.sgmt)->bytes->seqNumber != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->seqNumber) return 0;
-                if (((TCPSegment_t *)cur->dis.sgmt)->bytes->ackNumber != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->ackNumber) return 0;
-                if (((TCPSegment_t *)cur->dis.sgmt)->bytes->window != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->window) return 0;
-            }
+            if (cur->dis.protocol == IP_PROTO_TCP && !sameTCP(cur, pkt, 1, 0)) return 0;
         }
         // compare IP addresses
         if (cur->dis.ipPkt->bytes->srcAddr != pkt->dis.ipPkt->bytes->srcAddr || cur->dis.ipPkt->bytes->dstAddr != pkt->dis.ipPkt->bytes->dstAddr) return 0;
@@ -147,15 +363,11 @@ static inline int comparator_0(pkt_t *cur, pkt_t *pkt, int dataCmp) {
  * @return            1 (TRUE) or 0 (FALSE)
  */
 static inline int comparator_1(pkt_t *cur, pkt_t *pkt, int dataCmp) {
+    if (cur->dis.ip6) return comparator6_1(cur, pkt);
     // compare TCP/UDP fields
     if (cur->dis.protocol == IP_PROTO_TCP || cur->dis.protocol == IP_PROTO_UDP) {
         if (cur->dis.srcPort != pkt->dis.srcPort || cur->dis.dstPort != pkt->dis.dstPort) return 0;
-        if (cur->dis.protocol == IP_PROTO_TCP) {
-            if (cur->dis.ipPkt->bytes->totalLength != pkt->dis.ipPkt->bytes->totalLength) return 0;
-            if (((TCPSegment_t *)cur->dis.sgmt)->bytes->seqNumber != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->seqNumber) return 0;
-            if (((TCPSegment_t *)cur->dis.sgmt)->bytes->ackNumber != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->ackNumber) return 0;
-            if (((TCPSegment_t *)cur->dis.sgmt)->bytes->window != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->window) return 0;
-        }
+        if (cur->dis.protocol == IP_PROTO_TCP && !sameTCP(cur, pkt, 0, 0)) return 0;
     }
     // compare IP addresses
     if (cur->dis.ipPkt->bytes->srcAddr != pkt->dis.ipPkt->bytes->srcAddr || cur->dis.ipPkt->bytes->dstAddr != pkt->dis.ipPkt->bytes->dstAddr) return 0;
@@ -175,6 +387,7 @@ static inline int comparator_1(pkt_t *cur, pkt_t *pkt, int dataCmp) {
  * @return            1 (TRUE) or 0 (FALSE)
  */
 static inline int comparator_2(pkt_t *cur, pkt_t *pkt, int dataCmp) {
+    if (cur->dis.ip6) return comparator6_2(cur, pkt);
     // compare TCP/UDP fields
     if (cur->dis.protocol == IP_PROTO_TCP || cur->dis.protocol == IP_PROTO_UDP) {
         if ((cur->dis.srcPort == pkt->dis.srcPort && cur->dis.dstPort == pkt->dis.dstPort) ||
@@ -182,12 +395,7 @@ static inline int comparator_2(pkt_t *cur, pkt_t *pkt, int dataCmp) {
         // port and IP matching
         if ((cur->dis.srcPort == pkt->dis.srcPort && cur->dis.ipPkt->bytes->srcAddr != pkt->dis.ipPkt->bytes->srcAddr) ||
             (cur->dis.dstPort == pkt->dis.dstPort && cur->dis.ipPkt->bytes->dstAddr != pkt->dis.ipPkt->bytes->dstAddr)) return 0;
-        if (cur->dis.protocol == IP_PROTO_TCP) {
-            if (cur->dis.ipPkt->bytes->totalLength != pkt->dis.ipPkt->bytes->totalLength) return 0;
-            if (((TCPSegment_t *)cur->dis.sgmt)->bytes->seqNumber != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->seqNumber) return 0;
-            if (((TCPSegment_t *)cur->dis.sgmt)->bytes->ackNumber != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->ackNumber) return 0;
-            if (((TCPSegment_t *)cur->dis.sgmt)->bytes->window != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->window) return 0;
-        }
+        if (cur->dis.protocol == IP_PROTO_TCP && !sameTCP(cur, pkt, 0, 0)) return 0;
     } else {
         // compare IP addresses
         if ((cur->dis.ipPkt->bytes->srcAddr == pkt->dis.ipPkt->bytes->srcAddr && cur->dis.ipPkt->bytes->dstAddr == pkt->dis.ipPkt->bytes->dstAddr) ||
@@ -207,15 +415,11 @@ static inline int comparator_2(pkt_t *cur, pkt_t *pkt, int dataCmp) {
  * @return            1 (TRUE) or 0 (FALSE)
  */
 static inline int comparator_3(pkt_t *cur, pkt_t *pkt, int dataCmp) {
+    if (cur->dis.ip6) return comparator6_3(cur, pkt);
     // compare TCP/UDP fields
     if (cur->dis.protocol == IP_PROTO_TCP || cur->dis.protocol == IP_PROTO_UDP) {
         if (cur->dis.srcPort != pkt->dis.srcPort || cur->dis.dstPort != pkt->dis.dstPort) return 0;
-        if (cur->dis.protocol == IP_PROTO_TCP) {
-            if (cur->dis.ipPkt->bytes->totalLength != pkt->dis.ipPkt->bytes->totalLength) return 0;
-            if (((TCPSegment_t *)cur->dis.sgmt)->bytes->seqNumber != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->seqNumber &&
-                ((TCPSegment_t *)cur->dis.sgmt)->bytes->ackNumber != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->ackNumber) return 0;
-            if (((TCPSegment_t *)cur->dis.sgmt)->bytes->window != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->window) return 0;
-        }
+        if (cur->dis.protocol == IP_PROTO_TCP && !sameTCP(cur, pkt, 0, 1)) return 0;
     }
     // compare IP addresses
     if ((cur->dis.ipPkt->bytes->srcAddr == pkt->dis.ipPkt->bytes->srcAddr && cur->dis.ipPkt->bytes->dstAddr == pkt->dis.ipPkt->bytes->dstAddr) ||
@@ -237,12 +441,7 @@ static inline int comparator_4(pkt_t *cur, pkt_t *pkt, int dataCmp) {
     // compare TCP/UDP fields
     if ((cur->dis.protocol == IP_PROTO_TCP || cur->dis.protocol == IP_PROTO_UDP) && ip_is_first_fragment(pkt->dis.ipPkt)) {
         if (cur->dis.srcPort != pkt->dis.srcPort || cur->dis.dstPort != pkt->dis.dstPort) return 0;
-        if (cur->dis.protocol == IP_PROTO_TCP) {
-            if (cur->dis.ipPkt->bytes->totalLength != pkt->dis.ipPkt->bytes->totalLength) return 0;
-            if (((TCPSegment_t *)cur->dis.sgmt)->bytes->seqNumber != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->seqNumber) return 0;
-            if (((TCPSegment_t *)cur->dis.sgmt)->bytes->ackNumber != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->ackNumber) return 0;
-            if (((TCPSegment_t *)cur->dis.sgmt)->bytes->window != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->window) return 0;
-        }
+        if (cur->dis.protocol == IP_PROTO_TCP && !sameTCP(cur, pkt, 0, 0)) return 0;
     }
     // compare IP addresses
     if (cur->dis.ipPkt->bytes->srcAddr != pkt->dis.ipPkt->bytes->srcAddr || cur->dis.ipPkt->bytes->dstAddr != pkt->dis.ipPkt->bytes->dstAddr) return 0;
@@ -265,12 +464,7 @@ static inline int comparator_5(pkt_t *cur, pkt_t *pkt, int dataCmp) {
         // port and IP matching
         if ((cur->dis.srcPort == pkt->dis.srcPort && cur->dis.ipPkt->bytes->srcAddr != pkt->dis.ipPkt->bytes->srcAddr) ||
             (cur->dis.dstPort == pkt->dis.dstPort && cur->dis.ipPkt->bytes->dstAddr != pkt->dis.ipPkt->bytes->dstAddr)) return 0;
-        if (cur->dis.protocol == IP_PROTO_TCP) {
-            if (cur->dis.ipPkt->bytes->totalLength != pkt->dis.ipPkt->bytes->totalLength) return 0;
-            if (((TCPSegment_t *)cur->dis.sgmt)->bytes->seqNumber != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->seqNumber) return 0;
-            if (((TCPSegment_t *)cur->dis.sgmt)->bytes->ackNumber != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->ackNumber) return 0;
-            if (((TCPSegment_t *)cur->dis.sgmt)->bytes->window != ((TCPSegment_t *)pkt->dis.sgmt)->bytes->window) return 0;
-        }
+        if (cur->dis.protocol == IP_PROTO_TCP && !sameTCP(cur, pkt, 0, 0)) return 0;
     } else {
         // compare IP addresses
         if ((cur->dis.ipPkt->bytes->srcAddr == pkt->dis.ipPkt->bytes->srcAddr && cur->dis.ipPkt->bytes->dstAddr == pkt->dis.ipPkt->bytes->dstAddr) ||
@@ -279,6 +473,34 @@ static inline int comparator_5(pkt_t *cur, pkt_t *pkt, int dataCmp) {
     return 1;
 }
 
+// comparators, by type (X-macro)
+#define DUPS_COMPARATOR_LIST(X) X(0) X(1) X(2) X(3) X(4) X(5)
+
+/**
+ * @brief Runs the comparator of a type
+ *
+ * With a constant set of enabled comparators, the call is resolved at compile time and
+ * the comparator is inlined. Otherwise (enabled=DUPS_ENABLED_ANY), DUPS_TYPE is used.
+ *
+ * @param type        type of duplicate
+ * @param enabled     enabled comparators (bit n: comparator_n()) or DUPS_ENABLED_ANY
+ * @param cur         one packet
+ * @param pkt         another packet
+ * @param dataCmp     output from sameData()
+ * @return            1 (TRUE) or 0 (FALSE)
+ */
+static inline __attribute__((always_inline)) int dups_comparator(int type, const unsigned int enabled, pkt_t *cur, pkt_t *pkt, int dataCmp) {
+    if (enabled == DUPS_ENABLED_ANY)
+        return DUPS_TYPE[type].comparator && DUPS_TYPE[type].comparator(cur, pkt, dataCmp);
+    if (!(enabled & (1U << type))) return 0;
+
+    switch (type) {
+#define DUPS_COMPARATOR_CASE(n) case n: return comparator_##n(cur, pkt, dataCmp);
+    DUPS_COMPARATOR_LIST(DUPS_COMPARATOR_CASE)
+    }
+    return 0;
+}
+
 /**
  * @brief Checks if there is a VLAN tag change
  *
@@ -300,131 +522,334 @@ static inline int VLANchange(pkt_t *cur, pkt_t *pkt) {
  * @return      1 (TRUE) or 0 (FALSE)
  */
 static inline int DSCPchange(pkt_t *cur, pkt_t *pkt) {
-    if (!(cur->dis.ethertype == ETH_PROTO_IPv4 && pkt->dis.ethertype == ETH_PROTO_IPv4)) return 0;
+    // IPv6: traffic class
+    if (cur->dis.ip6 && pkt->dis.ip6)
+        return ((cur->dis.ip6->version_Class_Flow ^ pkt->dis.ip6->version_Class_Flow) & htonl(0x0FF00000)) != 0;
+    if (!(cur->dis.ip4 && pkt->dis.ip4)) return 0;
     if (cur->dis.ipPkt->bytes->dscpEcn == pkt->dis.ipPkt->bytes->dscpEcn) return 0;
     return 1;
 }
 
 /**
- * @brief Output formatter
+ * @brief Fills a duplicate record
  *
- * @param stream    output stream
+ * @param rec       the record
  * @param cur       first packet
  * @param pkt       second packet (duplicate)
  * @param type      type of duplicate
  * @param dataCmp   output from sameData()
- * @return          number of characters printed
  */
-static inline int dups_fprintf(FILE *stream, pkt_t *cur, pkt_t *pkt, int type, int dataCmp) {
-    int count = 0;
-
-    char macSrc2[20], macDst2[20], macSrc1[20], macDst1[20];
-    char ipSrc1[INET_ADDRSTRLEN], ipSrc2[INET_ADDRSTRLEN], ipDst1[INET_ADDRSTRLEN], ipDst2[INET_ADDRSTRLEN];
+static inline void dups_record(dupsRecord_t *rec, pkt_t *cur, pkt_t *pkt, int type, int dataCmp) {
     int ttl1=0, ttl2=0;
 
-    if (cur->dis.ethertype == ETH_PROTO_IPv4 && pkt->dis.ethertype == ETH_PROTO_IPv4) {
+    if (cur->dis.ip4 && pkt->dis.ip4) {
         ttl1 = (u_int)cur->dis.ipPkt->bytes->ttl;
         ttl2 = (u_int)pkt->dis.ipPkt->bytes->ttl;
+    } else if (cur->dis.ip6 && pkt->dis.ip6) {
+        ttl1 = cur->dis.ip6->hopLimit;
+        ttl2 = pkt->dis.ip6->hopLimit;
     }
-    count += fprintf(stream, "%llu %llu %i %i %i %i %.9Lf %i",
-        pkt->pos,
-        pkt->pos - cur->pos,
-        type,
-        (dataCmp == -1) ? 1 : 0,
-        VLANchange(cur, pkt),
-        DSCPchange(cur, pkt),
-        pkt->time - cur->time,
-        ttl1-ttl2
-    );
-
+    rec->pos = pkt->pos;
+    rec->diffPos = pkt->pos - cur->pos;
+    rec->type = type;
+    rec->nullPay = (dataCmp == -1) ? 1 : 0;
+    rec->vlan = VLANchange(cur, pkt);
+    rec->dscp = DSCPchange(cur, pkt);
+    rec->time = pkt->time;
+    rec->diffTime = pkt->time - cur->time;
+    rec->ttl = ttl2;
+    rec->diffTTL = ttl1-ttl2;
+    rec->flags = 0;
 
     if (dups_extended) {
-        utils_mac2txt(pkt->dis.src, macSrc2);
-        utils_mac2txt(pkt->dis.dst, macDst2);
-        count += fprintf(stream, " %.9Lf %i %s > %s", pkt->time, ttl2, macSrc2, macDst2);
-        if (pkt->dis.ethertype == ETH_PROTO_IPv4) {
-            inet_ntop(AF_INET, &pkt->dis.ipPkt->bytes->srcAddr, ipSrc2, INET_ADDRSTRLEN);
-            inet_ntop(AF_INET, &pkt->dis.ipPkt->bytes->dstAddr, ipDst2, INET_ADDRSTRLEN);
-            count += fprintf(stream, " %s > %s", ipSrc2, ipDst2);
+        memcpy(rec->dupSrcMAC, pkt->dis.src, 6);
+        memcpy(rec->dupDstMAC, pkt->dis.dst, 6);
+        // fields not shown are zeroed (binary records carry them all)
+        memset(rec->dupSrcIP, 0, 16);
+        memset(rec->dupDstIP, 0, 16);
+        memset(rec->fromSrcIP, 0, 16);
+        memset(rec->fromDstIP, 0, 16);
+        if (pkt->dis.ip4) {
+            rec->flags |= DUPS_RECORD_DUP_IP;
+            memcpy(rec->dupSrcIP, &pkt->dis.ipPkt->bytes->srcAddr, 4);
+            memcpy(rec->dupDstIP, &pkt->dis.ipPkt->bytes->dstAddr, 4);
+        } else if (pkt->dis.ip6) {
+            rec->flags |= DUPS_RECORD_DUP_IP6;
+            memcpy(rec->dupSrcIP, pkt->dis.ip6->srcAddr, 16);
+            memcpy(rec->dupDstIP, pkt->dis.ip6->dstAddr, 16);
         }
         if (type) {
-            utils_mac2txt(cur->dis.src, macSrc1);
-            utils_mac2txt(cur->dis.dst, macDst1);
-            count += fprintf(stream, " | %s > %s", macSrc1, macDst1);
-            if (type == -1 || type == 2 || type == 3 || type == 5) {
-                if (cur->dis.ethertype == ETH_PROTO_IPv4) {
-                    inet_ntop(AF_INET, &cur->dis.ipPkt->bytes->srcAddr, ipSrc1, INET_ADDRSTRLEN);
-                    inet_ntop(AF_INET, &cur->dis.ipPkt->bytes->dstAddr, ipDst1, INET_ADDRSTRLEN);
-                    count += fprintf(stream, " %s > %s", ipSrc1, ipDst1);
-                }
+            memcpy(rec->fromSrcMAC, cur->dis.src, 6);
+            memcpy(rec->fromDstMAC, cur->dis.dst, 6);
+            if (cur->dis.ip4) {
+                rec->flags |= DUPS_RECORD_FROM_IP;
+                memcpy(rec->fromSrcIP, &cur->dis.ipPkt->bytes->srcAddr, 4);
+                memcpy(rec->fromDstIP, &cur->dis.ipPkt->bytes->dstAddr, 4);
+            } else if (cur->dis.ip6) {
+                rec->flags |= DUPS_RECORD_FROM_IP6;
+                memcpy(rec->fromSrcIP, cur->dis.ip6->srcAddr, 16);
+                memcpy(rec->fromDstIP, cur->dis.ip6->dstAddr, 16);
             }
+        } else {
+            memset(rec->fromSrcMAC, 0, 6);
+            memset(rec->fromDstMAC, 0, 6);
         }
+        rec->dupSource = pkt->source;
+        rec->fromSource = cur->source;
     }
+}
+
+// flags of the binary output
+static inline int dups_bin_flags() {
+    if (!dups_extended) return 0;
+    return DUPS_BIN_EXTENDED | (dups_sources ? DUPS_BIN_SOURCES : 0);
+}
 
-    count += fprintf(stream, "\n");
+// record size for some flags of the binary output (-1: unknown flags)
+static inline int dups_bin_size(int flags) {
+    switch (flags) {
+    case 0:                                     return DUPS_BIN_RECORD;
+    case DUPS_BIN_EXTENDED:                     return DUPS_BIN_RECORD_EXT;
+    case DUPS_BIN_EXTENDED | DUPS_BIN_SOURCES:  return DUPS_BIN_RECORD_SRC;
+    default:                                    return -1;
+    }
+}
 
-    return count;
+/**
+ * @brief Shows the input file of both copies in the extended output
+ *
+ * @param sources   !=0 to enable (several input files)
+ */
+void dups_set_sources(int sources) {
+    dups_sources = sources;
 }
 
 /**
  * @brief Output formatter
  *
- * @param stream    output string
- * @param cur       first packet
- * @param pkt       second packet (duplicate)
- * @param type      type of duplicate
- * @param dataCmp   output from sameData()
+ * The line is built in place, without printf, and written at once.
+ *
+ * @param stream    output stream
+ * @param rec       duplicate record
  * @return          number of characters printed
  */
-static inline int dups_sprintf(char *stream, pkt_t *cur, pkt_t *pkt, int type, int dataCmp) {
-    int count = 0;
-
-    char macSrc2[20], macDst2[20], macSrc1[20], macDst1[20];
-    char ipSrc1[INET_ADDRSTRLEN], ipSrc2[INET_ADDRSTRLEN], ipDst1[INET_ADDRSTRLEN], ipDst2[INET_ADDRSTRLEN];
-    int ttl1=0, ttl2=0;
+inline int dups_print(FILE *stream, dupsRecord_t *rec) {
+    char line[DUPS_LINE_MAX], *p = line;
 
-    if (cur->dis.ethertype == ETH_PROTO_IPv4 && pkt->dis.ethertype == ETH_PROTO_IPv4) {
-        ttl1 = (u_int)cur->dis.ipPkt->bytes->ttl;
-        ttl2 = (u_int)pkt->dis.ipPkt->bytes->ttl;
+    if (dups_binary) {
+        dups_pack(rec, (unsigned char *)line, dups_bin_flags());
+        return fwrite(line, 1, dups_bin_size(dups_bin_flags()), stream);
     }
-    count += sprintf(stream+count, "%llu %llu %i %i %i %i %.9Lf %i",
-        pkt->pos,
-        pkt->pos - cur->pos,
-        type,
-        (dataCmp == -1) ? 1 : 0,
-        VLANchange(cur, pkt),
-        DSCPchange(cur, pkt),
-        pkt->time - cur->time,
-        ttl1-ttl2
-    );
 
+    p = utils_fmt_u64(p, rec->pos);
+    *p++ = ' ';
+    p = utils_fmt_u64(p, rec->diffPos);
+    *p++ = ' ';
+    p = utils_fmt_i64(p, rec->type);
+    *p++ = ' ';
+    p = utils_fmt_i64(p, rec->nullPay);
+    *p++ = ' ';
+    p = utils_fmt_i64(p, rec->vlan);
+    *p++ = ' ';
+    p = utils_fmt_i64(p, rec->dscp);
+    *p++ = ' ';
+    p = utils_fmt_ns(p, rec->diffTime);
+    *p++ = ' ';
+    p = utils_fmt_i64(p, rec->diffTTL);
 
     if (dups_extended) {
-        utils_mac2txt(pkt->dis.src, macSrc2);
-        utils_mac2txt(pkt->dis.dst, macDst2);
-        count += sprintf(stream+count, " %.9Lf %i %s > %s", pkt->time, ttl2, macSrc2, macDst2);
-        if (pkt->dis.ethertype == ETH_PROTO_IPv4) {
-            inet_ntop(AF_INET, &pkt->dis.ipPkt->bytes->srcAddr, ipSrc2, INET_ADDRSTRLEN);
-            inet_ntop(AF_INET, &pkt->dis.ipPkt->bytes->dstAddr, ipDst2, INET_ADDRSTRLEN);
-            count += sprintf(stream+count, " %s > %s", ipSrc2, ipDst2);
+        *p++ = ' ';
+        p = utils_fmt_ns(p, rec->time);
+        *p++ = ' ';
+        p = utils_fmt_i64(p, rec->ttl);
+        *p++ = ' ';
+        p = utils_fmt_mac(p, rec->dupSrcMAC);
+        memcpy(p, " > ", 3);
+        p = utils_fmt_mac(p + 3, rec->dupDstMAC);
+        if (rec->flags & DUPS_RECORD_DUP_IP) {
+            *p++ = ' ';
+            p = utils_fmt_ip4(p, rec->dupSrcIP);
+            memcpy(p, " > ", 3);
+            p = utils_fmt_ip4(p + 3, rec->dupDstIP);
+        } else if (rec->flags & DUPS_RECORD_DUP_IP6) {
+            *p++ = ' ';
+            p = utils_fmt_ip6(p, rec->dupSrcIP);
+            memcpy(p, " > ", 3);
+            p = utils_fmt_ip6(p + 3, rec->dupDstIP);
         }
-        if (type) {
-            utils_mac2txt(cur->dis.src, macSrc1);
-            utils_mac2txt(cur->dis.dst, macDst1);
-            count += sprintf(stream+count, " | %s > %s", macSrc1, macDst1);
-            if (type == -1 || type == 2 || type == 3 || type == 5) {
-                if (cur->dis.ethertype == ETH_PROTO_IPv4) {
-                    inet_ntop(AF_INET, &cur->dis.ipPkt->bytes->srcAddr, ipSrc1, INET_ADDRSTRLEN);
-                    inet_ntop(AF_INET, &cur->dis.ipPkt->bytes->dstAddr, ipDst1, INET_ADDRSTRLEN);
-                    count += sprintf(stream+count, " %s > %s", ipSrc1, ipDst1);
+        if (rec->type) {
+            memcpy(p, " | ", 3);
+            p = utils_fmt_mac(p + 3, rec->fromSrcMAC);
+            memcpy(p, " > ", 3);
+            p = utils_fmt_mac(p + 3, rec->fromDstMAC);
+            if (rec->type == -1 || rec->type == 2 || rec->type == 3 || rec->type == 5) {
+                if (rec->flags & DUPS_RECORD_FROM_IP) {
+                    *p++ = ' ';
+                    p = utils_fmt_ip4(p, rec->fromSrcIP);
+                    memcpy(p, " > ", 3);
+                    p = utils_fmt_ip4(p + 3, rec->fromDstIP);
+                } else if (rec->flags & DUPS_RECORD_FROM_IP6) {
+                    *p++ = ' ';
+                    p = utils_fmt_ip6(p, rec->fromSrcIP);
+                    memcpy(p, " > ", 3);
+                    p = utils_fmt_ip6(p + 3, rec->fromDstIP);
                 }
             }
         }
+        if (dups_sources) {
+            memcpy(p, " @ ", 3);
+            p = utils_fmt_u64(p + 3, rec->dupSource);
+            *p++ = ' ';
+            p = utils_fmt_u64(p, rec->fromSource);
+        }
     }
 
-    count += sprintf(stream+count, "\n");
+    *p++ = '\n';
+
+    return fwrite(line, 1, p - line, stream);
+}
+
+// little-endian integers of any size
+static inline void dups_put_le(unsigned char *buf, unsigned long long value, int bytes) {
+    for (int i=0; i<bytes; i++) buf[i] = value >> 8*i;
+}
 
-    return count;
+static inline unsigned long long dups_get_le(const unsigned char *buf, int bytes) {
+    unsigned long long value = 0;
+    for (int i=0; i<bytes; i++) value |= (unsigned long long)buf[i] << 8*i;
+    return value;
+}
+
+/**
+ * @brief Writes the header of the binary output
+ *
+ * @param stream    output stream
+ * @return          number of bytes written (0 in text mode)
+ */
+int dups_print_header(FILE *stream) {
+    unsigned char header[DUPS_BIN_HEADER];
+
+    if (!dups_binary) return 0;
+    memcpy(header, DUPS_BIN_MAGIC, 8);
+    dups_put_le(header + 8, DUPS_BIN_VERSION, 2);
+    dups_put_le(header + 10, dups_bin_flags(), 2);
+    dups_put_le(header + 12, DUPS_BIN_HEADER, 2);
+    dups_put_le(header + 14, dups_bin_size(dups_bin_flags()), 2);
+    return fwrite(header, 1, DUPS_BIN_HEADER, stream);
+}
+
+/**
+ * @brief Reads and checks the header of a binary output
+ *
+ * @param stream    input stream
+ * @param flags     output: DUPS_BIN_* flags
+ * @return          record size, -1 on error
+ */
+int dups_read_header(FILE *stream, int *flags) {
+    unsigned char header[DUPS_BIN_HEADER];
+    int size;
+
+    UTILS_CHECK(fread(header, 1, DUPS_BIN_HEADER, stream) != DUPS_BIN_HEADER, EIO, return -1);
+    UTILS_CHECK(memcmp(header, DUPS_BIN_MAGIC, 8) || dups_get_le(header + 8, 2) != DUPS_BIN_VERSION, EINVAL, return -1);
+    *flags = dups_get_le(header + 10, 2);
+    size = dups_get_le(header + 14, 2);
+    UTILS_CHECK(size != dups_bin_size(*flags), EINVAL, return -1);
+
+    // skip the rest of a longer header
+    for (int i = dups_get_le(header + 12, 2) - DUPS_BIN_HEADER; i > 0; i--)
+        UTILS_CHECK(fgetc(stream) == EOF, EIO, return -1);
+
+    return size;
+}
+
+/**
+ * @brief Encodes a duplicate record (see dups.h for the layout)
+ *
+ * @param rec       duplicate record
+ * @param buf       output: DUPS_BIN_RECORD, DUPS_BIN_RECORD_EXT or DUPS_BIN_RECORD_SRC bytes
+ * @param flags     DUPS_BIN_* flags
+ */
+void dups_pack(const dupsRecord_t *rec, unsigned char *buf, int flags) {
+    dups_put_le(buf, rec->pos, 8);
+    dups_put_le(buf + 8, rec->diffPos, 8);
+    dups_put_le(buf + 16, rec->diffTime, 8);
+    buf[24] = rec->type;
+    buf[25] = rec->nullPay;
+    buf[26] = rec->vlan;
+    buf[27] = rec->dscp;
+    dups_put_le(buf + 28, rec->diffTTL, 2);
+    buf[30] = rec->flags;
+    buf[31] = rec->ttl;
+    if (!(flags & DUPS_BIN_EXTENDED)) return;
+
+    dups_put_le(buf + 32, rec->time, 8);
+    memcpy(buf + 40, rec->dupSrcMAC, 6);
+    memcpy(buf + 46, rec->dupDstMAC, 6);
+    memcpy(buf + 52, rec->fromSrcMAC, 6);
+    memcpy(buf + 58, rec->fromDstMAC, 6);
+    memcpy(buf + 64, rec->dupSrcIP, 16);
+    memcpy(buf + 80, rec->dupDstIP, 16);
+    memcpy(buf + 96, rec->fromSrcIP, 16);
+    memcpy(buf + 112, rec->fromDstIP, 16);
+    if (!(flags & DUPS_BIN_SOURCES)) return;
+
+    dups_put_le(buf + 128, rec->dupSource, 2);
+    dups_put_le(buf + 130, rec->fromSource, 2);
+}
+
+/**
+ * @brief Decodes a duplicate record (see dups.h for the layout)
+ *
+ * @param buf       DUPS_BIN_RECORD, DUPS_BIN_RECORD_EXT or DUPS_BIN_RECORD_SRC bytes
+ * @param rec       output: duplicate record
+ * @param flags     DUPS_BIN_* flags
+ */
+void dups_unpack(const unsigned char *buf, dupsRecord_t *rec, int flags) {
+    memset(rec, 0, sizeof(*rec));
+    rec->pos = dups_get_le(buf, 8);
+    rec->diffPos = dups_get_le(buf + 8, 8);
+    rec->diffTime = (int64_t)dups_get_le(buf + 16, 8);
+    rec->type = (signed char)buf[24];
+    rec->nullPay = buf[25];
+    rec->vlan = buf[26];
+    rec->dscp = buf[27];
+    rec->diffTTL = (short)dups_get_le(buf + 28, 2);
+    rec->flags = buf[30];
+    rec->ttl = buf[31];
+    if (!(flags & DUPS_BIN_EXTENDED)) return;
+
+    rec->time = (int64_t)dups_get_le(buf + 32, 8);
+    memcpy(rec->dupSrcMAC, buf + 40, 6);
+    memcpy(rec->dupDstMAC, buf + 46, 6);
+    memcpy(rec->fromSrcMAC, buf + 52, 6);
+    memcpy(rec->fromDstMAC, buf + 58, 6);
+    memcpy(rec->dupSrcIP, buf + 64, 16);
+    memcpy(rec->dupDstIP, buf + 80, 16);
+    memcpy(rec->fromSrcIP, buf + 96, 16);
+    memcpy(rec->fromDstIP, buf + 112, 16);
+    if (!(flags & DUPS_BIN_SOURCES)) return;
+
+    rec->dupSource = dups_get_le(buf + 128, 2);
+    rec->fromSource = dups_get_le(buf + 130, 2);
+}
+
+/**
+ * @brief Reports a duplicate
+ *
+ * @param output    output ring or NULL (stream of the worker)
+ * @param id        thread identifier
+ * @param cur       first packet
+ * @param pkt       second packet (duplicate)
+ * @param type      type of duplicate
+ * @param dataCmp   output from sameData()
+ */
+static inline void dups_output(ring_t *output, unsigned int id, pkt_t *cur, pkt_t *pkt, int type, int dataCmp) {
+    dupsRecord_t rec;
+
+    if (!output && !dups_stream[id]) return;
+    dups_record(&rec, cur, pkt, type, dataCmp);
+    if (!output) dups_print(dups_stream[id], &rec);
+    else while (ring_push(output, &rec)) sched_yield();
 }
 
 /**
@@ -437,7 +862,7 @@ static inline int dups_sprintf(char *stream, pkt_t *cur, pkt_t *pkt, int type, i
 static inline int in_window(pkt_t *pkt, pkt_t *cur) {
     switch (dups_window_mode) {
     case 0:
-        if (dups_window_time < pkt->time - cur->time) return 0;
+        if (pkt->time - cur->time > dups_window_time) return 0;
         break;
     case 1:
         if (dups_window_pos-1 < pkt->pos - cur->pos) return 0;
@@ -446,158 +871,576 @@ static inline int in_window(pkt_t *pkt, pkt_t *cur) {
     return 1;
 }
 
-// Normal mode
-static inline int _dups_search(node_t *node, unsigned int id, char *output, int *bufSize) {
-    UTILS_CHECK(!node || !node->load, EINVAL, return -1);
-    UTILS_CHECK(((pkt_t *)node->load)->frame->caplen <= 13, ENODATA, return -1);
-
-    if (bufSize) *bufSize = 0;
-    pkt_t *cur, *pkt = (pkt_t *)node->load;
-    node_t *marker = buffer_get_marker(node->buffer, id);
-    node_t *last = node;
-    node = node->prev;
-    int type, dataCmp=0, fragCmp=0, macsCmp, dupe=0;
+/**
+ * @brief Compares the IP ID of two IP packets of the same version
+ *
+ * @param cur   one packet
+ * @param pkt   another packet
+ * @return      1 (TRUE) or 0 (FALSE)
+ */
+static inline int sameID(pkt_t *cur, pkt_t *pkt) {
+    if (cur->dis.ip6) return cur->dis.flowId == pkt->dis.flowId;
+    return cur->dis.ipPkt->bytes->identification == pkt->dis.ipPkt->bytes->identification;
+}
 
-    while (node && (marker != last)) {
-        cur = (pkt_t *)node->load;
-        if (!in_window(pkt, cur)) break;
+/**
+ * @brief Compares a packet with a previous one and reports the result
+ *
+ * @param cur       previous packet
+ * @param pkt       current packet
+ * @param fragCmp   output from fragmentInData() (kept between calls)
+ * @param output    output ring or NULL (stream of the worker)
+ * @param id        thread identifier
+ * @param enabled   enabled comparators (see dups_comparator())
+ * @return          1 if a duplicate was found, 0 if not
+ */
+static inline __attribute__((always_inline)) int dups_compare(pkt_t *cur, pkt_t *pkt, int *fragCmp, ring_t *output, unsigned int id, const unsigned int enabled) {
+    int type = 0, dataCmp, macsCmp, dupe = 0;
 
-        type = 0;
-        dataCmp = sameData(cur->dis.data, cur->dis.bufSize, pkt->dis.data, pkt->dis.bufSize);
+    dataCmp = sameData(cur, pkt);
 
-        // payload match or null payload
-        if (dataCmp) {
-            if (cur->dis.ethertype == pkt->dis.ethertype) {
-                macsCmp = compareMacs(cur, pkt);
-                // switching
-                if (macsCmp == 2) {
-                    if (DUPS_TYPE[type].comparator)
-                        if (DUPS_TYPE[type].comparator(cur, pkt, dataCmp)) dupe = 1;
-                // routing
-                } else if (macsCmp == 0 && cur->dis.ethertype == ETH_PROTO_IPv4) {
-                    // check IP ID
-                    if (cur->dis.ipPkt->bytes->identification == pkt->dis.ipPkt->bytes->identification && cur->dis.protocol == pkt->dis.protocol) {
-                        for (type=1; type<4; type++) {
-                            if (DUPS_TYPE[type].comparator)
-                                if (DUPS_TYPE[type].comparator(cur, pkt, dataCmp)) {
-                                    dupe = 1;
-                                    break;
-                                }
+    // payload match or null payload
+    if (dataCmp) {
+        if (cur->dis.ethertype == pkt->dis.ethertype) {
+            macsCmp = compareMacs(cur, pkt);
+            // switching
+            if (macsCmp == 2) {
+                if (dups_comparator(type, enabled, cur, pkt, dataCmp)) dupe = 1;
+            // routing
+            } else if (macsCmp == 0 && ((cur->dis.ip4 && pkt->dis.ip4) || (cur->dis.ip6 && pkt->dis.ip6))) {
+                // check IP ID
+                if (sameID(cur, pkt) && cur->dis.protocol == pkt->dis.protocol) {
+                    for (type=1; type<4; type++) {
+                        if (dups_comparator(type, enabled, cur, pkt, dataCmp)) {
+                            dupe = 1;
+                            break;
                         }
                     }
                 }
             }
-        // fragmentation
-        } else {
-            if (cur->dis.ethertype == ETH_PROTO_IPv4 && pkt->dis.ethertype == ETH_PROTO_IPv4 && ip_is_fragment(pkt->dis.ipPkt)) {
-                if (pkt->dis.offset) fragCmp = fragmentInData((void *)cur->dis.ipData, cur->dis.ipBufSize, (void *)pkt->dis.ipData, pkt->dis.ipBufSize, pkt->dis.offset);
-                else fragCmp = fragmentInData(cur->dis.data, cur->dis.bufSize, pkt->dis.data, pkt->dis.bufSize, 0);
-                if (fragCmp) {
-                    macsCmp = compareMacs(cur, pkt);
-                    // routing + check IP ID
-                    if (macsCmp == 0 && cur->dis.ipPkt->bytes->identification == pkt->dis.ipPkt->bytes->identification) {
-                        for (type=4; type<DUPS_COMPARATORS; type++) {
-                            if (DUPS_TYPE[type].comparator)
-                                if (DUPS_TYPE[type].comparator(cur, pkt, fragCmp)) {
-                                    dupe = 1;
-                                    break;
-                                }
+        }
+    // fragmentation (needs the payloads)
+    } else if (!dups_headers) {
+        if (cur->dis.ip4 && pkt->dis.ip4 && ip_is_fragment(pkt->dis.ipPkt)) {
+            if (pkt->dis.offset) *fragCmp = fragmentInData((void *)cur->dis.ipData, cur->dis.ipBufSize, (void *)pkt->dis.ipData, pkt->dis.ipBufSize, pkt->dis.offset);
+            else *fragCmp = fragmentInData(cur->dis.data, cur->dis.bufSize, pkt->dis.data, pkt->dis.bufSize, 0);
+            if (*fragCmp) {
+                macsCmp = compareMacs(cur, pkt);
+                // routing + check IP ID
+                if (macsCmp == 0 && cur->dis.ipPkt->bytes->identification == pkt->dis.ipPkt->bytes->identification) {
+                    for (type=4; type<DUPS_COMPARATORS; type++) {
+                        if (dups_comparator(type, enabled, cur, pkt, *fragCmp)) {
+                            dupe = 1;
+                            break;
                         }
                     }
                 }
             }
         }
+    }
+
+    // suspicious, type = -1
+    if (dataCmp == 1 && !dupe) {
+        DUPS_COUNT(dups_counters[id].numSuspicious);
+        if (dups_suspicious) {
+            dups_output(output, id, cur, pkt, -1, dataCmp);
+        }
+    }
+
+    // duplicate found!
+    if (dupe) {
+        DUPS_COUNT(dups_counters[id].numDup[type]);
+        dups_output(output, id, cur, pkt, type, dataCmp);
+        if (*fragCmp) pkt_copy(cur, pkt, 0);
+    }
+
+    return dupe;
+}
+
+/**
+ * @brief Hash key of a payload
+ *
+ * NULL payloads get their own key, because sameData() matches them with any payload of the same size.
+ *
+ * @param data    the payload
+ * @param size    size of the payload
+ * @param digest  hash of the payload
+ * @return        the key
+ */
+static inline unsigned long long dups_key_data(const void *data, int size, unsigned long long digest) {
+    if (!data) return utils_hash64(NULL, 0, size) ^ DUPS_KEY_NULL;
+    return utils_hash64(&digest, sizeof(digest), size);
+}
+
+/**
+ * @brief Hash key of the header fields checked by comparator_fast()
+ *
+ * @param pkt   the packet
+ * @return      the key
+ */
+static inline unsigned long long dups_key_fast(pkt_t *pkt) {
+    unsigned int fields[5];
+
+    if (pkt->dis.ip6) {
+        fields[0] = pkt->dis.flowId;
+        fields[1] = pkt->dis.ip6->payloadLength;
+        fields[2] = ETH_PROTO_IPv6;
+        fields[3] = pkt->dis.protocol;
+        fields[4] = pkt->dis.offset;
+        // source and destination addresses
+        return utils_hash64(fields, sizeof(fields), utils_hash64(pkt->dis.ip6->srcAddr, 2*16, 0));
+    }
+    fields[0] = pkt->dis.ipPkt->bytes->identification | (unsigned int)pkt->dis.ipPkt->bytes->totalLength << 16;
+    fields[1] = pkt->dis.ipPkt->bytes->srcAddr;
+    fields[2] = pkt->dis.ipPkt->bytes->dstAddr;
+    fields[3] = pkt->dis.protocol;
+    fields[4] = pkt->dis.offset;
+    return utils_hash64(fields, sizeof(fields), 0);
+}
+
+// hot columns (see dupsHot_t)
+#define DUPS_HOT_COLUMNS(X) X(bound) X(digest) X(tag) X(addr) X(node)
+
+/**
+ * @brief Gets the hot fields of a packet
+ *
+ * @param key   output: hot fields
+ * @param pkt   the packet
+ */
+static inline void dups_hot_key(dupsHotKey_t *key, pkt_t *pkt) {
+    key->bound = dups_window_mode ? (int64_t)pkt->pos : pkt->time;
+    key->limit = dups_window_mode ? (int64_t)dups_window_pos - 1 : dups_window_time;
+    key->digest = pkt->dis.digest;
+    key->addr = 0;
+
+    int len = pkt->dis.bufSize;
+    unsigned short ipid = 0;
+    unsigned char proto = 0, flags = pkt->dis.data ? 0 : DUPS_HOT_NULL;
+    // not for truncated IP headers: their fields were not captured
+    if (pkt->dis.ip4) {
+        flags |= DUPS_HOT_IPV4;
+        if (!dups_headers && ip_is_fragment(pkt->dis.ipPkt)) flags |= DUPS_HOT_FRAG;
+        key->addr = (unsigned long long)pkt->dis.ipPkt->bytes->srcAddr << 32 | pkt->dis.ipPkt->bytes->dstAddr;
+        ipid = pkt->dis.ipPkt->bytes->identification;
+        proto = pkt->dis.protocol;
+        if (dups_fast) len = pkt->dis.ipPkt->bytes->totalLength;
+    } else if (pkt->dis.ip6) {
+        flags |= DUPS_HOT_IPV6;
+        ipid = pkt->dis.flowId ^ pkt->dis.flowId >> 16;
+        proto = pkt->dis.protocol;
+        if (dups_fast) {
+            key->addr = utils_hash64(pkt->dis.ip6->srcAddr, 2*16, 0);
+            len = pkt->dis.ip6->payloadLength;
+        }
+    }
+    key->tag = DUPS_HOT_TAG(len, ipid, proto, flags);
+}
+
+/**
+ * @brief Doubles the hot columns
+ *
+ * @param hot   hot columns
+ * @param lo    sequence number of the oldest entry to keep
+ * @param hi    sequence number of the entry after the newest one
+ * @return      0 on success, -1 on error
+ */
+static int dups_hot_grow(dupsHot_t *hot, unsigned long long lo, unsigned long long hi) {
+    unsigned long long size = hot->node ? 2*(hot->mask+1) : DUPS_HOT_INIT_SIZE;
+    dupsHot_t new = {.mask = size-1};
+
+#define DUPS_HOT_ALLOC(col) \
+    new.col = malloc(size*sizeof(*new.col)); \
+    if (!new.col) { \
+        perror("Error: dups_hot_grow > malloc"); \
+        return -1; \
+    }
+    DUPS_HOT_COLUMNS(DUPS_HOT_ALLOC)
 
-        // suspicious, type = -1
-        if (dataCmp == 1 && !dupe) {
-            pthread_mutex_lock(&dups_mutex);
-            dups_stats->numSuspicious++;
-            pthread_mutex_unlock(&dups_mutex);
-            if (dups_suspicious) {
-                if (!output) dups_fprintf(stdout, cur, pkt, -1, dataCmp);
-                else *bufSize = dups_sprintf(output, cur, pkt, -1, dataCmp);
+#define DUPS_HOT_COPY(col) new.col[seq & new.mask] = hot->col[seq & hot->mask];
+    if (hot->node)
+        for (unsigned long long seq = lo; seq < hi; seq++) {
+            DUPS_HOT_COLUMNS(DUPS_HOT_COPY)
+        }
+
+#define DUPS_HOT_FREE(col) free(hot->col);
+    DUPS_HOT_COLUMNS(DUPS_HOT_FREE)
+    *hot = new;
+
+    return 0;
+}
+
+/**
+ * @brief Adds a packet to the hot columns
+ *
+ * @param hot   hot columns
+ * @param node  the node
+ * @param lo    sequence number of the oldest entry in use (end-of-window marker)
+ */
+static inline void dups_hot_insert(dupsHot_t *hot, node_t *node, unsigned long long lo) {
+    dupsHotKey_t key;
+
+    if (!hot->node || node->seq - lo > hot->mask)
+        if (dups_hot_grow(hot, lo, node->seq)) exit(EXIT_FAILURE);
+
+    unsigned long long i = node->seq & hot->mask;
+    dups_hot_key(&key, (pkt_t *)node->load);
+    hot->bound[i] = key.bound;
+    hot->digest[i] = key.digest;
+    hot->tag[i] = key.tag;
+    hot->addr[i] = key.addr;
+    hot->node[i] = node;
+}
+
+// blocks of hot entries (GCC vector extensions, lowered to the SIMD width of each clone)
+typedef int64_t dupsHotVec_t __attribute__((vector_size(8*DUPS_HOT_BLOCK)));
+typedef unsigned long long dupsHotUVec_t __attribute__((vector_size(8*DUPS_HOT_BLOCK)));
+
+// the entries are evaluated on scalars or on blocks: a nonzero result (1 or -1) means true
+
+// the entry is out of the window (see in_window())
+#define DUPS_HOT_OUT(key, b) \
+    ((key)->bound - (b) > (key)->limit)
+
+// normal mode: sameData() isn't 0 (same size and digest, or a NULL payload), or the fragment is compared
+#define DUPS_HOT_MATCH(key, t, d) \
+    ((((((t) ^ (key)->tag) & DUPS_HOT_TAG_LEN) == 0) & \
+      (((d) == (key)->digest) | ((((t) | (key)->tag) & DUPS_HOT_NULL) != 0))) | \
+     ((((key)->tag & DUPS_HOT_FRAG) != 0) & (((t) & DUPS_HOT_IPV4) != 0)))
+
+// fast mode: the IP header fields checked by comparator_fast()
+#define DUPS_HOT_MATCH_FAST(key, t, a) \
+    ((((t) & (DUPS_HOT_IPV4 | DUPS_HOT_IPV6)) != 0) & ((((t) ^ (key)->tag) & DUPS_HOT_TAG_FAST) == 0) & ((a) == (key)->addr))
+
+/**
+ * @brief Scans the hot columns backwards, from hi-1 to lo
+ *
+ * Blocks of DUPS_HOT_BLOCK entries are tested at once with vector operations.
+ * Only candidates need a look at the packets: everything else can't be a duplicate.
+ *
+ * @param hot   hot columns
+ * @param key   hot fields of the current packet
+ * @param lo    sequence number of the oldest entry
+ * @param hi    sequence number of the entry after the newest one
+ * @param at    output: sequence number of the entry found
+ * @param fast  fast mode
+ * @return      1 if a candidate was found, 0 if an entry is out of the window, -1 if none is left
+ */
+static inline __attribute__((always_inline)) int _dups_hot_scan(const dupsHot_t *hot, const dupsHotKey_t *key,
+        unsigned long long lo, unsigned long long hi, unsigned long long *at, const int fast) {
+    while (hi > lo) {
+        // entries down to the start of the columns are contiguous
+        unsigned long long n = MIN(hi - lo, ((hi-1) & hot->mask) + 1);
+
+        for (; n >= DUPS_HOT_BLOCK; n -= DUPS_HOT_BLOCK, hi -= DUPS_HOT_BLOCK) {
+            unsigned long long base = ((hi-1) & hot->mask) + 1 - DUPS_HOT_BLOCK;
+            dupsHotVec_t bound, out, cand;
+            dupsHotUVec_t tag, other;
+
+            memcpy(&bound, hot->bound + base, sizeof(bound));
+            memcpy(&tag, hot->tag + base, sizeof(tag));
+            memcpy(&other, fast ? hot->addr + base : hot->digest + base, sizeof(other));
+            out = DUPS_HOT_OUT(key, bound);
+            cand = fast ? DUPS_HOT_MATCH_FAST(key, tag, other) : DUPS_HOT_MATCH(key, tag, other);
+
+            // the newest one wins (the window check goes first)
+            for (int k = DUPS_HOT_BLOCK-1; k >= 0; k--) {
+                if (!(out[k] | cand[k])) continue;
+                *at = hi - DUPS_HOT_BLOCK + k;
+                return !out[k];
             }
         }
+        for (; n; n--, hi--) {
+            unsigned long long i = (hi-1) & hot->mask;
+            *at = hi-1;
+            if (DUPS_HOT_OUT(key, hot->bound[i])) return 0;
+            if (fast ? DUPS_HOT_MATCH_FAST(key, hot->tag[i], hot->addr[i]) : DUPS_HOT_MATCH(key, hot->tag[i], hot->digest[i])) return 1;
+        }
+    }
 
-        // duplicate found!
-        if (dupe) {
-            pthread_mutex_lock(&dups_mutex);
-            dups_stats->numDup[type]++;
-            pthread_mutex_unlock(&dups_mutex);
-            if (!output) dups_fprintf(stdout, cur, pkt, type, dataCmp);
-            else *bufSize = dups_sprintf(output, cur, pkt, type, dataCmp);
-            if (fragCmp) pkt_copy(cur, pkt, 0);
-            break;
+    return -1;
+}
+
+DUPS_HOT_CLONES static int dups_hot_scan(const dupsHot_t *hot, const dupsHotKey_t *key,
+        unsigned long long lo, unsigned long long hi, unsigned long long *at) {
+    return _dups_hot_scan(hot, key, lo, hi, at, 0);
+}
+
+DUPS_HOT_CLONES static int dups_hot_scan_fast(const dupsHot_t *hot, const dupsHotKey_t *key,
+        unsigned long long lo, unsigned long long hi, unsigned long long *at) {
+    return _dups_hot_scan(hot, key, lo, hi, at, 1);
+}
+
+/**
+ * @brief Keeps track of the window coordinate going backwards
+ *
+ * Timestamps can go backwards in the trace, and positions when pkt_copy() sets a merged
+ * fragment back to its first copy. Either way, a backward scan would stop at that node.
+ *
+ * @param win   window index
+ * @param node  the node (after its own search)
+ */
+static inline void dups_window_check_order(dupsWindow_t *win, node_t *node) {
+    pkt_t *pkt = (pkt_t *)node->load;
+    int64_t coord = dups_window_mode ? (int64_t)pkt->pos : pkt->time;
+
+    if (coord < win->last) win->inversion = DUPS_WINDOW_POS(node);
+    win->last = coord;
+}
+
+/**
+ * @brief Adds a packet to the window index of a worker
+ *
+ * @param win   window index
+ * @param node  the node
+ */
+static inline void dups_window_insert(dupsWindow_t *win, node_t *node) {
+    pkt_t *pkt = (pkt_t *)node->load;
+
+    dups_window_check_order(win, node);
+    dups_hot_insert(&win->hot, node, buffer_get_marker(node->buffer, win->id)->seq);
+
+    if (!dups_fast) hashidx_insert(win->idx, dups_key_data(pkt->dis.data, pkt->dis.bufSize, pkt->dis.digest), DUPS_WINDOW_POS(node), node);
+    else if (pkt->dis.ip4 || pkt->dis.ip6) hashidx_insert(win->idx, dups_key_fast(pkt), DUPS_WINDOW_POS(node), node);
+}
+
+/**
+ * @brief Gets the window index of a worker and brings it up to date
+ *
+ * Every packet between the last one indexed by this worker and the current one is added to the index.
+ *
+ * @param node  current node
+ * @param id    thread identifier
+ * @return      the window index
+ */
+static inline dupsWindow_t *dups_window_get(node_t *node, unsigned int id) {
+    dupsWindow_t *win = &dups_window[id];
+
+    if (!win->idx) {
+        win->idx = hashidx_init(HASHIDX_INIT_SIZE);
+        if (!win->idx) exit(EXIT_FAILURE);
+        win->id = id;
+    }
+
+    node_t *next = win->indexed ? win->indexed->next : buffer_get_marker(node->buffer, id);
+    for (; next != node; next = next->next)
+        dups_window_insert(win, next);
+
+    return win;
+}
+
+/**
+ * @brief Marks the current packet as indexed
+ *
+ * @param win   window index
+ * @param node  current node
+ */
+static inline void dups_window_done(dupsWindow_t *win, node_t *node) {
+    dups_window_insert(win, node);
+    win->indexed = node;
+}
+
+/**
+ * @brief Finds the oldest packet within the window
+ *
+ * This is the node where a backward scan would have stopped. It is only valid when
+ * the window coordinate doesn't go backwards inside the window (otherwise, -1 is returned
+ * and a full scan is needed, see dups_window_check_order()).
+ *
+ * @param win       window index
+ * @param node      current node
+ * @param marker    end-of-window marker of this worker
+ * @param first     output: the oldest node within the window
+ * @return          1 if the marker must be updated, 0 if not, -1 if the window can't be found
+ */
+static inline int dups_window_bound(dupsWindow_t *win, node_t *node, node_t *marker, node_t **first) {
+    pkt_t *pkt = (pkt_t *)node->load;
+    node_t *start = marker;
+    unsigned long long markerPos = DUPS_WINDOW_POS(marker);
+
+    if (win->lo && DUPS_WINDOW_POS(win->lo) > markerPos) start = win->lo;
+    if (win->inversion > DUPS_WINDOW_POS(start)) return -1;
+
+    while (start != node && !in_window(pkt, (pkt_t *)start->load))
+        start = start->next;
+
+    *first = win->lo = start;
+    return DUPS_WINDOW_POS(start) > markerPos;
+}
+
+// Normal mode (enabled: see dups_comparator())
+static inline __attribute__((always_inline)) int _dups_search_mask(node_t *node, unsigned int id, ring_t *output, const unsigned int enabled) {
+    UTILS_CHECK(!node || !node->load, EINVAL, return -1);
+    UTILS_CHECK(((pkt_t *)node->load)->frame->caplen <= 13, ENODATA, return -1);
+
+    pkt_t *cur, *pkt = (pkt_t *)node->load;
+    node_t *marker = buffer_get_marker(node->buffer, id);
+    node_t *first;
+    dupsWindow_t *win = dups_window_get(node, id);
+    dupsHotKey_t key;
+    unsigned long long seq = node->seq;
+    int fragCmp=0, dupe=0, update, found;
+
+    // indexed search: only packets with the same payload (or a NULL one) can match
+    if (!(pkt->dis.ip4 && ip_is_fragment(pkt->dis.ipPkt)) &&
+        pkt->dis.bufSize >= 0 && (pkt->dis.data || !pkt->dis.bufSize) &&
+        (update = dups_window_bound(win, node, marker, &first)) >= 0) {
+        unsigned long long firstPos = DUPS_WINDOW_POS(first), posA, posB;
+        unsigned long long keyA = pkt->dis.data ? dups_key_data(pkt->dis.data, pkt->dis.bufSize, pkt->dis.digest) :
+                                                  dups_key_data("", pkt->dis.bufSize, pkt_digest(NULL, 0));
+        unsigned long long keyB = dups_key_data(NULL, pkt->dis.bufSize, 0);
+        unsigned long long curA = hashidx_lookup(win->idx, keyA);
+        unsigned long long curB = (keyB != keyA) ? hashidx_lookup(win->idx, keyB) : 0;
+
+        // merge both chains from newest to oldest
+        while (1) {
+            posA = curA ? hashidx_get_pos(win->idx, curA) : 0;
+            posB = curB ? hashidx_get_pos(win->idx, curB) : 0;
+            if (posA < firstPos && posB < firstPos) break;
+
+            if (posA > posB) {
+                cur = (pkt_t *)((node_t *)hashidx_get_load(win->idx, curA))->load;
+                curA = hashidx_next(win->idx, curA);
+            } else {
+                cur = (pkt_t *)((node_t *)hashidx_get_load(win->idx, curB))->load;
+                curB = hashidx_next(win->idx, curB);
+            }
+            if ((dupe = dups_compare(cur, pkt, &fragCmp, output, id, enabled))) break;
         }
 
-        // continue
-        last = node;
-        node = node->prev;
+        // update end-of-window marker
+        if (!dupe && update)
+            buffer_set_marker(first, id);
+        hashidx_expire(win->idx, firstPos);
+        dups_window_done(win, node);
+
+        return dupe;
+    }
+
+    // full backward scan: hot columns first, packets only for the candidates
+    dups_hot_key(&key, pkt);
+    while ((found = dups_hot_scan(&win->hot, &key, marker->seq, seq, &seq)) > 0) {
+        cur = (pkt_t *)win->hot.node[seq & win->hot.mask]->load;
+        if ((dupe = dups_compare(cur, pkt, &fragCmp, output, id, enabled))) break;
     }
 
-    // update end-of-window marker
-    if (!dupe && node && (marker != last))
-        buffer_set_marker(last, id);
+    // update end-of-window marker (oldest packet within the window)
+    if (!found)
+        buffer_set_marker(seq+1 == node->seq ? node : win->hot.node[(seq+1) & win->hot.mask], id);
+    win->lo = NULL;
+    dups_window_done(win, pkt->container);
 
     return dupe;
 }
 
+// generic search loop
+static int _dups_search(node_t *node, unsigned int id, ring_t *output) {
+    return _dups_search_mask(node, id, output, DUPS_ENABLED_ANY);
+}
+
+// specialized search loops
+#define DUPS_SEARCH_DEFINE(name, mask) \
+static int _dups_search_##name(node_t *node, unsigned int id, ring_t *output) { \
+    return _dups_search_mask(node, id, output, mask); \
+}
+DUPS_SEARCH_VARIANTS(DUPS_SEARCH_DEFINE)
+
 /**
- * @brief Fast mode comparator (only IPv4 duplicates)
+ * @brief Fast mode comparator (only IP duplicates)
  *
  * @param cur   one packet
  * @param pkt   another packet
  * @return      1 (TRUE) or 0 (FALSE)
  */
 static inline int comparator_fast(pkt_t *cur, pkt_t *pkt) {
-    if (cur->dis.ipPkt->bytes->identification != pkt->dis.ipPkt->bytes->identification) return 0;
-    if (cur->dis.ipPkt->bytes->totalLength != pkt->dis.ipPkt->bytes->totalLength) return 0;
-    if (cur->dis.ipPkt->bytes->srcAddr != pkt->dis.ipPkt->bytes->srcAddr || cur->dis.ipPkt->bytes->dstAddr != pkt->dis.ipPkt->bytes->dstAddr) return 0;
+    if (!cur->dis.ip6 != !pkt->dis.ip6 || !cur->dis.ip4 != !pkt->dis.ip4) return 0;
+    if (pkt->dis.ip6) {
+        if (cur->dis.flowId != pkt->dis.flowId) return 0;
+        if (cur->dis.ip6->payloadLength != pkt->dis.ip6->payloadLength) return 0;
+        if (memcmp(cur->dis.ip6->srcAddr, pkt->dis.ip6->srcAddr, 16) || memcmp(cur->dis.ip6->dstAddr, pkt->dis.ip6->dstAddr, 16)) return 0;
+    } else {
+        if (cur->dis.ipPkt->bytes->identification != pkt->dis.ipPkt->bytes->identification) return 0;
+        if (cur->dis.ipPkt->bytes->totalLength != pkt->dis.ipPkt->bytes->totalLength) return 0;
+        if (cur->dis.ipPkt->bytes->srcAddr != pkt->dis.ipPkt->bytes->srcAddr || cur->dis.ipPkt->bytes->dstAddr != pkt->dis.ipPkt->bytes->dstAddr) return 0;
+    }
     if (cur->dis.protocol != pkt->dis.protocol) return 0;
     if (cur->dis.offset != pkt->dis.offset) return 0;
-    return !memcmp(cur->dis.data, pkt->dis.data, MIN(cur->dis.bufSize, 20));
+    if (MIN(cur->dis.bufSize, PKT_FAST_BYTES) == MIN(pkt->dis.bufSize, PKT_FAST_BYTES) && cur->dis.digest != pkt->dis.digest) return 0;
+    // NULL payloads match, as in sameData()
+    if (dups_headers || !cur->dis.data || !pkt->dis.data || cur->dis.bufSize <= 0) return 1;
+    return !memcmp(cur->dis.data, pkt->dis.data, MIN(cur->dis.bufSize, PKT_FAST_BYTES));
+}
+
+/**
+ * @brief Reports a duplicate found in fast mode
+ *
+ * @param cur       previous packet
+ * @param pkt       current packet
+ * @param output    output ring or NULL (stream of the worker)
+ * @param id        thread identifier
+ */
+static inline void dups_report_fast(pkt_t *cur, pkt_t *pkt, ring_t *output, unsigned int id) {
+    int type = 0;
+
+    if (compareMacs(cur, pkt) != 2) type = 1;
+    DUPS_COUNT(dups_counters[id].numDup[type]);
+    dups_output(output, id, cur, pkt, type, 0);
 }
 
 // Fast mode
-static inline int _dups_search_fast(node_t *node, unsigned int id, char *output, int *bufSize) {
+static inline int _dups_search_fast(node_t *node, unsigned int id, ring_t *output) {
     UTILS_CHECK(!node || !node->load, EINVAL, return -1);
     UTILS_CHECK(((pkt_t *)node->load)->frame->caplen <= 13, ENODATA, return -1);
 
-    if (bufSize) *bufSize = 0;
     pkt_t *cur, *pkt = (pkt_t *)node->load;
     node_t *marker = buffer_get_marker(node->buffer, id);
-    node_t *last = node;
-    node = node->prev;
-
-    if (pkt->dis.ethertype != ETH_PROTO_IPv4) return 0;
-    int dupe=0, type=0;
-
-    while (node && (marker != last)) {
-        cur = (pkt_t *)node->load;
-        if (!in_window(pkt, cur)) break;
-
-        if (cur->dis.ethertype == ETH_PROTO_IPv4) {
-            dupe = comparator_fast(cur, pkt);
-            // match
-            if (dupe) {
-                if (compareMacs(cur, pkt) != 2) type = 1;
-                pthread_mutex_lock(&dups_mutex);
-                dups_stats->numDup[type]++;
-                pthread_mutex_unlock(&dups_mutex);
-                if (!output) dups_fprintf(stdout, cur, pkt, type, 0);
-                else *bufSize = dups_sprintf(output, cur, pkt, type, 0);
+    node_t *first;
+    dupsWindow_t *win = dups_window_get(node, id);
+    dupsHotKey_t key;
+    unsigned long long seq = node->seq;
+    int dupe=0, update, found;
+
+    if (!pkt->dis.ip4 && !pkt->dis.ip6) {
+        dups_window_done(win, node);
+        return 0;
+    }
+
+    // indexed search: only packets with the same IP header fields can match
+    if ((update = dups_window_bound(win, node, marker, &first)) >= 0) {
+        unsigned long long firstPos = DUPS_WINDOW_POS(first);
+        unsigned long long cursor = hashidx_lookup(win->idx, dups_key_fast(pkt));
+
+        for (; cursor && hashidx_get_pos(win->idx, cursor) >= firstPos; cursor = hashidx_next(win->idx, cursor)) {
+            cur = (pkt_t *)((node_t *)hashidx_get_load(win->idx, cursor))->load;
+            if ((dupe = comparator_fast(cur, pkt))) {
+                dups_report_fast(cur, pkt, output, id);
                 break;
             }
         }
 
-        // continue
-        last = node;
-        node = node->prev;
+        // update end-of-window marker
+        if (!dupe && update)
+            buffer_set_marker(first, id);
+        hashidx_expire(win->idx, firstPos);
+        dups_window_done(win, node);
+
+        return dupe;
+    }
+
+    // full backward scan: hot columns first, packets only for the candidates
+    dups_hot_key(&key, pkt);
+    while ((found = dups_hot_scan_fast(&win->hot, &key, marker->seq, seq, &seq)) > 0) {
+        cur = (pkt_t *)win->hot.node[seq & win->hot.mask]->load;
+        if ((dupe = comparator_fast(cur, pkt))) {
+            dups_report_fast(cur, pkt, output, id);
+            break;
+        }
     }
 
-    // update end-of-window marker
-    if (!dupe && node && (marker != last))
-        buffer_set_marker(last, id);
+    // update end-of-window marker (oldest packet within the window)
+    if (!found)
+        buffer_set_marker(seq+1 == node->seq ? node : win->hot.node[(seq+1) & win->hot.mask], id);
+    win->lo = NULL;
+    dups_window_done(win, pkt->container);
 
     return dupe;
 }
@@ -610,37 +1453,49 @@ static inline int _dups_search_fast(node_t *node, unsigned int id, char *output,
  * - bit 1 disables comparator_1() (routing)
  * - ...
  * @param fast              fast mode flag (!=0 to enable)
+ * @param headers           header-only mode flag (!=0 to enable): payloads are compared by digest and
+ *                          fragmentation types are disabled
  * @param mode              window mode flag
  * - 0 time limited
  * - 1 position limited
  * @param value             string with a new window limit (in seconds or positions)
  * @param extendedOutput    extended output flag (!=0 to enable)
  * @param suspicious        suspicious flag (!=0 to enable)
- * @param stats             pointer to stats_t struct
+ * @param binary            binary output flag (!=0 to enable, see dups.h)
  */
-void dups_init(unsigned int dupMask, int fast, int mode, char *value, int extendedOutput, int suspicious, stats_t *stats) {
+void dups_init(unsigned int dupMask, int fast, int headers, int mode, char *value, int extendedOutput, int suspicious, int binary) {
     if (!(dupMask & 0x0001)) DUPS_TYPE[0].comparator = comparator_0;
     if (!(dupMask & 0x0002)) DUPS_TYPE[1].comparator = comparator_1;
     if (!(dupMask & 0x0004)) DUPS_TYPE[2].comparator = comparator_2;
     if (!(dupMask & 0x0008)) DUPS_TYPE[3].comparator = comparator_3;
-    if (!(dupMask & 0x0010)) DUPS_TYPE[4].comparator = comparator_4;
-    if (!(dupMask & 0x0020)) DUPS_TYPE[5].comparator = comparator_5;
+    if (!(dupMask & 0x0010) && !headers) DUPS_TYPE[4].comparator = comparator_4;
+    if (!(dupMask & 0x0020) && !headers) DUPS_TYPE[5].comparator = comparator_5;
+
+    // pick a specialized search loop for the enabled comparators, if there is one
+    unsigned int enabled = 0;
+    for (int type = 0; type < DUPS_COMPARATORS; type++)
+        if (DUPS_TYPE[type].comparator) enabled |= 1U << type;
 
-    if (!fast) dups_search = _dups_search;
-    else dups_search = _dups_search_fast;
+    if (!fast) {
+        dups_search = _dups_search;
+#define DUPS_SEARCH_PICK(name, mask) if (enabled == mask) dups_search = _dups_search_##name;
+        DUPS_SEARCH_VARIANTS(DUPS_SEARCH_PICK)
+    } else dups_search = _dups_search_fast;
 
+    dups_fast = fast;
+    dups_headers = headers;
     dups_extended = extendedOutput;
     dups_suspicious = suspicious;
-    dups_stats = stats;
-    pthread_mutex_init(&dups_mutex, NULL);
+    dups_binary = binary;
+    for (int i=0; i<BUFFER_MAX_WORKERS; i++) dups_stream[i] = stdout;
 
-    float aux0; int aux1;
+    double aux0; int aux1;
     if (value) {
         dups_window_mode = mode;
         switch (mode) {
         case 0:
             aux0 = atof(value);
-            if (aux0 > 0) dups_window_time = aux0;
+            if (aux0 > 0) dups_window_time = (int64_t)(aux0*1e9 + 0.5);
             break;
         case 1:
             aux1 = atoi(value);
@@ -654,9 +1509,82 @@ void dups_init(unsigned int dupMask, int fast, int mode, char *value, int extend
     }
 }
 
+/**
+ * @brief Gets the window length
+ *
+ * @param length    output: window length (nanoseconds or positions)
+ * @return window mode (0=time, 1=pos)
+ */
+int dups_get_window(unsigned long long *length) {
+    *length = dups_window_mode ? dups_window_pos : dups_window_time;
+    return dups_window_mode;
+}
+
+/**
+ * @brief Sets where a worker prints its records when it has no output ring
+ *
+ * @param id        thread identifier
+ * @param stream    the stream (default: stdout) or NULL to discard the records
+ */
+void dups_set_stream(unsigned int id, FILE *stream) {
+    UTILS_CHECK(id >= BUFFER_MAX_WORKERS, EINVAL, return);
+
+    dups_stream[id] = stream;
+}
+
+/**
+ * @brief Empties the window index of a worker (to start over with an empty window)
+ *
+ * @param id    thread identifier
+ */
+void dups_clear_window(unsigned int id) {
+    UTILS_CHECK(id >= BUFFER_MAX_WORKERS, EINVAL, return);
+
+    dupsWindow_t *win = &dups_window[id];
+    dupsHot_t *hot = &win->hot;
+
+    if (win->idx) hashidx_destroy(win->idx);
+    DUPS_HOT_COLUMNS(DUPS_HOT_FREE)
+    memset(win, 0, sizeof(dupsWindow_t));
+}
+
 /**
  * @brief Cleaner
  */
 void dups_destroy() {
-    pthread_mutex_destroy(&dups_mutex);
+    for (int i=0; i<BUFFER_MAX_WORKERS; i++)
+        dups_clear_window(i);
+}
+
+/**
+ * @brief Gets the duplicate counters, added up over all workers
+ *
+ * It doesn't lock: while workers are running, the snapshot may be slightly behind.
+ *
+ * @param stats   output: numSuspicious and numDup are set (pkts is untouched)
+ */
+void dups_get_stats(stats_t *stats) {
+    stats->numSuspicious = 0;
+    for (int type=0; type<DUPS_COMPARATORS; type++) stats->numDup[type] = 0;
+
+    for (int i=0; i<BUFFER_MAX_WORKERS; i++) {
+        stats->numSuspicious += __atomic_load_n(&dups_counters[i].numSuspicious, __ATOMIC_RELAXED);
+        for (int type=0; type<DUPS_COMPARATORS; type++)
+            stats->numDup[type] += __atomic_load_n(&dups_counters[i].numDup[type], __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Resets the duplicate counters of a worker (e.g. after warming up its window)
+ *
+ * Only the worker itself may call it.
+ *
+ * @param id    thread identifier
+ */
+void dups_clear_stats(unsigned int id) {
+    UTILS_CHECK(id >= BUFFER_MAX_WORKERS, EINVAL, return);
+
+    __atomic_store_n(&dups_counters[id].numSuspicious, 0, __ATOMIC_RELAXED);
+    for (int type=0; type<DUPS_COMPARATORS; type++)
+        __atomic_store_n(&dups_counters[id].numDup[type], 0, __ATOMIC_RELAXED);
 }
@@ -12,6 +12,7 @@
 
 #include "buffer.h"
 #include "pkt.h"
+#include "ring.h"
 #include <stdio.h>
 
 #define DUPS_COMPARATORS 6  /**< Number of types of duplicates */
@@ -35,20 +36,117 @@ typedef struct {
 
 extern dup_t DUPS_TYPE[DUPS_COMPARATORS];  /**< Array of types */
 
+// record flags
+#define DUPS_RECORD_DUP_IP   0x01   /**< the duplicate is an IPv4 packet */
+#define DUPS_RECORD_FROM_IP  0x02   /**< the first copy is an IPv4 packet */
+#define DUPS_RECORD_DUP_IP6  0x04   /**< the duplicate is an IPv6 packet */
+#define DUPS_RECORD_FROM_IP6 0x08   /**< the first copy is an IPv6 packet */
+
+/**
+ * Duplicate record (one output line)
+ */
+typedef struct {
+    unsigned long long  pos;            /**< duplicate position */
+    unsigned long long  diffPos;        /**< position difference between copies */
+    int64_t             time;           /**< duplicate timestamp (ns) */
+    int64_t             diffTime;       /**< timestamp difference between copies (ns) */
+    int                 type;           /**< type of duplicate */
+    int                 ttl;            /**< duplicate TTL */
+    int                 diffTTL;        /**< TTL difference between copies */
+    char                nullPay;        /**< NULL payload flag */
+    char                vlan;           /**< VLAN tag change flag */
+    char                dscp;           /**< DSCP tag change flag */
+    char                flags;          /**< DUPS_RECORD_* flags */
+
+    // extended output
+    char                dupSrcMAC[6];   /**< duplicate source MAC */
+    char                dupDstMAC[6];   /**< duplicate destination MAC */
+    char                fromSrcMAC[6];  /**< first copy source MAC */
+    char                fromDstMAC[6];  /**< first copy destination MAC */
+    unsigned char       dupSrcIP[16];   /**< duplicate source IP (IPv4: first 4 bytes) */
+    unsigned char       dupDstIP[16];   /**< duplicate destination IP */
+    unsigned char       fromSrcIP[16];  /**< first copy source IP */
+    unsigned char       fromDstIP[16];  /**< first copy destination IP */
+    unsigned int        dupSource;      /**< input file of the duplicate (see dups_set_sources()) */
+    unsigned int        fromSource;     /**< input file of the first copy */
+} dupsRecord_t;
+
+/*
+ * Binary output: a header followed by fixed-width records, sorted by duplicate position.
+ * All integers are little-endian; IP addresses are kept in network order (raw bytes).
+ *
+ * Header (DUPS_BIN_HEADER bytes):
+ *   0  magic (DUPS_BIN_MAGIC, 8 bytes)
+ *   8  version (u16)
+ *  10  flags (u16, DUPS_BIN_EXTENDED, DUPS_BIN_SOURCES)
+ *  12  header size (u16)
+ *  14  record size (u16)
+ *
+ * Record (DUPS_BIN_RECORD bytes, DUPS_BIN_RECORD_EXT with extended output):
+ *   0  dupNo (u64)         8  diffNo (u64)         16  diffTs in ns (i64)
+ *  24  type (i8)          25  nullPay (u8)        26  vlan (u8)        27  dscp (u8)
+ *  28  diffTTL (i16)      30  DUPS_RECORD_* flags (u8)                 31  dupTTL (u8)
+ * extended:
+ *  32  dupTs in ns (i64)  40  dupSrcMAC  46  dupDstMAC  52  fromSrcMAC  58  fromDstMAC
+ *  64  dupSrcIP  80  dupDstIP  96  fromSrcIP  112  fromDstIP
+ *      (16 bytes each: IPv4 addresses take the first 4 and the rest is zero, see the
+ *       DUPS_RECORD_* flags for the version of each copy)
+ * sources (DUPS_BIN_RECORD_SRC bytes, extended output from several input files):
+ * 128  dupFile (u16)     130  fromFile (u16)
+ */
+#define DUPS_BIN_MAGIC      "NTDUPS\r\n"
+#define DUPS_BIN_VERSION    1
+#define DUPS_BIN_EXTENDED   0x0001  /**< records carry the extended output */
+#define DUPS_BIN_SOURCES    0x0002  /**< extended records carry the input file of both copies */
+#define DUPS_BIN_HEADER     16      /**< header size */
+#define DUPS_BIN_RECORD     32      /**< record size */
+#define DUPS_BIN_RECORD_EXT 128     /**< record size (extended output) */
+#define DUPS_BIN_RECORD_SRC 132     /**< record size (extended output with input files) */
+
 // initializer
 // fast mode: only IP packets + switching duplicates + routing duplicates
-void dups_init(unsigned int dupMask, int fast, int mode, char *value, int extendedOutput, int suspicious, stats_t *stats);
+void dups_init(unsigned int dupMask, int fast, int headers, int mode, char *value, int extendedOutput, int suspicious, int binary);
 
 /**
  * @brief Searches for duplicates
  *
  * @param node      current node
  * @param id        thread identifier
- * @param output    output stream or NULL
- * @param bufSize   number of bytes written to the stream
+ * @param output    ring of dupsRecord_t or NULL (records are printed to the stream of the worker, see dups_set_stream())
  * @return 1 if a duplicate was found, 0 if not, -1 on error
  */
-extern int (*dups_search)(node_t *node, unsigned int id, char *output, int *bufSize);
+extern int (*dups_search)(node_t *node, unsigned int id, ring_t *output);
+
+// window length (nanoseconds or positions) and mode (0=time, 1=pos)
+int dups_get_window(unsigned long long *length);
+
+// where a worker without an output ring prints its records (default: stdout, NULL: discarded)
+void dups_set_stream(unsigned int id, FILE *stream);
+
+// empty the window index of a worker
+void dups_clear_window(unsigned int id);
+
+// extended output: show the input file of both copies (!=0 to enable, several input files)
+void dups_set_sources(int sources);
+
+// format a duplicate record (text or binary, see dups_init())
+int dups_print(FILE *stream, dupsRecord_t *rec);
+
+// binary output: write the header (nothing in text mode)
+int dups_print_header(FILE *stream);
+
+// binary records: encode/decode one (flags: DUPS_BIN_* flags of the header, which set the record size)
+void dups_pack(const dupsRecord_t *rec, unsigned char *buf, int flags);
+void dups_unpack(const unsigned char *buf, dupsRecord_t *rec, int flags);
+
+// binary input: check the header and get its flags and the record size (-1 on error)
+int dups_read_header(FILE *stream, int *flags);
+
+// snapshot of the duplicate counters (no locking, safe while searching)
+void dups_get_stats(stats_t *stats);
+
+// reset the counters of a worker (called by the worker itself)
+void dups_clear_stats(unsigned int id);
 
 // cleaner
 void dups_destroy();
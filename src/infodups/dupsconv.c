@@ -0,0 +1,87 @@
+/*
+ * dupsconv.c
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#include "../config.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include "../common/utils.h"
+#include "dups.h"
+
+#ifndef DUPSCONV_OUTBUF
+#define DUPSCONV_OUTBUF 1048576 // stdout buffer size
+#endif
+
+void print_options() {
+    fprintf(stderr, "\ndupsconv %s\n", INFODUPS_VERSION);
+    fputs(  "Converts the binary output of infodups ('-B') to its text output.\n"
+            "http://github.com/Enchufa2/nantools\n"
+            "\n"
+            "Usage: dupsconv [options]\n"
+            "\n"
+            "Options:\n"
+            "  -h               show help\n"
+            "  -i <file>        binary output of infodups (default: standard input)\n"
+            "\n"
+            "Copyright (C) 2013 Iñaki Úcar <i.ucar86@gmail.com>\n"
+            "Distributed under the GNU General Public License v3.0\n"
+            "This is free software: you are free to change and redistribute it.\n"
+            "There is NO WARRANTY, to the extent permitted by law.\n\n",
+    stderr);
+}
+
+static char outBuf[DUPSCONV_OUTBUF];    // stdout buffer
+
+int main (int argc, char **argv) {
+    char option, *path = NULL;
+    unsigned char buf[DUPS_BIN_RECORD_SRC];
+    int size, flags;
+    FILE *input = stdin;
+    dupsRecord_t rec;
+
+    while ((option = getopt(argc, argv, "hi:")) != -1) {
+        switch (option) {
+            case 'h':
+                print_options();
+                exit(0);
+            case 'i':
+                path = optarg;
+                break;
+            default:
+                print_options();
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (path && !(input = fopen(path, "rb"))) {
+        perror("Error: main > fopen");
+        return EXIT_FAILURE;
+    }
+    if ((size = dups_read_header(input, &flags)) < 0) {
+        fprintf(stderr, "Error: not an infodups binary output\n");
+        return EXIT_FAILURE;
+    }
+
+    // text output with the same flags
+    dups_init(0, 0, 0, 0, NULL, flags & DUPS_BIN_EXTENDED, 0, 0);
+    dups_set_sources(flags & DUPS_BIN_SOURCES);
+    setvbuf(stdout, outBuf, _IOFBF, sizeof(outBuf));
+
+    while (fread(buf, size, 1, input) == 1) {
+        dups_unpack(buf, &rec, flags);
+        dups_print(stdout, &rec);
+    }
+    if (ferror(input)) {
+        perror("Error: main > fread");
+        return EXIT_FAILURE;
+    }
+
+    if (path) fclose(input);
+    dups_destroy();
+    return EXIT_SUCCESS;
+}
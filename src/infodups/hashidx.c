@@ -0,0 +1,233 @@
+/*
+ * hashidx.c
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#include "hashidx.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * Index entry
+ */
+typedef struct {
+    unsigned long long  key;    /**< hash key */
+    unsigned long long  pos;    /**< position of the indexed element */
+    void                *load;  /**< pointer to the indexed element */
+    unsigned long long  next;   /**< sequence number of the next (older) entry in the same bucket */
+} entry_t;
+
+/**
+ * Private index structure
+ *
+ * Entries are stored in a ring indexed by sequence number, so expiring old entries
+ * is just a matter of moving the tail forward. Bucket chains are linked by sequence
+ * number too: a link to a sequence number lower than the tail is an expired entry
+ * and ends the chain, so stale chains never need to be unlinked.
+ */
+struct hashidx {
+    entry_t             *entries;   /**< ring of entries */
+    unsigned long long  *buckets;   /**< sequence number of the newest entry in each bucket (0: empty) */
+    unsigned long long  mask;       /**< ring and bucket mask (size-1) */
+
+    unsigned long long  head;       /**< sequence number for the next entry */
+    unsigned long long  tail;       /**< sequence number of the oldest entry */
+};
+
+/**
+ * @brief Allocates the ring and the buckets of an index and rebuilds the chains
+ *
+ * @param idx   the index
+ * @param size  new number of entries (power of two)
+ * @return 0 on success, -1 on error
+ */
+static int hashidx_resize(hashidx_t *idx, unsigned long long size) {
+    entry_t *entries = (entry_t *) malloc(size*sizeof(entry_t));
+    unsigned long long *buckets = (unsigned long long *) calloc(size, sizeof(unsigned long long));
+    if (!entries || !buckets) {
+        perror("Error: hashidx_resize > malloc");
+        free(entries);
+        free(buckets);
+        return -1;
+    }
+
+    // move live entries, oldest first, so chains keep the newest entry on top
+    for (unsigned long long seq = idx->tail; seq < idx->head; seq++) {
+        entry_t *entry = &entries[seq & (size-1)];
+        *entry = idx->entries[seq & idx->mask];
+        entry->next = buckets[entry->key & (size-1)];
+        buckets[entry->key & (size-1)] = seq;
+    }
+
+    free(idx->entries);
+    free(idx->buckets);
+    idx->entries = entries;
+    idx->buckets = buckets;
+    idx->mask = size-1;
+
+    return 0;
+}
+
+/**
+ * @brief Initializes a new index
+ *
+ * This library is intended for indexing the packets of a sliding window by a hash key.
+ * Entries are expired in insertion order and the index grows as needed.
+ *
+ * @param size initial number of entries (rounded up to a power of two)
+ * @return a pointer to the index (NULL if error)
+ */
+hashidx_t *hashidx_init(unsigned long long size) {
+    hashidx_t *idx = (hashidx_t *) malloc(sizeof(hashidx_t));
+    if (!idx) {
+        perror("Error: hashidx_init > malloc");
+        return NULL;
+    }
+    idx->entries = NULL;
+    idx->buckets = NULL;
+    idx->mask = 0;
+    idx->head = 1;
+    idx->tail = 1;
+
+    unsigned long long n = 1;
+    while (n < size) n <<= 1;
+    if (hashidx_resize(idx, n)) {
+        free(idx);
+        return NULL;
+    }
+
+    return idx;
+}
+
+/**
+ * @brief Destroys an index
+ *
+ * @param idx the index
+ */
+void hashidx_destroy(hashidx_t *idx) {
+    UTILS_CHECK(!idx, EINVAL, return);
+
+    free(idx->entries);
+    free(idx->buckets);
+    free(idx);
+}
+
+/**
+ * @brief Inserts a new entry
+ *
+ * Entries must be inserted in increasing position order.
+ *
+ * @param idx   the index
+ * @param key   hash key
+ * @param pos   position of the element
+ * @param load  pointer to the element
+ * @return 0 on success, -1 on error
+ */
+inline int hashidx_insert(hashidx_t *idx, unsigned long long key, unsigned long long pos, void *load) {
+    UTILS_CHECK(!idx, EINVAL, return -1);
+
+    if (idx->head - idx->tail > idx->mask)
+        if (hashidx_resize(idx, (idx->mask+1) << 1)) return -1;
+
+    unsigned long long seq = idx->head++;
+    entry_t *entry = &idx->entries[seq & idx->mask];
+    entry->key = key;
+    entry->pos = pos;
+    entry->load = load;
+    entry->next = idx->buckets[key & idx->mask];
+    idx->buckets[key & idx->mask] = seq;
+
+    return 0;
+}
+
+/**
+ * @brief Removes the entries older than a given position
+ *
+ * @param idx   the index
+ * @param pos   first position to keep
+ */
+inline void hashidx_expire(hashidx_t *idx, unsigned long long pos) {
+    UTILS_CHECK(!idx, EINVAL, return);
+
+    while (idx->tail < idx->head && idx->entries[idx->tail & idx->mask].pos < pos)
+        idx->tail++;
+}
+
+// private: first live entry with the given key, starting from seq
+static inline unsigned long long hashidx_follow(hashidx_t *idx, unsigned long long key, unsigned long long seq) {
+    while (seq >= idx->tail) {
+        if (idx->entries[seq & idx->mask].key == key) return seq;
+        seq = idx->entries[seq & idx->mask].next;
+    }
+    return 0;
+}
+
+/**
+ * @brief Gets the newest entry with a given key
+ *
+ * @param idx   the index
+ * @param key   hash key
+ * @return a cursor to the entry or 0 if there is none
+ */
+inline unsigned long long hashidx_lookup(hashidx_t *idx, unsigned long long key) {
+    UTILS_CHECK(!idx, EINVAL, return 0);
+
+    return hashidx_follow(idx, key, idx->buckets[key & idx->mask]);
+}
+
+/**
+ * @brief Gets the next (older) entry with the same key
+ *
+ * @param idx       the index
+ * @param cursor    cursor to the current entry
+ * @return a cursor to the entry or 0 if there is none
+ */
+inline unsigned long long hashidx_next(hashidx_t *idx, unsigned long long cursor) {
+    UTILS_CHECK(!idx, EINVAL, return 0);
+
+    entry_t *entry = &idx->entries[cursor & idx->mask];
+    return hashidx_follow(idx, entry->key, entry->next);
+}
+
+/**
+ * @brief Gets the position of an entry
+ *
+ * @param idx       the index
+ * @param cursor    cursor to the entry
+ * @return the position
+ */
+inline unsigned long long hashidx_get_pos(hashidx_t *idx, unsigned long long cursor) {
+    UTILS_CHECK(!idx, EINVAL, return 0);
+
+    return idx->entries[cursor & idx->mask].pos;
+}
+
+/**
+ * @brief Gets the element of an entry
+ *
+ * @param idx       the index
+ * @param cursor    cursor to the entry
+ * @return a pointer to the element
+ */
+inline void *hashidx_get_load(hashidx_t *idx, unsigned long long cursor) {
+    UTILS_CHECK(!idx, EINVAL, return NULL);
+
+    return idx->entries[cursor & idx->mask].load;
+}
+
+/**
+ * @brief Gets the number of entries in an index
+ *
+ * @param idx the index
+ * @return the number of entries
+ */
+inline unsigned long long hashidx_get_count(hashidx_t *idx) {
+    UTILS_CHECK(!idx, EINVAL, return 0);
+
+    return idx->head - idx->tail;
+}
@@ -0,0 +1,42 @@
+/*
+ * hashidx.h
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#ifndef HASHIDX_H_
+#define HASHIDX_H_
+
+#ifndef HASHIDX_INIT_SIZE
+#define HASHIDX_INIT_SIZE 1024  /**< initial number of entries (power of two) */
+#endif
+
+typedef struct hashidx hashidx_t;
+
+// initializer
+hashidx_t *hashidx_init(unsigned long long size);
+
+// free all memory
+void hashidx_destroy(hashidx_t *idx);
+
+// insert a new entry (positions must be inserted in increasing order)
+int hashidx_insert(hashidx_t *idx, unsigned long long key, unsigned long long pos, void *load);
+
+// remove the entries older than pos
+void hashidx_expire(hashidx_t *idx, unsigned long long pos);
+
+// iterate over the entries with a given key, from newest to oldest (end: 0)
+unsigned long long hashidx_lookup(hashidx_t *idx, unsigned long long key);
+unsigned long long hashidx_next(hashidx_t *idx, unsigned long long cursor);
+
+// entry contents
+unsigned long long hashidx_get_pos(hashidx_t *idx, unsigned long long cursor);
+void *hashidx_get_load(hashidx_t *idx, unsigned long long cursor);
+
+// number of entries in the index
+unsigned long long hashidx_get_count(hashidx_t *idx);
+
+#endif /* HASHIDX_H_ */
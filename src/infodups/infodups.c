@@ -11,34 +11,70 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <sched.h>
 #include <pcap/pcap.h>
 #include "../common/utils.h"
+#include "../common/trace.h"
 #include "worker.h"
+#include "ring.h"
 #include "dups.h"
+#include "dumper.h"
+#include "chunk.h"
+#include "merge.h"
+#include "pipeline.h"
+
+#ifndef INFODUPS_OUTBUF
+#define INFODUPS_OUTBUF 1048576 // stdout buffer size
+#endif
+
+#ifndef INFODUPS_STALL_WAIT
+#define INFODUPS_STALL_WAIT 1000000 // longest wait for the workers with a full window (ns)
+#endif
+
+#ifndef INFODUPS_LOAD_EVERY
+#define INFODUPS_LOAD_EVERY 64      // packets between samples of the queue occupancy (pipeline)
+#endif
 
 void print_options() {
     fprintf(stderr, "\ninfodups %s\n", INFODUPS_VERSION);
     fputs(  "Identifies and marks duplicate packets in PCAP files.\n"
             "http://github.com/Enchufa2/nantools\n"
             "\n"
-            "Usage: infodups [options] -i <file>\n"
-            "  -i <file>        PCAP file\n"
+            "Usage: infodups [options] -i <file> [-i <file> ...]\n"
+            "  -i <file>        PCAP file (several files, e.g. one per capture port, are merged by timestamp\n"
+            "                   while they are read, and searched as a single trace)\n"
             "\n"
             "Options:\n"
             "  -h               show help\n"
             "  -v               show progress\n"
             "  -x               show extended output\n"
             "  -s               print suspicious duplicates\n"
+            "  -B               binary output: fixed-width little-endian records (convert to text with dupsconv)\n"
+            "  -o <file>        write the trace without duplicates (suspicious ones are kept) to a PCAP file\n"
+            "  -d <file>        write the duplicates removed by '-o' to a PCAP file\n"
             "  -b               (debug) show window state for every packet\n"
             "\n"
             "  -F               fast mode\n"
+            "  -H               header-only mode: keep headers and a payload hash per packet (longer windows\n"
+            "                   in less memory, no byte-by-byte payload check, types 4 and 5 disabled)\n"
             "  [-0] [-1] ...    deactivate duplicates of each type\n"
             "\n"
             "  -t <timeout>     window length in seconds (default: 0.1)\n"
             "  -n <maxPos>      window length in positions\n\n"
 
             "  -T <threads>     number of threads to use [2-64] (default: no threads)\n"
-            "  -M <mem>         memory limit (GB) with multithreading (default: 2)\n"
+            "  -M <mem>         memory limit (GB) for the packets in the window: when it is reached, reading waits\n"
+            "                   for the threads to release old packets (default: 2)\n"
+            "  -w <mode>        how idle threads wait for packets: spin, futex (spin, then sleep) or block (default: futex)\n"
+            "  -S               shard packets among threads by IP ID (IPv6: flow label and L4 fields) and protocol,\n"
+            "                   with a private window per thread (suspicious duplicates are only searched within\n"
+            "                   the same shard)\n"
+            "  -P <chunks>      split the file into chunks [1-64], each one read, dissected and searched by a thread\n"
+            "                   of its own after reading again one window before it (classic PCAP files only)\n"
+            "  -D <threads>     pipeline mode with '-T': files are read by threads of their own, packets are\n"
+            "                   dissected by this number of threads [1-64] and records are printed by another\n"
+            "                   one (not in header-only mode)\n"
             "\n"
             "Copyright (C) 2013 Iñaki Úcar <i.ucar86@gmail.com>\n"
             "Distributed under the GNU General Public License v3.0\n"
@@ -59,9 +95,9 @@ void print_help() {
             "   3 <type>        type of duplicate\n"
             "   4 <nullPay>     NULL payload flag\n"
             "   5 <vlan>        does the VLAN tag change between copies?\n"
-            "   6 <dscp>        does the DSCP tag change between copies?\n"
+            "   6 <dscp>        does the DSCP tag (IPv6: traffic class) change between copies?\n"
             "   7 <diffTs>      timestamp difference between copies\n"
-            "   8 <diffTTL>     TTL difference between copies\n"
+            "   8 <diffTTL>     TTL (IPv6: hop limit) difference between copies\n"
             "\n"
             "Extended output ('-x'): <dupTs> <dupTTL> <dupSrcMAC> > <dupDstMAC> <dupSrcIP> > <dupDstIP> | <fromSrcMAC> > <fromDstMAC> <fromSrcIP> > <fromDstIP>\n"
             "   9 <dupTs>       duplicate timestamp\n"
@@ -73,35 +109,158 @@ void print_help() {
             "  18 <fromSrcMAC>  first copy source MAC (if it changed)\n"
             "  20 <fromDstMAC>  first copy destination MAC (if it changed)\n"
             "  21 <fromSrcIP>   first copy source IP (if it changed)\n"
-            "  23 <fromDstIP>   first copy destination IP (if it changed)\n\n",
+            "  23 <fromDstIP>   first copy destination IP (if it changed)\n"
+            "IP addresses are shown for IPv4 and IPv6 packets\n"
+            "With several input files, ' @ <dupFile> <fromFile>' follows: the input file of each copy ('-i' order, from 0)\n\n",
     stderr);
 }
 
 // globals
 static buffer_t *buffer;
+static buffer_t *shards[BUFFER_MAX_WORKERS];
 static workerPool_t *pool;
-static pcap_t *traceFile;
+static chunkPool_t *chunkPool;
+static dumper_t *dumper;        // deduplicated trace writer (NULL: disabled)
+static unsigned int dumperId;   // its marker in the windows
+static trace_t *traceFiles[MERGE_MAX_SOURCES];
+static unsigned int numFiles;
+static merger_t *merger;        // timestamp merge of several files (NULL: a single file)
+static pipeline_t *dissectors;  // dissector threads (NULL: packets are dissected by the reader)
+static unsigned long long searched; // position of the last packet handed to the search (pipeline)
+static double occupancy[5];     // queue occupancy added up over the samples (pipeline)
+static unsigned long long samples;
 static unsigned long long fileSize;
 static int showProgress, debug, threads;
+static unsigned int sharded;    // number of shards (0: disabled)
 static stats_t stats;
+static int64_t stallTime;       // time spent waiting for the workers with a full window (ns)
+static unsigned long long stalls;
+static char outBuf[INFODUPS_OUTBUF];    // stdout buffer (records are written in large blocks)
 
 // final statistics
 static void print_stats() {
+    dups_get_stats(&stats);
     fprintf(stderr, "\n----------- statistics -----------\n");
     fprintf(stderr, "%llu packets (%llu IP, %llu TCP, %llu UDP, %llu errors), ", stats.pkts.numPkts, stats.pkts.numIP, stats.pkts.numTCP, stats.pkts.numUDP, stats.pkts.numErrors);
-    fprintf(stderr, "%.6lf seconds elapsed\n", utils_timeval2float(&stats.pkts.endTime)-utils_timeval2float(&stats.pkts.startTime));
+    fprintf(stderr, "%.6lf seconds elapsed\n", (stats.pkts.endTime-stats.pkts.startTime)/1e9);
+    if (stalls) fprintf(stderr, "%.6lf seconds stalled on a full window (%llu times)\n", stallTime/1e9, stalls);
+    if (samples) {
+        // a queue usually full points to the stage that reads it as the bottleneck
+        fprintf(stderr, "Queue occupancy (average): read > main %.1lf%%, main > dissect %.1lf%%, dissect > main %.1lf%%, ", occupancy[0]*100/samples, occupancy[1]*100/samples, occupancy[2]*100/samples);
+        fprintf(stderr, "main > search %.1lf%%, search > write %.1lf%%\n", occupancy[3]*100/samples, occupancy[4]*100/samples);
+    }
     for (int i=0; i<DUPS_COMPARATORS; i++)
         fprintf(stderr, "%10llu duplicates of type %i (%s)\n", stats.numDup[i], i, DUPS_TYPE[i].description);
     fprintf(stderr, "%10llu duplicates of type -1 (suspicious)\n", stats.numSuspicious);
 }
 
+// live duplicate counters (progress)
+static void print_progress_dups() {
+    stats_t snapshot;
+
+    dups_get_stats(&snapshot);
+    fprintf(stderr, "Duplicates:");
+    for (int i=0; i<DUPS_COMPARATORS; i++)
+        fprintf(stderr, " %llu (type %i)", snapshot.numDup[i], i);
+    fprintf(stderr, ", %llu suspicious\n", snapshot.numSuspicious);
+}
+
+// monotonic clock (ns)
+static int64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+// search for duplicates (the packet is already dissected)
+static void search(node_t *node, unsigned int shard) {
+    searched = ((pkt_t *)node->load)->pos;
+    if (sharded) worker_add_task_to(pool, shard, (void *)node);
+    else if (threads) worker_add_task(pool, (void *)node);
+    else if (dups_search(node, 0, NULL) == 1) ((pkt_t *)node->load)->dupe = 1;
+}
+
+// pipeline: search the packets already dissected, in order
+static void search_dissected() {
+    node_t *node;
+    unsigned int shard;
+
+    while ((node = pipeline_pop(dissectors, &shard)))
+        search(node, shard);
+}
+
+// position up to which every packet has been searched, given the progress of the workers
+static unsigned long long get_searched(unsigned long long done) {
+    if (dissectors && pipeline_get_pending(dissectors) && searched < done) return searched;
+    return done;
+}
+
+// pipeline: sample the occupancy of the queues between stages
+static void sample_occupancy() {
+    double in, out;
+
+    occupancy[0] += merge_get_load(merger);
+    pipeline_get_load(dissectors, &in, &out);
+    occupancy[1] += in;
+    occupancy[2] += out;
+    worker_get_load(pool, &in, &out);
+    occupancy[3] += in;
+    occupancy[4] += out;
+    samples++;
+}
+
+// flow control: the window is full, wait until the workers release enough old packets
+static void stall(buffer_t *window) {
+    static int warned;
+    unsigned long long bound;
+    int64_t start = 0;
+
+    while (1) {
+        if (dissectors) search_dissected();
+        bound = threads ? worker_get_done(pool) : ~0ULL;
+        if (threads) worker_mux(pool, 0);
+        if (dumper) dumper_write(dumper, get_searched(bound));
+        buffer_trim(window);
+        if (!buffer_is_full(window)) break;
+
+        // nothing pending: what is left is needed by the searches done
+        if (get_searched(bound) == ~0ULL) {
+            if (!warned) fputs("Warning: the window does not fit in the memory limit ('-M'), going over it\n", stderr);
+            warned = 1;
+            break;
+        }
+        if (!start) start = now();
+        if (debug) buffer_print(window);
+        worker_flush(pool);
+        if (bound != ~0ULL) worker_wait(pool, bound, INFODUPS_STALL_WAIT);
+        else {
+            // the workers are idle: the packets left are still being dissected
+            pipeline_flush(dissectors);
+            sched_yield();
+        }
+    }
+
+    if (start) {
+        stallTime += now() - start;
+        stalls++;
+    }
+}
+
 void update(u_char *user, const struct pcap_pkthdr *header, const u_char *bytes) {
-    if (!stats.pkts.numPkts) stats.pkts.startTime = header->ts;
+    if (!stats.pkts.numPkts) stats.pkts.startTime = utils_ts2ns(&header->ts);
     stats.pkts.numPkts++;
-    stats.pkts.endTime = header->ts;
+    stats.pkts.endTime = utils_ts2ns(&header->ts);
+
+    // choose the window (with sharding, each worker owns the window of its flows)
+    buffer_t *window = buffer;
+    unsigned int shard = 0;
+    if (sharded) {
+        shard = pkt_flow_key(bytes, header->len, header->caplen) % sharded;
+        window = shards[shard];
+    }
 
     // create packet
-    node_t *node_new = buffer_new(buffer);
+    node_t *node_new = buffer_new(window);
     if (!node_new) {
         stats.pkts.numErrors++;
         return;
@@ -111,45 +270,53 @@ void update(u_char *user, const struct pcap_pkthdr *header, const u_char *bytes)
         stats.pkts.numErrors++;
         return;
     }
-    pkt_dissect((pkt_t *)node_new->load);
-    buffer_append(buffer, node_new);
-    if (stats.pkts.numPkts == 1) buffer_init_markers(node_new);
+    if (merger) ((pkt_t *)node_new->load)->source = merge_get_source(merger);
+    if (!dissectors) pkt_dissect((pkt_t *)node_new->load);
+    buffer_append(window, node_new);
+    if (sharded && buffer_get_count(window) == 1) buffer_init_marker(node_new, shard);
+    else if (!sharded && stats.pkts.numPkts == 1) buffer_init_markers(node_new);
+    if (dumper) dumper_add(dumper, node_new, shard, dumperId);
 
-    // search for duplicates
-    if (threads) worker_add_task(pool, (void *)node_new);
-    else dups_search(node_new, 0, NULL, NULL);
+    // search for duplicates (pipeline: once dissected, while newer packets are read)
+    if (dissectors) {
+        while (pipeline_push(dissectors, node_new, shard)) {
+            search_dissected();
+            sched_yield();
+        }
+        search_dissected();
+        if (!(stats.pkts.numPkts % INFODUPS_LOAD_EVERY)) sample_occupancy();
+    } else search(node_new, shard);
 
     // debug
-    if (debug) buffer_debug(buffer, pkt_print);
+    if (debug) buffer_debug(window, pkt_print);
 
     // mux output
     if (threads) worker_mux(pool, 0);
 
+    // write the packets already searched
+    if (dumper) dumper_write(dumper, get_searched(threads ? worker_get_done(pool) : ~0ULL));
+
     // trim window
-    buffer_trim(buffer);
-    while (buffer_is_full(buffer)) {
-        buffer_print(buffer);
-        worker_mux(pool, 0);
-        sleep(3);
-        buffer_trim(buffer);
-    }
+    buffer_trim(window);
+    if (buffer_is_full(window)) stall(window);
 
     // show progress
-    if (showProgress) utils_print_progress(traceFile, fileSize);
+    if (showProgress && utils_print_progress(merger ? merge_tell(merger) : trace_tell(traceFiles[0]), fileSize)) print_progress_dups();
 
     return;
 }
 
 int main (int argc, char **argv) {
     char errbuf[5000], option;
-    char *pcapFilePath = NULL;
+    char *pcapFilePaths[MERGE_MAX_SOURCES];
     char *value = NULL;
-    int ret, mode=0, fast=0, showExtOut=0, showSuspicious=0;
+    char *keptFilePath = NULL, *removedFilePath = NULL;
+    int ret, linktype=-1, snaplen=0, precision=PCAP_TSTAMP_PRECISION_MICRO, chunks=0, stages=0, mode=0, fast=0, headers=0, storage=PKT_STORE_REF, showExtOut=0, showSuspicious=0, binary=0, waitMode=RING_WAIT_FUTEX;
     unsigned int dupMask=0;
     double memory=2;
-    unsigned long long max_count;
+    unsigned long long max_size;
 
-    while ((option = getopt(argc, argv, "hvxbi:t:n:s012345FT:M:")) != -1) {
+    while ((option = getopt(argc, argv, "hvxbi:t:n:sBo:d:012345FHT:M:w:SP:D:")) != -1) {
         switch (option) {
             case 'h':
                 print_options();
@@ -166,7 +333,11 @@ int main (int argc, char **argv) {
                 debug = 1;
                 break;
             case 'i':
-                pcapFilePath = optarg;
+                if (numFiles == MERGE_MAX_SOURCES) {
+                    fprintf(stderr, "Error: too many input files (at most %i)\n", MERGE_MAX_SOURCES);
+                    return EXIT_FAILURE;
+                }
+                pcapFilePaths[numFiles++] = optarg;
                 break;
             case 't':
                 mode = 0;
@@ -179,54 +350,194 @@ int main (int argc, char **argv) {
             case 's':
                 showSuspicious = 1;
                 break;
+            case 'B':
+                binary = 1;
+                break;
+            case 'o':
+                keptFilePath = optarg;
+                break;
+            case 'd':
+                removedFilePath = optarg;
+                break;
             case 'F':
                 fast = 1;
                 break;
+            case 'H':
+                headers = 1;
+                break;
             case 'T':
                 threads = atoi(optarg);
                 break;
             case 'M':
                 memory = atof(optarg);
                 break;
+            case 'w':
+                if (!strcmp(optarg, "spin")) waitMode = RING_WAIT_SPIN;
+                else if (!strcmp(optarg, "futex")) waitMode = RING_WAIT_FUTEX;
+                else if (!strcmp(optarg, "block")) waitMode = RING_WAIT_BLOCK;
+                else {
+                    fprintf(stderr, "Error: unknown wait mode %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'S':
+                sharded = 1;
+                break;
+            case 'P':
+                chunks = atoi(optarg);
+                if (chunks < 1 || chunks > BUFFER_MAX_WORKERS) {
+                    fprintf(stderr, "Error: the number of chunks must be between 1 and %i\n", BUFFER_MAX_WORKERS);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'D':
+                stages = atoi(optarg);
+                if (stages < 1 || stages > PIPELINE_MAX_DISSECTORS) {
+                    fprintf(stderr, "Error: the number of dissector threads must be between 1 and %i\n", PIPELINE_MAX_DISSECTORS);
+                    return EXIT_FAILURE;
+                }
+                break;
             default:
                 dupMask = dupMask | (0x0001 << ((int)option - 48));
                 break;
         }
     }
-    if (pcapFilePath == NULL) {
+    if (!numFiles || (removedFilePath && !keptFilePath)) {
         print_options();
         return EXIT_FAILURE;
     }
+    if (chunks && (threads || keptFilePath || numFiles > 1)) {
+        fprintf(stderr, "Error: '-P' can't be combined with '-T', '-o' or several input files\n");
+        return EXIT_FAILURE;
+    }
+    if (stages && (!threads || headers)) {
+        fprintf(stderr, "Error: '-D' needs '-T', and can't be combined with '-H'\n");
+        return EXIT_FAILURE;
+    }
+    if (keptFilePath && headers) {
+        fprintf(stderr, "Error: '-o' needs the whole packets, not available in header-only mode\n");
+        return EXIT_FAILURE;
+    }
+
+    max_size = memory*1000000000;
 
-    max_count = memory*1000000000/(PKT_BYTES+100);
+    // records go out in large blocks, unless somebody is watching
+    if (!isatty(fileno(stdout))) setvbuf(stdout, outBuf, _IOFBF, sizeof(outBuf));
+
+    // open (packets are referenced, not copied, if every file is mapped)
+    for (int i=0; i<numFiles; i++) {
+        traceFiles[i] = trace_open(pcapFilePaths[i], errbuf);
+        if (!traceFiles[i]) {
+            fprintf(stderr, "Error: cannot open trace file %s\n", pcapFilePaths[i]);
+            fprintf(stderr, "%s\n", errbuf);
+            return EXIT_FAILURE;
+        }
+        if (!i) linktype = trace_datalink(traceFiles[i]);
+        else if (trace_datalink(traceFiles[i]) != linktype) {
+            fprintf(stderr, "Error: trace file %s has a different link-layer header type\n", pcapFilePaths[i]);
+            return EXIT_FAILURE;
+        }
+        if (trace_snaplen(traceFiles[i]) > snaplen) snaplen = trace_snaplen(traceFiles[i]);
+        if (trace_tstamp_precision(traceFiles[i]) == PCAP_TSTAMP_PRECISION_NANO) precision = PCAP_TSTAMP_PRECISION_NANO;
+        if (!trace_is_mapped(traceFiles[i])) storage = PKT_STORE_COPY;
+    }
+    if (chunks && storage != PKT_STORE_REF) {
+        fprintf(stderr, "Error: '-P' needs a classic PCAP file\n");
+        return EXIT_FAILURE;
+    }
+    if (storage != PKT_STORE_REF && headers) storage = PKT_STORE_HEADERS;
 
     // init
-    buffer = buffer_init(threads, max_count);
-    if (!buffer) return EXIT_FAILURE;
-    pkt_init(fast, &stats.pkts);
-    dups_init(dupMask, fast, mode, value, showExtOut, showSuspicious, &stats);
+    pkt_init(fast, storage, &stats.pkts);
+    dups_init(dupMask, fast, headers, mode, value, showExtOut, showSuspicious, binary);
+    dups_set_sources(numFiles > 1);
+    dups_print_header(stdout);
+    if (chunks) {
+        // every chunk has its own reader and window
+        chunkPool = chunk_init(pcapFilePaths[0], chunks, max_size, errbuf);
+        if (!chunkPool) {
+            fprintf(stderr, "Error: cannot split trace file %s\n", pcapFilePaths[0]);
+            fprintf(stderr, "%s\n", errbuf);
+            return EXIT_FAILURE;
+        }
+    }
     if (threads) {
-        pool = worker_init(threads, debug);
+        // the writer needs a marker of its own
+        if (keptFilePath && threads >= BUFFER_MAX_WORKERS) threads = BUFFER_MAX_WORKERS-1;
+        pool = worker_init(threads, waitMode, debug);
         if (!pool) return EXIT_FAILURE;
+        if (stages && worker_start_writer(pool)) return EXIT_FAILURE;
+    } else sharded = 0;
+    if (sharded) {
+        // one window per worker, sharing the memory limit
+        sharded = worker_get_num(pool);
+        for (int i=0; i<sharded; i++) {
+            shards[i] = buffer_init(sharded, max_size/sharded, sizeof(pktRecord_t));
+            if (!shards[i]) return EXIT_FAILURE;
+            buffer_set_release(shards[i], pkt_release);
+        }
+    } else if (!chunkPool) {
+        buffer = buffer_init(threads, max_size, sizeof(pktRecord_t));
+        if (!buffer) return EXIT_FAILURE;
+        buffer_set_release(buffer, pkt_release);
+    }
+    if (keptFilePath) {
+        dumperId = threads ? worker_get_num(pool) : 1;
+        dumper = dumper_init(keptFilePath, removedFilePath, linktype, snaplen, precision);
+        if (!dumper) return EXIT_FAILURE;
+        // duplicates are written as read, not merged
+        if (removedFilePath) pkt_keep_original(1);
+    }
+
+    if (showProgress)
+        for (int i=0; i<numFiles; i++)
+            fileSize += utils_fsize(pcapFilePaths[i]);
+
+    // one reader per file, merged by timestamp (pipeline: even for a single file)
+    if (numFiles > 1 || stages) {
+        merger = merge_init(traceFiles, numFiles);
+        if (!merger) return EXIT_FAILURE;
+    }
+    if (stages) {
+        dissectors = pipeline_init(stages, waitMode);
+        if (!dissectors) return EXIT_FAILURE;
     }
 
-    if (showProgress) fileSize = utils_fsize(pcapFilePath);
-    
     // loop
-    traceFile = pcap_open_offline(pcapFilePath, errbuf);
-    if (!traceFile) {
-        fprintf(stderr, "Error: cannot open trace file %s\n", pcapFilePath);
-        fprintf(stderr, "%s\n", errbuf);
-        return EXIT_FAILURE;
+    if (chunkPool) {
+        if (showProgress) fprintf(stderr, "*********** SEARCHING %u CHUNKS ***********\n", chunk_get_num(chunkPool));
+        ret = chunk_run(chunkPool, stdout);
+        chunk_get_stats(chunkPool, &stats.pkts);
+    } else if (merger) ret = merge_loop(merger, update, NULL);
+    else ret = trace_loop(traceFiles[0], -1, update, NULL);
+
+    // last packets in the pipeline
+    if (dissectors) {
+        while (pipeline_get_pending(dissectors)) {
+            pipeline_flush(dissectors);
+            search_dissected();
+            sched_yield();
+        }
+        pipeline_get_stats(dissectors, &stats.pkts);
+        pipeline_destroy(dissectors);
     }
-    ret = pcap_loop(traceFile, -1, update, NULL);
 
     if (threads && showProgress) fputs("*********** WAITING FOR THREADS ***********\n", stderr);
 
     // clean
-    pcap_close(traceFile);
     if (threads) worker_destroy(pool);
-    buffer_destroy(buffer);
+    if (dumper) {
+        dumper_write(dumper, ~0ULL);
+        dumper_destroy(dumper);
+    }
+    if (chunkPool) chunk_destroy(chunkPool);
+    else if (sharded)
+        for (int i=0; i<sharded; i++)
+            buffer_destroy(shards[i]);
+    else buffer_destroy(buffer);
+    if (merger) merge_destroy(merger);
+    for (int i=0; i<numFiles; i++)
+        trace_close(traceFiles[i]);
     pkt_destroy();
     dups_destroy();
     
@@ -0,0 +1,351 @@
+/*
+ * merge.c
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#include "merge.h"
+#include "ring.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#ifndef MERGE_BATCH
+#define MERGE_BATCH 32      /**< packets read ahead needed to wake up the merger */
+#endif
+
+#ifndef MERGE_SPIN
+#define MERGE_SPIN 64       /**< yields of a reader with a full queue before it naps */
+#endif
+
+#ifndef MERGE_NAP
+#define MERGE_NAP 100       /**< nap of a reader with a full queue (us) */
+#endif
+
+/**
+ * Packet read ahead
+ */
+typedef struct {
+    struct pcap_pkthdr  header;     /**< its header (nanosecond timestamps) */
+    const u_char        *bytes;     /**< its bytes (a copy if the trace is not mapped) */
+    int64_t             time;       /**< decoded timestamp (ns) */
+    unsigned long long  offset;     /**< offset in the file after it */
+} mergePkt_t;
+
+/**
+ * Input file
+ */
+typedef struct {
+    unsigned int        id;         /**< index of the file */
+    pthread_t           thread;     /**< its reader */
+    trace_t             *trace;     /**< the trace */
+    int                 mapped;     /**< packet bytes are referenced, not copied */
+    ring_t              *queue;     /**< packets read ahead */
+    mergePkt_t          *head;      /**< next packet (NULL: not in the merge heap) */
+    unsigned long long  offset;     /**< offset in the file after the last packet processed */
+    int                 joined;     /**< the reader has been joined */
+    int                 ret;        /**< reader result (0 on success, -1 on error) */
+    int                 *stop;      /**< stop reading (merger) */
+} mergeSource_t;
+
+/**
+ * Private merger structure
+ *
+ * Every input file has a reader thread that reads ahead into a queue, and packets
+ * are taken from them in timestamp order through a min-heap keyed on the timestamp
+ * of their next packet (ties go to the first file).
+ */
+struct merger {
+    mergeSource_t       *sources;   /**< input files */
+    mergeSource_t       **heap;     /**< merge heap of input files */
+    unsigned int        heapSize;   /**< number of input files in the heap */
+    unsigned int        num;        /**< number of input files */
+    unsigned int        source;     /**< input file of the packet being processed */
+    int                 stop;       /**< the readers must stop */
+};
+
+/**
+ * @brief Reader callback: queues a packet
+ *
+ * @param user      the input file
+ * @param header    packet header
+ * @param bytes     packet bytes
+ */
+static void merge_read(u_char *user, const struct pcap_pkthdr *header, const u_char *bytes) {
+    mergeSource_t *src = (mergeSource_t *)user;
+    mergePkt_t pkt;
+
+    if (__atomic_load_n(src->stop, __ATOMIC_RELAXED)) return;
+
+    pkt.header = *header;
+    pkt.time = utils_ts2ns(&header->ts);
+    pkt.offset = trace_tell(src->trace);
+    pkt.bytes = bytes;
+    if (!src->mapped) {
+        u_char *copy = malloc(header->caplen ? header->caplen : 1);
+        if (!copy) {
+            perror("Error: merge_read > malloc");
+            src->ret = -1;
+            __atomic_store_n(src->stop, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        memcpy(copy, bytes, header->caplen);
+        pkt.bytes = copy;
+    }
+
+    // a full queue means the merger is busy (or asleep, waiting for a whole batch): yield, then nap
+    for (unsigned int i=0; ring_push(src->queue, &pkt); i++) {
+        if (__atomic_load_n(src->stop, __ATOMIC_RELAXED)) {
+            if (!src->mapped) free((void *)pkt.bytes);
+            return;
+        }
+        ring_notify(src->queue, 0);
+        if (i < MERGE_SPIN) sched_yield();
+        else usleep(MERGE_NAP);
+    }
+    ring_notify(src->queue, MERGE_BATCH);
+}
+
+/**
+ * @brief Thread function
+ *
+ * @param arg an input file
+ * @return NULL
+ */
+static void *merge_reader(void *arg) {
+    mergeSource_t *src = (mergeSource_t *)arg;
+
+    if (trace_loop(src->trace, -1, merge_read, (u_char *)src)) src->ret = -1;
+    ring_kill(src->queue);
+
+    return NULL;
+}
+
+/**
+ * @brief Initializes a merger and starts reading
+ *
+ * @param traces    open traces (they are read by the merger until merge_destroy())
+ * @param num       number of traces [1-MERGE_MAX_SOURCES]
+ * @return a pointer to a new merger or NULL
+ */
+merger_t *merge_init(trace_t **traces, unsigned int num) {
+    UTILS_CHECK(!traces || !num || num > MERGE_MAX_SOURCES, EINVAL, return NULL);
+
+    merger_t *merger = calloc(1, sizeof(merger_t));
+    if (!merger) {
+        perror("Error: merge_init > calloc");
+        return NULL;
+    }
+    merger->sources = calloc(num, sizeof(mergeSource_t));
+    merger->heap = calloc(num, sizeof(mergeSource_t *));
+    if (!merger->sources || !merger->heap) {
+        perror("Error: merge_init > calloc");
+        free(merger->sources);
+        free(merger->heap);
+        free(merger);
+        return NULL;
+    }
+    merger->num = num;
+
+    for (int i=0; i<num; i++) {
+        mergeSource_t *src = &merger->sources[i];
+        src->id = i;
+        src->trace = traces[i];
+        src->mapped = trace_is_mapped(traces[i]);
+        src->stop = &merger->stop;
+        src->queue = ring_init(MERGE_QUEUE, sizeof(mergePkt_t), RING_WAIT_FUTEX);
+        if (!src->queue) exit(EXIT_FAILURE);
+
+        if (pthread_create(&src->thread, NULL, merge_reader, (void *)src)) {
+            perror("Error: merge_init > pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return merger;
+}
+
+/**
+ * @brief Waits for a reader and frees the packets it left behind
+ *
+ * @param src the input file
+ */
+static void merge_join(mergeSource_t *src) {
+    mergePkt_t *pkt;
+
+    if (src->joined) return;
+    pthread_join(src->thread, NULL);
+    src->joined = 1;
+
+    while ((pkt = (mergePkt_t *) ring_peek(src->queue))) {
+        if (!src->mapped) free((void *)pkt->bytes);
+        ring_drop(src->queue);
+    }
+}
+
+/**
+ * @brief Cleaner
+ *
+ * @param merger the merger
+ */
+void merge_destroy(merger_t *merger) {
+    UTILS_CHECK(!merger, EINVAL, return);
+
+    __atomic_store_n(&merger->stop, 1, __ATOMIC_RELAXED);
+    for (int i=0; i<merger->num; i++) {
+        merge_join(&merger->sources[i]);
+        ring_destroy(merger->sources[i].queue);
+    }
+
+    free(merger->sources);
+    free(merger->heap);
+    free(merger);
+}
+
+// private: the next packet of a goes before the one of b
+static inline int merge_before(mergeSource_t *a, mergeSource_t *b) {
+    if (a->head->time != b->head->time) return a->head->time < b->head->time;
+    return a->id < b->id;
+}
+
+/**
+ * @brief Restores the heap property from a given node downwards
+ *
+ * @param merger    the merger
+ * @param i         heap node
+ */
+static inline void merge_heap_down(merger_t *merger, unsigned int i) {
+    mergeSource_t **heap = merger->heap, *src = heap[i];
+    unsigned int child;
+
+    while ((child = 2*i+1) < merger->heapSize) {
+        if (child+1 < merger->heapSize && merge_before(heap[child+1], heap[child]))
+            child++;
+        if (!merge_before(heap[child], src)) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = src;
+}
+
+/**
+ * @brief Inserts an input file with a next packet into the heap
+ *
+ * @param merger    the merger
+ * @param src       the input file
+ */
+static inline void merge_heap_push(merger_t *merger, mergeSource_t *src) {
+    mergeSource_t **heap = merger->heap;
+    unsigned int i = merger->heapSize++, parent;
+
+    while (i) {
+        parent = (i-1)/2;
+        if (!merge_before(src, heap[parent])) break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = src;
+}
+
+/**
+ * @brief Processes the packets of all input files in timestamp order
+ *
+ * The packets of each file keep their order, so files not sorted by time are
+ * merged as they come.
+ *
+ * @param merger    the merger
+ * @param callback  packet handler (see merge_get_source())
+ * @param user      its first argument
+ * @return 0 at the end of every file, -1 on error
+ */
+int merge_loop(merger_t *merger, pcap_handler callback, u_char *user) {
+    UTILS_CHECK(!merger || !callback, EINVAL, return -1);
+
+    mergeSource_t *src;
+    int ret = 0;
+
+    // first packet of every file
+    for (int i=0; i<merger->num; i++) {
+        src = &merger->sources[i];
+        if (!ring_wait(src->queue)) continue;
+        src->head = (mergePkt_t *) ring_peek(src->queue);
+        merge_heap_push(merger, src);
+    }
+
+    while (merger->heapSize) {
+        src = merger->heap[0];
+        merger->source = src->id;
+        callback(user, &src->head->header, src->head->bytes);
+        src->offset = src->head->offset;
+        if (!src->mapped) free((void *)src->head->bytes);
+        ring_drop(src->queue);
+
+        // next packet of the same file
+        if (ring_wait(src->queue)) src->head = (mergePkt_t *) ring_peek(src->queue);
+        else {
+            src->head = NULL;
+            merger->heap[0] = merger->heap[--merger->heapSize];
+        }
+        if (merger->heapSize) merge_heap_down(merger, 0);
+    }
+
+    for (int i=0; i<merger->num; i++) {
+        merge_join(&merger->sources[i]);
+        if (merger->sources[i].ret) ret = -1;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Gets the input file of the packet being processed
+ *
+ * @param merger the merger
+ * @return the index of the file
+ */
+inline unsigned int merge_get_source(merger_t *merger) {
+    UTILS_CHECK(!merger, EINVAL, return 0);
+
+    return merger->source;
+}
+
+/**
+ * @brief Gets the bytes read so far
+ *
+ * @param merger the merger
+ * @return the offsets of the packets processed, added up over all input files
+ */
+inline unsigned long long merge_tell(merger_t *merger) {
+    UTILS_CHECK(!merger, EINVAL, return 0);
+
+    unsigned long long offset = 0;
+
+    for (int i=0; i<merger->num; i++)
+        offset += merger->sources[i].offset;
+
+    return offset;
+}
+
+/**
+ * @brief Gets the occupancy of the read-ahead queues
+ *
+ * @param merger the merger
+ * @return packets read ahead (fraction of the queues)
+ */
+double merge_get_load(merger_t *merger) {
+    UTILS_CHECK(!merger, EINVAL, return 0);
+
+    unsigned long long count = 0;
+
+    for (int i=0; i<merger->num; i++)
+        count += ring_get_count(merger->sources[i].queue);
+
+    return (double)count / (merger->num * MERGE_QUEUE);
+}
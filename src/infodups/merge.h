@@ -0,0 +1,43 @@
+/*
+ * merge.h
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#ifndef MERGE_H_
+#define MERGE_H_
+
+#include "../common/trace.h"
+
+#ifndef MERGE_MAX_SOURCES
+#define MERGE_MAX_SOURCES 256   /**< maximum number of input files */
+#endif
+
+#ifndef MERGE_QUEUE
+#define MERGE_QUEUE 4096        /**< packets read ahead per input file */
+#endif
+
+typedef struct merger merger_t;
+
+// initializer: one reader thread per trace, already open (the traces are not closed by the merger)
+merger_t *merge_init(trace_t **traces, unsigned int num);
+
+// stop the readers and free all memory
+void merge_destroy(merger_t *merger);
+
+// process the packets of all traces in timestamp order, like trace_loop(): 0 at the end, -1 on error
+int merge_loop(merger_t *merger, pcap_handler callback, u_char *user);
+
+// input file of the packet being processed
+unsigned int merge_get_source(merger_t *merger);
+
+// bytes read so far, added up over all traces
+unsigned long long merge_tell(merger_t *merger);
+
+// occupancy of the read-ahead queues, from 0 to 1
+double merge_get_load(merger_t *merger);
+
+#endif /* MERGE_H_ */
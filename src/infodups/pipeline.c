@@ -0,0 +1,253 @@
+/*
+ * pipeline.c
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#include "pipeline.h"
+#include "ring.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <pthread.h>
+
+#ifndef PIPELINE_BATCH
+#define PIPELINE_BATCH 32   /**< pending packets needed to wake up a sleeping dissector (and dissected in a row) */
+#endif
+
+/**
+ * Packet in flight
+ */
+typedef struct {
+    node_t              *node;      /**< its node */
+    unsigned int        tag;        /**< caller's data (e.g. its window) */
+} stageItem_t;
+
+/**
+ * Dissector thread
+ */
+typedef struct {
+    pthread_t           thread;     /**< the thread */
+    ring_t              *input;     /**< packets to dissect */
+    ring_t              *output;    /**< packets dissected */
+    pktStats_t          stats;      /**< its packet counters */
+    int                 *stop;      /**< stop dissecting (pipeline) */
+} stage_t;
+
+/**
+ * Private pipeline structure
+ *
+ * Packets are handed out to the dissectors in turn, so they are taken back in the same
+ * order by visiting the output queues in turn too.
+ */
+struct pipeline {
+    stage_t             stages[PIPELINE_MAX_DISSECTORS];    /**< dissectors */
+    unsigned int        num;        /**< number of dissectors */
+    unsigned int        in;         /**< next dissector to push to */
+    unsigned int        out;        /**< next dissector to pop from */
+    unsigned long long  pending;    /**< packets pushed and not popped yet */
+    int                 stop;       /**< the dissectors must stop */
+};
+
+/**
+ * @brief Thread function
+ *
+ * @param arg a dissector
+ * @return NULL
+ */
+static void *pipeline_dissector(void *arg) {
+    stage_t *stage = (stage_t *)arg;
+    stageItem_t items[PIPELINE_BATCH];
+    pkt_t *pkts[PIPELINE_BATCH];
+    int n;
+
+    pkt_set_stats(&stage->stats);
+    while (ring_wait(stage->input)) {
+        // every packet waiting (up to a batch), dissected in a row
+        for (n=0; n<PIPELINE_BATCH && !ring_pop(stage->input, &items[n]); n++)
+            pkts[n] = (pkt_t *)items[n].node->load;
+        pkt_dissect_batch(pkts, n);
+
+        // the main thread takes packets back in order: it may be waiting for another dissector
+        for (int i=0; i<n; i++)
+            while (ring_push(stage->output, &items[i])) {
+                if (__atomic_load_n(stage->stop, __ATOMIC_RELAXED)) return NULL;
+                sched_yield();
+            }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Initializes a pipeline and starts its dissectors
+ *
+ * @param num   number of dissector threads [1-PIPELINE_MAX_DISSECTORS]
+ * @param mode  how idle dissectors wait for packets (RING_WAIT_*)
+ * @return a pointer to a new pipeline or NULL
+ */
+pipeline_t *pipeline_init(unsigned int num, int mode) {
+    UTILS_CHECK(!num || num > PIPELINE_MAX_DISSECTORS, EINVAL, return NULL);
+
+    pipeline_t *pipe = calloc(1, sizeof(pipeline_t));
+    if (!pipe) {
+        perror("Error: pipeline_init > calloc");
+        return NULL;
+    }
+    pipe->num = num;
+
+    for (int i=0; i<num; i++) {
+        stage_t *stage = &pipe->stages[i];
+        stage->stop = &pipe->stop;
+        stage->input = ring_init(PIPELINE_QUEUE, sizeof(stageItem_t), mode);
+        if (!stage->input) exit(EXIT_FAILURE);
+        // the main thread polls this queue, it never sleeps on it
+        stage->output = ring_init(PIPELINE_QUEUE, sizeof(stageItem_t), RING_WAIT_SPIN);
+        if (!stage->output) exit(EXIT_FAILURE);
+
+        if (pthread_create(&stage->thread, NULL, pipeline_dissector, (void *)stage)) {
+            perror("Error: pipeline_init > pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return pipe;
+}
+
+/**
+ * @brief Cleaner
+ *
+ * @param pipe the pipeline
+ */
+void pipeline_destroy(pipeline_t *pipe) {
+    UTILS_CHECK(!pipe, EINVAL, return);
+
+    // a dissector may be waiting for room in its output queue
+    __atomic_store_n(&pipe->stop, 1, __ATOMIC_RELAXED);
+    for (int i=0; i<pipe->num; i++)
+        ring_kill(pipe->stages[i].input);
+
+    for (int i=0; i<pipe->num; i++) {
+        pthread_join(pipe->stages[i].thread, NULL);
+        ring_destroy(pipe->stages[i].input);
+        ring_destroy(pipe->stages[i].output);
+    }
+
+    free(pipe);
+}
+
+/**
+ * @brief Hands a packet to the next dissector (in turn)
+ *
+ * The packet must be in its window already: the dissector fills in its headers while
+ * newer packets are read.
+ *
+ * @param pipe  the pipeline
+ * @param node  node of the packet
+ * @param tag   caller's data, given back by pipeline_pop()
+ * @return 0 on success, -1 if the queue of the dissector is full (pop some packets first)
+ */
+inline int pipeline_push(pipeline_t *pipe, node_t *node, unsigned int tag) {
+    UTILS_CHECK(!pipe || !node, EINVAL, return -1);
+
+    stage_t *stage = &pipe->stages[pipe->in];
+    stageItem_t item = {node, tag};
+
+    // packets are taken back in order: the oldest one may be with any dissector
+    if (ring_push(stage->input, &item)) {
+        pipeline_flush(pipe);
+        return -1;
+    }
+    ring_notify(stage->input, PIPELINE_BATCH);
+
+    if (++pipe->in == pipe->num) pipe->in = 0;
+    pipe->pending++;
+
+    return 0;
+}
+
+/**
+ * @brief Takes back the oldest packet pushed, if it has been dissected
+ *
+ * @param pipe  the pipeline
+ * @param tag   output: caller's data (see pipeline_push())
+ * @return its node or NULL
+ */
+inline node_t *pipeline_pop(pipeline_t *pipe, unsigned int *tag) {
+    UTILS_CHECK(!pipe, EINVAL, return NULL);
+
+    stageItem_t item;
+
+    if (!pipe->pending || ring_pop(pipe->stages[pipe->out].output, &item)) return NULL;
+    if (++pipe->out == pipe->num) pipe->out = 0;
+    pipe->pending--;
+
+    if (tag) *tag = item.tag;
+    return item.node;
+}
+
+/**
+ * @brief Wakes up every sleeping dissector with pending packets
+ *
+ * @param pipe the pipeline
+ */
+void pipeline_flush(pipeline_t *pipe) {
+    UTILS_CHECK(!pipe, EINVAL, return);
+
+    for (int i=0; i<pipe->num; i++)
+        ring_notify(pipe->stages[i].input, 0);
+}
+
+/**
+ * @brief Gets the number of packets in flight
+ *
+ * @param pipe the pipeline
+ * @return packets pushed and not popped yet
+ */
+inline unsigned long long pipeline_get_pending(pipeline_t *pipe) {
+    UTILS_CHECK(!pipe, EINVAL, return 0);
+
+    return pipe->pending;
+}
+
+/**
+ * @brief Gets the occupancy of the queues
+ *
+ * @param pipe      the pipeline
+ * @param input     output: packets waiting for a dissector (fraction of the queues)
+ * @param output    output: packets dissected waiting for the main thread (fraction of the queues)
+ */
+void pipeline_get_load(pipeline_t *pipe, double *input, double *output) {
+    UTILS_CHECK(!pipe || !input || !output, EINVAL, return);
+
+    unsigned long long in = 0, out = 0;
+
+    for (int i=0; i<pipe->num; i++) {
+        in += ring_get_count(pipe->stages[i].input);
+        out += ring_get_count(pipe->stages[i].output);
+    }
+    *input = (double)in / (pipe->num * PIPELINE_QUEUE);
+    *output = (double)out / (pipe->num * PIPELINE_QUEUE);
+}
+
+/**
+ * @brief Adds up the packet counters of the dissectors (call it once they have stopped)
+ *
+ * @param pipe  the pipeline
+ * @param stats statistics to add them to
+ */
+void pipeline_get_stats(pipeline_t *pipe, pktStats_t *stats) {
+    UTILS_CHECK(!pipe || !stats, EINVAL, return);
+
+    for (int i=0; i<pipe->num; i++) {
+        pktStats_t *cur = &pipe->stages[i].stats;
+        stats->numErrors += cur->numErrors;
+        stats->numIP += cur->numIP;
+        stats->numTCP += cur->numTCP;
+        stats->numUDP += cur->numUDP;
+    }
+}
@@ -0,0 +1,48 @@
+/*
+ * pipeline.h
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include "buffer.h"
+#include "pkt.h"
+
+#define PIPELINE_MAX_DISSECTORS 64  /**< maximum number of dissector threads */
+
+#ifndef PIPELINE_QUEUE
+#define PIPELINE_QUEUE 1024         /**< packets in flight per dissector, each way */
+#endif
+
+typedef struct pipeline pipeline_t;
+
+// initializer: num dissector threads (mode: how idle ones wait, see RING_WAIT_*)
+pipeline_t *pipeline_init(unsigned int num, int mode);
+
+// stop the dissectors and free all memory (packets in flight are dropped)
+void pipeline_destroy(pipeline_t *pipe);
+
+// hand a packet, already in its window, to the next dissector (0 on success, -1 if its queue is full)
+int pipeline_push(pipeline_t *pipe, node_t *node, unsigned int tag);
+
+// next dissected packet, in the order they were pushed (NULL: not ready yet)
+node_t *pipeline_pop(pipeline_t *pipe, unsigned int *tag);
+
+// wake up idle dissectors with pending packets
+void pipeline_flush(pipeline_t *pipe);
+
+// number of packets pushed and not popped yet
+unsigned long long pipeline_get_pending(pipeline_t *pipe);
+
+// occupancy of the queues, from 0 to 1 (to the dissectors and back)
+void pipeline_get_load(pipeline_t *pipe, double *input, double *output);
+
+// add the dissector counters (IP, TCP, UDP, errors) to some statistics
+void pipeline_get_stats(pipeline_t *pipe, pktStats_t *stats);
+
+#endif /* PIPELINE_H_ */
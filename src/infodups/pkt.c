@@ -8,6 +8,7 @@
  */
 
 #include "pkt.h"
+#include "../common/parse.h"
 #include "../common/tcp.h"
 #include "../common/udp.h"
 #include "../common/utils.h"
@@ -18,16 +19,80 @@
 #define obstack_chunk_alloc malloc
 #define obstack_chunk_free free
 
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+#define PKT_SLAB_CLASSES 52 /**< number of size classes (enough for any int size) */
+#define PKT_SLAB_SIZE(c) ((2 | ((c) & 1)) << ((c)/2 + 5))   /**< block size of a class */
+#define PKT_OVERHEAD (sizeof(node_t) + sizeof(pktRecord_t))
+
+#ifndef PKT_PREFETCH
+#define PKT_PREFETCH 4      /**< packets ahead whose headers are prefetched in a batch */
+#endif
+
 // private
 static struct obstack pkt_obstack;  /**< obstack that stores packets */
-static pktStats_t *pkt_stats;       /**< pointer to packet statistics */
+static __thread pktStats_t *pkt_stats;  /**< pointer to packet statistics (per thread) */
+static int pkt_fast;                /**< fast mode flag */
+static int pkt_storage;             /**< storage mode (PKT_STORE_*) */
+static int pkt_original;            /**< keep the bytes overwritten by pkt_copy() */
+
+static void *pkt_slab[PKT_SLAB_CLASSES];    /**< free blocks of each size class */
+static pthread_mutex_t pkt_slab_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 int (*pkt_dissect)(pkt_t *pkt) = NULL;
 
+/**
+ * @brief Gets the size class of a block
+ *
+ * Classes grow by half and whole powers of two (64, 96, 128, 192...), so at most
+ * a third of a block is wasted.
+ *
+ * @param size  bytes needed
+ * @return the smallest class that fits
+ */
+static inline int pkt_slab_class(int size) {
+    if (size <= PKT_SLAB_MIN) return 0;
+
+    unsigned int n = size - 1;
+    int b = 31 - __builtin_clz(n);
+    return 2*(b - 6) + 1 + ((n >> (b - 1)) & 1);
+}
+
+/**
+ * @brief Takes a block from the slab (or allocates a new one)
+ *
+ * @param c size class
+ * @return a pointer to the block or NULL
+ */
+static inline void *pkt_slab_alloc(int c) {
+    pthread_mutex_lock(&pkt_slab_mutex);
+    void *block = pkt_slab[c];
+    if (block) pkt_slab[c] = *(void **)block;
+    else block = obstack_alloc(&pkt_obstack, PKT_SLAB_SIZE(c));
+    pthread_mutex_unlock(&pkt_slab_mutex);
+
+    if (!block) perror("Error: pkt_slab_alloc > obstack_alloc");
+    return block;
+}
+
+/**
+ * @brief Gives a block back to the slab
+ *
+ * @param block the block
+ * @param c     size class
+ */
+static inline void pkt_slab_free(void *block, int c) {
+    pthread_mutex_lock(&pkt_slab_mutex);
+    *(void **)block = pkt_slab[c];
+    pkt_slab[c] = block;
+    pthread_mutex_unlock(&pkt_slab_mutex);
+}
+
 /**
  * @brief Ethernet frame constructor
  *
  * This function fills a given frame or allocates a new one if NULL pointer is passed.
+ * A given frame must have room for caplen bytes, or already point to the new data.
  *
  * @param frame     frame to fill or NULL
  * @param bytes     pointer to the new data (the data will be copied)
@@ -44,8 +109,8 @@ inline ethFrame_t *pkt_new_ethFrame(ethFrame_t *frame, void *bytes, int size, in
     // init
     if (frame) {
         if (caplen > PKT_BYTES) caplen = PKT_BYTES;
-        if (flag) frame->bytes = obstack_alloc(&pkt_obstack, PKT_BYTES);
-        memcpy((void *)frame->bytes, bytes, caplen);
+        if (flag) frame->bytes = obstack_alloc(&pkt_obstack, caplen);
+        if (frame->bytes != bytes) memcpy((void *)frame->bytes, bytes, caplen);
         frame->size = size;
         frame->caplen = caplen;
         frame->frameType = ETH_FRAMETYPE_NOTCHECKED;
@@ -104,10 +169,25 @@ inline void *pkt_new_segment(void *sgmt, void *bytes, int size, int caplen) {
     return sgmt;
 }
 
+/**
+ * @brief Gives the original frame bytes of a packet back to the slab
+ * @see pkt_copy()
+ *
+ * @param pkt the packet
+ */
+static inline void pkt_release_original(pkt_t *pkt) {
+    if (pkt->origSlab >= 0) pkt_slab_free((void *)pkt->orig, pkt->origSlab);
+    pkt->orig = NULL;
+}
+
 /**
  * @brief Packet filler
  *
- * This function fills a given node or allocates a new pkt if the node is empty.
+ * This function fills the packet record of a given node (a zeroed record is laid out the first time),
+ * or allocates a new record if the node is empty.
+ * The frame bytes are taken from the slab according to caplen, and node.size is set.
+ * Otherwise, the data is not copied: it must be kept until pkt_dissect() with PKT_STORE_HEADERS,
+ * or while the packet is in the window with PKT_STORE_REF.
  *
  * @param node      the node
  * @param pos       packet position
@@ -122,101 +202,366 @@ inline pkt_t *pkt_fill(node_t *node, unsigned long long pos, void *bytes, int si
 
     pkt_t *pkt = (pkt_t *)node->load;
     if (!pkt) {
-        pkt = obstack_alloc(&pkt_obstack, sizeof(pkt_t));
+        pkt = obstack_alloc(&pkt_obstack, sizeof(pktRecord_t));
         if (!pkt) {
             perror("Error: pkt_fill > obstack_alloc");
             return NULL;
         }
         pkt->frame = NULL;
-        pkt->dis.ipPkt = NULL;
-        pkt->dis.sgmt = NULL;
+    }
+    if (!pkt->frame) {
+        pktRecord_t *rec = (pktRecord_t *)pkt;
+        pkt->frame = &rec->frame;
+        pkt->frame->bytes = NULL;
+        pkt->slab = -1;
+        pkt->orig = NULL;
+        pkt->dis.ipPkt = &rec->ipPkt;
+        pkt->dis.sgmt = &rec->sgmt;
     }
     pkt->pos = pos;
     pkt->time = 0;
+    pkt->dupe = 0;
+    pkt->source = 0;
     pkt->container = node;
+    if (pkt->orig) pkt_release_original(pkt);
+
+    // frame bytes
+    if (caplen > PKT_BYTES) caplen = PKT_BYTES;
+    if (pkt->slab >= 0 && (pkt_storage != PKT_STORE_COPY || PKT_SLAB_SIZE(pkt->slab) < caplen)) pkt_release(pkt);
+    if (pkt_storage != PKT_STORE_COPY) {
+        pkt->frame->bytes = bytes;
+        node->size = PKT_OVERHEAD + (pkt_storage == PKT_STORE_REF ? caplen : 0);
+        pkt->frame = pkt_new_ethFrame(pkt->frame, bytes, size, caplen, timestamp);
+        return pkt;
+    }
+    if (pkt->slab < 0) {
+        pkt->slab = pkt_slab_class(caplen);
+        pkt->frame->bytes = pkt_slab_alloc(pkt->slab);
+        if (!pkt->frame->bytes) {
+            pkt->slab = -1;
+            return NULL;
+        }
+    }
+    node->size = PKT_OVERHEAD + PKT_SLAB_SIZE(pkt->slab);
     pkt->frame = pkt_new_ethFrame(pkt->frame, bytes, size, caplen, timestamp);
 
     return pkt;
 }
 
+/**
+ * @brief Computes the hash of a payload
+ *
+ * @param data  the payload (NULL is hashed as an empty payload)
+ * @param size  size of the payload
+ * @return the hash
+ */
+inline unsigned long long pkt_digest(const void *data, int size) {
+    if (!data || size < 0) size = 0;
+    return utils_hash64(data, size, 0);
+}
+
+/**
+ * @brief Computes the IPv6 analogue of the IP ID
+ *
+ * IPv6 has no identification field outside the Fragment header, so the flow label is
+ * mixed with the fields that routers, NATs and proxies are expected to keep: the fragment
+ * identification, and the TCP window or the UDP length of first fragments (ports and
+ * checksums are left out, NATs rewrite them).
+ *
+ * @param bytes frame bytes
+ * @param hdr   its parsed headers (IPv6)
+ * @return the identifier
+ */
+static inline unsigned int pkt_flow_id(const char *bytes, const parsed_hdr_t *hdr) {
+    unsigned int id = hdr->flowLabel;
+
+    if (hdr->frag >= 0)
+        id = id*0x9E3779B1 + ((const IPv6fragment_t *)(bytes + hdr->frag))->identification;
+    if (!hdr->fragOffset && hdr->l4 >= 0) {
+        if (hdr->protocol == IP_PROTO_TCP && hdr->l4Caplen >= 16)
+            id = id*0x9E3779B1 + ((const TCPheader_t *)(bytes + hdr->l4))->window;
+        else if (hdr->protocol == IP_PROTO_UDP && hdr->l4Caplen >= 6)
+            id = id*0x9E3779B1 + ((const UDPheader_t *)(bytes + hdr->l4))->length;
+    }
+
+    return id;
+}
+
+/**
+ * @brief Computes a key shared by every copy of a duplicate from a raw frame
+ *
+ * IPv4 packets are keyed on their IP ID and protocol, which every type of duplicate
+ * keeps (IPv6 packets, on pkt_flow_id() and their protocol). Other packets can only be switching duplicates with the same captured size,
+ * so they are keyed on their ethertype and size. The frame is not dissected: this is
+ * meant for choosing a worker before the packet is stored.
+ *
+ * @param bytes     frame bytes
+ * @param size      real size of the frame
+ * @param caplen    captured size
+ * @return the key
+ */
+inline unsigned long long pkt_flow_key(const void *bytes, int size, int caplen) {
+    parsed_hdr_t hdr;
+    unsigned int fields[2];
+
+    nan_parse_eth((const char *)bytes, caplen, &hdr);
+    fields[0] = hdr.ethertype;
+    const IPheader_t *ip = (const IPheader_t *)((const char *)bytes + hdr.l3);
+    if (fields[0] == ETH_PROTO_IPv4 && hdr.l3Caplen >= 10)
+        fields[1] = ip->identification | ip->protocol << 16;
+    else if (fields[0] == ETH_PROTO_IPv6 && hdr.l3Caplen >= IP6_HEADER_LENGTH) {
+        nan_parse_ipv6((const char *)bytes, &hdr);
+        fields[1] = pkt_flow_id((const char *)bytes, &hdr) ^ (unsigned int)hdr.protocol << 24;
+    } else fields[1] = hdr.l3Caplen;
+
+    return utils_hash64(fields, sizeof(fields), 0);
+}
+
 /**
  * @brief Dissects Ethernet level
  *
+ * Every header is walked once by nan_parse(), and the dissector fields are taken
+ * from its offsets (same results as the eth_get_*() getters).
+ *
  * @param pkt the packet
+ * @param hdr output: parsed headers
  * @return 0 on success, -1 on error
  */
-static inline int pkt_dissect_eth(pkt_t *pkt) {
+static inline int pkt_dissect_eth(pkt_t *pkt, parsed_hdr_t *hdr) {
     UTILS_CHECK(!pkt || !pkt->frame, EINVAL, return -1);
 
-    pkt->time = utils_timeval2float(&pkt->frame->timestamp);
-    pkt->dis.src = eth_get_src(pkt->frame);
-    pkt->dis.dst = eth_get_dst(pkt->frame);
-    pkt->dis.ethertype = eth_get_ethertype(pkt->frame);
-    pkt->dis.data = (void *)eth_get_data(pkt->frame, &pkt->dis.bufSize);
+    ethFrame_t *frame = pkt->frame;
+    const char *bytes = frame->bytes;
+
+    pkt->time = utils_ts2ns(&frame->timestamp);
+    if (nan_parse(bytes, frame->caplen, hdr)) {
+        // ETH_FRAMETYPE_ERROR: no fields (the data size is left as it was)
+        pkt->dis.src = pkt->dis.dst = NULL;
+        pkt->dis.ethertype = 0;
+        pkt->dis.data = NULL;
+        pkt->dis.ip4 = NULL;
+        pkt->dis.ip6 = NULL;
+        return 0;
+    }
+
+    frame->frameType = hdr->frameType;
+    pkt->dis.src = (hdr->src < 0) ? NULL : bytes + hdr->src;
+    pkt->dis.dst = bytes + hdr->dst;
+    pkt->dis.ethertype = hdr->ethertype;
+    pkt->dis.data = (void *)(bytes + hdr->l3);
+    pkt->dis.bufSize = hdr->l3Caplen;
+    // truncated IPv4 headers stay IP packets, but their fields can't be read
+    pkt->dis.ip4 = (hdr->ethertype == ETH_PROTO_IPv4 && hdr->l3Caplen >= 20) ?
+                   (const IPheader_t *)(bytes + hdr->l3) : NULL;
+    // the fixed IPv6 header is needed to compare anything
+    pkt->dis.ip6 = (hdr->ethertype == ETH_PROTO_IPv6 && hdr->l3Caplen >= IP6_HEADER_LENGTH) ?
+                   (const IPv6header_t *)(bytes + hdr->l3) : NULL;
 
     return 0;
 }
 
+/**
+ * @brief Dissects IP level (same results as the ip_get_*() and ip6_get_*() getters)
+ *
+ * @param pkt       the packet (Ethernet level already dissected)
+ * @param hdr       its parsed headers
+ * @param bufSize   output: size of captured IP data
+ * @param pktSize   output: real size of IP data
+ * @return a pointer to IP data or NULL
+ */
+static inline const char *pkt_dissect_ip(pkt_t *pkt, const parsed_hdr_t *hdr, int *bufSize, int *pktSize) {
+    pkt->dis.ipPkt = pkt_new_ipPkt(pkt->dis.ipPkt, pkt->dis.data, pkt->dis.bufSize);
+    pkt->dis.protocol = hdr->protocol;
+    pkt->dis.offset = hdr->fragOffset;
+    if (pkt->dis.ip6) pkt->dis.flowId = pkt_flow_id(pkt->frame->bytes, hdr);
+    *bufSize = hdr->l4Caplen;
+    *pktSize = hdr->l4Size;
+
+    return (hdr->l4 < 0) ? NULL : pkt->frame->bytes + hdr->l4;
+}
+
+/**
+ * @brief Dissects TCP or UDP level (same results as the tcp_get_*() and udp_get_*() getters)
+ *
+ * A datagram too short to hold its header has no data (udp_get_data() would leave
+ * the sizes as they were).
+ *
+ * @param pkt the packet (IP level already dissected)
+ * @param hdr its parsed headers
+ */
+static inline void pkt_dissect_l4(pkt_t *pkt, const parsed_hdr_t *hdr) {
+    pkt->dis.sgmt = pkt_new_segment(pkt->dis.sgmt, (void *)pkt->dis.ipData, pkt->dis.ipPktSize, pkt->dis.ipBufSize);
+    pkt->dis.srcPort = hdr->srcPort;
+    pkt->dis.dstPort = hdr->dstPort;
+    pkt->dis.sgmtData = (hdr->payload < 0) ? NULL : pkt->frame->bytes + hdr->payload;
+    pkt->dis.sgmtBufSize = hdr->payloadCaplen;
+    pkt->dis.sgmtPktSize = hdr->payloadSize;
+}
+
 // Normal mode
 static inline int _pkt_dissect(pkt_t *pkt) {
-    if (pkt_dissect_eth(pkt)) {
+    parsed_hdr_t hdr;
+
+    if (pkt_dissect_eth(pkt, &hdr)) {
         if (pkt_stats) pkt_stats->numErrors++;
         return -1;
     }
 
-    if (pkt->dis.ethertype == ETH_PROTO_IPv4) {
+    if (pkt->dis.ethertype == ETH_PROTO_IPv4 || pkt->dis.ip6) {
         if (pkt_stats) pkt_stats->numIP++;
 
-        pkt->dis.ipPkt = pkt_new_ipPkt(pkt->dis.ipPkt, pkt->dis.data, pkt->dis.bufSize);
-        pkt->dis.ipData = ip_get_data(pkt->dis.ipPkt, &pkt->dis.ipBufSize, &pkt->dis.ipPktSize);
+        pkt->dis.ipData = pkt_dissect_ip(pkt, &hdr, &pkt->dis.ipBufSize, &pkt->dis.ipPktSize);
         pkt->dis.data = (void *)pkt->dis.ipData;
         pkt->dis.bufSize = pkt->dis.ipBufSize;
-        pkt->dis.protocol = (u_int)ip_get_proto(pkt->dis.ipPkt);
-        pkt->dis.offset = ip_get_offset(pkt->dis.ipPkt);
-
-        switch (pkt->dis.protocol) {
-            case IP_PROTO_TCP: {
-                if (pkt_stats) pkt_stats->numTCP++;
-                pkt->dis.sgmt = pkt_new_segment(pkt->dis.sgmt, (void*)pkt->dis.ipData, pkt->dis.ipPktSize, pkt->dis.ipBufSize);
-                pkt->dis.srcPort = tcp_get_src((TCPSegment_t *)pkt->dis.sgmt);
-                pkt->dis.dstPort = tcp_get_dst((TCPSegment_t *)pkt->dis.sgmt);
-                pkt->dis.sgmtData = tcp_get_data((TCPSegment_t *)pkt->dis.sgmt, &pkt->dis.sgmtBufSize, &pkt->dis.sgmtPktSize);
-                pkt->dis.data = (void *)pkt->dis.sgmtData;
-                pkt->dis.bufSize = pkt->dis.sgmtBufSize;
-                break;
-            }
-            case IP_PROTO_UDP: {
-                if (pkt_stats) pkt_stats->numUDP++;
-                pkt->dis.sgmt = pkt_new_segment(pkt->dis.sgmt, (void*)pkt->dis.ipData, pkt->dis.ipPktSize, pkt->dis.ipBufSize);
-                pkt->dis.srcPort = udp_get_src((UDPDatagram_t *)pkt->dis.sgmt);
-                pkt->dis.dstPort = udp_get_dst((UDPDatagram_t *)pkt->dis.sgmt);
-                pkt->dis.sgmtData = udp_get_data((UDPDatagram_t *)pkt->dis.sgmt, &pkt->dis.sgmtBufSize, &pkt->dis.sgmtPktSize);
-                pkt->dis.data = (void *)pkt->dis.sgmtData;
-                pkt->dis.bufSize = pkt->dis.sgmtBufSize;
-                break;
+
+        // later IPv6 fragments don't carry the TCP or UDP header
+        if ((pkt->dis.protocol == IP_PROTO_TCP || pkt->dis.protocol == IP_PROTO_UDP) && !(pkt->dis.ip6 && pkt->dis.offset)) {
+            if (pkt_stats) {
+                if (pkt->dis.protocol == IP_PROTO_TCP) pkt_stats->numTCP++;
+                else pkt_stats->numUDP++;
             }
+            pkt_dissect_l4(pkt, &hdr);
+            pkt->dis.data = (void *)pkt->dis.sgmtData;
+            pkt->dis.bufSize = pkt->dis.sgmtBufSize;
         }
     }
+    pkt->dis.digest = pkt_digest(pkt->dis.data, pkt->dis.bufSize);
 
     return 0;
 }
 
 // Fast mode
 static inline int _pkt_dissect_fast(pkt_t *pkt) {
-    if (pkt_dissect_eth(pkt)) return -1;
-    if (pkt->dis.ethertype != ETH_PROTO_IPv4) return -1;
+    parsed_hdr_t hdr;
+
+    if (pkt_dissect_eth(pkt, &hdr)) return -1;
+    if (pkt->dis.ethertype != ETH_PROTO_IPv4 && !pkt->dis.ip6) return -1;
 
     if (pkt_stats) pkt_stats->numIP++;
 
-    pkt->dis.ipPkt = pkt_new_ipPkt(pkt->dis.ipPkt, pkt->dis.data, pkt->dis.bufSize);
-    pkt->dis.data = (void *)ip_get_data(pkt->dis.ipPkt, &pkt->dis.bufSize, &pkt->dis.pktSize);
-    pkt->dis.protocol = (u_int)ip_get_proto(pkt->dis.ipPkt);
-    pkt->dis.offset = ip_get_offset(pkt->dis.ipPkt);
-    pkt->time = utils_timeval2float(&pkt->frame->timestamp);
+    pkt->dis.data = (void *)pkt_dissect_ip(pkt, &hdr, &pkt->dis.bufSize, &pkt->dis.pktSize);
+    pkt->dis.digest = pkt_digest(pkt->dis.data, MIN(pkt->dis.bufSize, PKT_FAST_BYTES));
 
     return 0;
 }
 
+#define PKT_REBASE(p, old, size, bytes) \
+    if ((const char *)(p) >= (old) && (const char *)(p) <= (old) + (size)) \
+        (p) = (void *)((bytes) + ((const char *)(p) - (old)))
+
+/**
+ * @brief Moves the dissector pointers to new frame bytes
+ *
+ * @param pkt   the packet (its frame already points to the new bytes)
+ * @param old   previous frame bytes
+ * @param size  size of the previous block
+ */
+static inline void pkt_rebase(pkt_t *pkt, const char *old, int size) {
+    const char *bytes = pkt->frame->bytes;
+
+    PKT_REBASE(pkt->dis.src, old, size, bytes);
+    PKT_REBASE(pkt->dis.dst, old, size, bytes);
+    PKT_REBASE(pkt->dis.data, old, size, bytes);
+    PKT_REBASE(pkt->dis.ipData, old, size, bytes);
+    PKT_REBASE(pkt->dis.sgmtData, old, size, bytes);
+    PKT_REBASE(pkt->dis.ip4, old, size, bytes);
+    PKT_REBASE(pkt->dis.ip6, old, size, bytes);
+    if (pkt->dis.ipPkt) PKT_REBASE(pkt->dis.ipPkt->bytes, old, size, bytes);
+    if (pkt->dis.sgmt) PKT_REBASE(((TCPSegment_t *)pkt->dis.sgmt)->bytes, old, size, bytes);
+}
+
+/**
+ * @brief Keeps only the headers of a dissected packet
+ *
+ * The headers (everything before the payload) are copied from the caller's data to
+ * the slab, and the payload is only represented by its size and digest.
+ *
+ * @param pkt the packet
+ * @return 0 on success, -1 on error
+ */
+static inline int pkt_keep_headers(pkt_t *pkt) {
+    const char *old = pkt->frame->bytes;
+    int caplen = pkt->frame->caplen, size = caplen;
+
+    if (pkt->dis.data >= (void *)old && pkt->dis.data <= (void *)(old + caplen))
+        size = (const char *)pkt->dis.data - old;
+
+    pkt->slab = pkt_slab_class(size);
+    char *bytes = pkt_slab_alloc(pkt->slab);
+    if (!bytes) {
+        pkt->slab = -1;
+        return -1;
+    }
+    memcpy(bytes, old, size);
+    pkt->frame->bytes = bytes;
+    pkt->frame->caplen = size;
+    pkt_rebase(pkt, old, caplen);
+    pkt->container->size += PKT_SLAB_SIZE(pkt->slab);
+
+    return 0;
+}
+
+// Header-only mode
+static inline int _pkt_dissect_headers(pkt_t *pkt) {
+    int ret = pkt_fast ? _pkt_dissect_fast(pkt) : _pkt_dissect(pkt);
+
+    if (pkt_keep_headers(pkt)) return -1;
+    return ret;
+}
+
+/**
+ * @brief Dissects a batch of packets with a given dissector
+ *
+ * With prefetch, while a packet is decoded, the first bytes of the one PKT_PREFETCH
+ * positions ahead are prefetched, and the record of the one twice as far (to know
+ * where its bytes are).
+ *
+ * @param pkts      the packets
+ * @param n         number of packets
+ * @param dissect   the dissector (constant: it is inlined)
+ * @param prefetch  prefetch flag (constant)
+ * @return the number of packets dissected without errors
+ */
+static inline __attribute__((always_inline)) int pkt_dissect_each(pkt_t **pkts, int n, int (*dissect)(pkt_t *pkt), int prefetch) {
+    int ok = 0;
+
+    for (int i=0; i<n; i++) {
+        if (prefetch && i + 2*PKT_PREFETCH < n) __builtin_prefetch(pkts[i + 2*PKT_PREFETCH], 1);
+        if (prefetch && i + PKT_PREFETCH < n) {
+            const char *bytes = pkts[i + PKT_PREFETCH]->frame->bytes;
+            __builtin_prefetch(bytes, 0);
+            __builtin_prefetch(bytes + 64, 0);
+        }
+        if (!dissect(pkts[i])) ok++;
+    }
+
+    return ok;
+}
+
+/**
+ * @brief Dissects a batch of packets (same as pkt_dissect() on each one)
+ *
+ * The dissector of the mode is chosen once for the whole batch. Packets copied to the
+ * slab are scattered in memory, so the headers of the next ones are fetched while the
+ * current one is decoded. Referenced packets are laid out as in the file, where the
+ * hardware prefetcher is faster on its own (see dissectbench).
+ *
+ * @param pkts  the packets
+ * @param n     number of packets
+ * @return the number of packets dissected without errors (-1 on error)
+ */
+int pkt_dissect_batch(pkt_t **pkts, int n) {
+    UTILS_CHECK(!pkts || n < 0, EINVAL, return -1);
+
+    if (pkt_storage == PKT_STORE_COPY) {
+        if (pkt_dissect == _pkt_dissect) return pkt_dissect_each(pkts, n, _pkt_dissect, 1);
+        return pkt_dissect_each(pkts, n, _pkt_dissect_fast, 1);
+    }
+    if (pkt_dissect == _pkt_dissect) return pkt_dissect_each(pkts, n, _pkt_dissect, 0);
+    if (pkt_dissect == _pkt_dissect_fast) return pkt_dissect_each(pkts, n, _pkt_dissect_fast, 0);
+    return pkt_dissect_each(pkts, n, _pkt_dissect_headers, 0);
+}
+
 /**
  * @brief Copies the contents of a packet to another
  *
@@ -228,7 +573,33 @@ static inline int _pkt_dissect_fast(pkt_t *pkt) {
 inline int pkt_copy(pkt_t *src, pkt_t *dst, int copyTs) {
     UTILS_CHECK(!src || !dst, EINVAL, return -1);
 
+    // keep the original bytes: referenced ones stay valid, allocated ones are left as they are
+    if (pkt_original && !dst->orig) {
+        dst->orig = dst->frame->bytes;
+        dst->origSlab = dst->slab;
+        dst->origCaplen = dst->frame->caplen;
+        dst->origSize = dst->frame->size;
+    }
+
+    // referenced bytes are never written: point to the source ones instead
+    if (dst->slab < 0) {
+        const char *old = dst->frame->bytes;
+        dst->frame->bytes = src->frame->bytes;
+        pkt_rebase(dst, old, dst->frame->caplen);
+    // move to a larger block if needed (or to a new one if the original is kept)
+    } else if (PKT_SLAB_SIZE(dst->slab) < src->frame->caplen || dst->orig == dst->frame->bytes) {
+        int c = pkt_slab_class(src->frame->caplen);
+        const char *old = dst->frame->bytes;
+        const char *bytes = pkt_slab_alloc(c);
+        if (!bytes) return -1;
+        dst->frame->bytes = bytes;
+        pkt_rebase(dst, old, PKT_SLAB_SIZE(dst->slab));
+        if (dst->orig != old) pkt_slab_free((void *)old, dst->slab);
+        dst->slab = c;
+    }
+
     dst->pos = src->pos;
+    dst->source = src->source;
     if (copyTs) {
         dst->time = src->time;
         dst->frame->timestamp = src->frame->timestamp;
@@ -236,32 +607,80 @@ inline int pkt_copy(pkt_t *src, pkt_t *dst, int copyTs) {
     dst->frame->caplen = src->frame->caplen;
     dst->frame->frameType = src->frame->frameType;
     dst->frame->size = src->frame->size;
-    memcpy((void *)dst->frame->bytes, (const void *)src->frame->bytes, src->frame->caplen);
+    if (dst->frame->bytes != src->frame->bytes)
+        memcpy((void *)dst->frame->bytes, (const void *)src->frame->bytes, src->frame->caplen);
+    if (!pkt_fast) dst->dis.digest = pkt_digest(dst->dis.data, dst->dis.bufSize);
+    else dst->dis.digest = pkt_digest(dst->dis.data, MIN(dst->dis.bufSize, PKT_FAST_BYTES));
 
     return 0;
 }
 
+/**
+ * @brief Keeps the frame bytes overwritten by pkt_copy()
+ *
+ * When a fragment is merged with its first copy, its original bytes stay in pkt.orig
+ * until the packet is released (referenced ones are not copied).
+ *
+ * @param keep  flag
+ */
+void pkt_keep_original(int keep) {
+    pkt_original = keep;
+}
+
+/**
+ * @brief Gives the frame bytes of a packet back to the slab
+ * @see buffer_set_release()
+ *
+ * @param load pointer to the packet
+ */
+inline void pkt_release(void *load) {
+    UTILS_CHECK(!load, EINVAL, return);
+
+    pkt_t *pkt = (pkt_t *)load;
+    if (pkt->orig) pkt_release_original(pkt);
+    if (pkt->slab < 0) return;
+
+    pkt_slab_free((void *)pkt->frame->bytes, pkt->slab);
+    pkt->frame->bytes = NULL;
+    pkt->slab = -1;
+}
+
 /**
  * @brief Initializes the library
  *
- * @param fast  fast mode flag
- * @param stats pointer to packet statistics
+ * @param fast      fast mode flag
+ * @param storage   how frame bytes are stored (PKT_STORE_*)
+ * @param stats     pointer to packet statistics
  */
-void pkt_init(int fast, pktStats_t *stats) {
+void pkt_init(int fast, int storage, pktStats_t *stats) {
     obstack_init(&pkt_obstack);
     obstack_chunk_size(&pkt_obstack) = 1048576;
 
-    if (!fast) pkt_dissect = _pkt_dissect;
+    pkt_fast = fast;
+    pkt_storage = storage;
+    if (storage == PKT_STORE_HEADERS) pkt_dissect = _pkt_dissect_headers;
+    else if (!fast) pkt_dissect = _pkt_dissect;
     else pkt_dissect = _pkt_dissect_fast;
 
     pkt_stats = stats;
 }
 
+/**
+ * @brief Sets the packet statistics updated by the calling thread
+ * @see pkt_init()
+ *
+ * @param stats     pointer to packet statistics or NULL
+ */
+void pkt_set_stats(pktStats_t *stats) {
+    pkt_stats = stats;
+}
+
 /**
  * @brief Cleaner
  */
 void pkt_destroy() {
     obstack_free(&pkt_obstack, NULL);
+    memset(pkt_slab, 0, sizeof(pkt_slab));
 }
 
 /**
@@ -273,5 +692,7 @@ inline void pkt_print(void *load) {
     UTILS_CHECK(!load, EINVAL, return);
 
     pkt_t *pkt = (pkt_t *)load;
-    fprintf(stderr, "%llu,%.9Lf", pkt->pos, pkt->time);
+    char time[UTILS_NS_TXTLEN];
+    utils_ns2txt(pkt->time, time);
+    fprintf(stderr, "%llu,%s", pkt->pos, time);
 }
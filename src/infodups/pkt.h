@@ -12,22 +12,38 @@
 
 #include "../common/eth.h"
 #include "../common/ip.h"
+#include "../common/ip6.h"
+#include "../common/tcp.h"
 #include "buffer.h"
+#include <stdint.h>
 
 #ifndef PKT_BYTES
-#define PKT_BYTES 5000  /**< maximum packet size allowed */
+#define PKT_BYTES 262144    /**< maximum packet size allowed (libpcap's maximum snaplen) */
+#endif
+
+#ifndef PKT_SLAB_MIN
+#define PKT_SLAB_MIN 64     /**< smallest block for packet bytes */
+#endif
+
+// how frame bytes are stored
+#define PKT_STORE_COPY      0   /**< copied to the slab */
+#define PKT_STORE_HEADERS   1   /**< only headers are copied (the payload is kept as size and digest) */
+#define PKT_STORE_REF       2   /**< referenced: the caller keeps them valid (e.g. a mapped file) */
+
+#ifndef PKT_FAST_BYTES
+#define PKT_FAST_BYTES 20   /**< payload bytes compared in fast mode */
 #endif
 
 /**
  * Packet statistics
  */
 typedef struct {
-    struct timeval      startTime;  /**< time of the first packet */
-    struct timeval      endTime;    /**< time of the last packet */
+    int64_t             startTime;  /**< time of the first packet (ns) */
+    int64_t             endTime;    /**< time of the last packet (ns) */
 
     unsigned long long  numPkts;    /**< total number of packets */
     unsigned long long  numErrors;  /**< number of errors */
-    unsigned long long  numIP;      /**< number of IP packets */
+    unsigned long long  numIP;      /**< number of IP packets (IPv4 or IPv6) */
     unsigned long long  numTCP;     /**< number of TCP packets */
     unsigned long long  numUDP;     /**< number of UDP packets */
 } pktStats_t;
@@ -47,6 +63,9 @@ struct dissector {
     int             pktSize;        /**< real size of data */
 
     IPPacket_t      *ipPkt;         /**< pointer to the IP header */
+    const IPheader_t *ip4;          /**< pointer to the IPv4 header (NULL unless IPv4 with its 20 fixed bytes) */
+    const IPv6header_t *ip6;        /**< pointer to the IPv6 header (NULL unless IPv6 with its whole fixed header) */
+    unsigned int    flowId;         /**< IPv6 analogue of the IP ID (see pkt_flow_id()) */
     unsigned int    protocol;       /**< transport protocol */
     int             offset;         /**< IP offset */
     const char      *ipData;        /**< pointer to IP data */
@@ -59,6 +78,8 @@ struct dissector {
     const char      *sgmtData;      /**< pointer to transport level data */
     int             sgmtBufSize;    /**< size of captured transport data */
     int             sgmtPktSize;    /**< real size of transport data */
+
+    unsigned long long digest;      /**< hash of the payload (fast mode: of its first PKT_FAST_BYTES) */
 };
 
 /**
@@ -66,20 +87,46 @@ struct dissector {
  */
 struct pkt {
     unsigned long long  pos;        /**< position */
-    long double         time;       /**< decoded timestamp */
+    int64_t             time;       /**< decoded timestamp (ns) */
     ethFrame_t          *frame;     /**< pointer to ethernet header */
     dissector_t         dis;        /**< packet dissector */
     node_t              *container; /**< pointer to the container node */
+    int                 slab;       /**< size class of the frame bytes (-1: not allocated) */
+    int                 dupe;       /**< duplicate flag (set when the packet has been searched) */
+    unsigned int        source;     /**< input file (several input files) */
+    const char          *orig;      /**< frame bytes before pkt_copy() (NULL: unchanged, see pkt_keep_original()) */
+    int                 origSlab;   /**< size class of the original bytes (-1: not allocated) */
+    int                 origCaplen; /**< captured size before pkt_copy() */
+    int                 origSize;   /**< real size before pkt_copy() */
 };
 
+/**
+ * Packet record: a packet and its headers, stored together (inline in the window's nodes)
+ */
+typedef struct {
+    pkt_t               pkt;        /**< the packet (first member) */
+    ethFrame_t          frame;      /**< ethernet header */
+    IPPacket_t          ipPkt;      /**< IP header */
+    TCPSegment_t        sgmt;       /**< transport header (TCP or UDP) */
+} pktRecord_t;
+
 // initializer
-void pkt_init(int fast, pktStats_t *stats);
+void pkt_init(int fast, int storage, pktStats_t *stats);
+
+// packet statistics of the calling thread (pkt_init() sets them for the caller)
+void pkt_set_stats(pktStats_t *stats);
 
 // constructors
 ethFrame_t *pkt_new_ethFrame(ethFrame_t *frame, void *bytes, int size, int caplen, struct timeval *timestamp);
 IPPacket_t *pkt_new_ipPkt(IPPacket_t *ipPkt, void *bytes, int caplen);
 void *pkt_new_segment(void *sgmt, void *bytes, int size, int caplen);
 
+// payload hash
+unsigned long long pkt_digest(const void *data, int size);
+
+// hash of the fields shared by every copy of a duplicate (raw frame)
+unsigned long long pkt_flow_key(const void *bytes, int size, int caplen);
+
 // fill pkt_t
 pkt_t *pkt_fill(node_t *node, unsigned long long pos, void *bytes, int size, int caplen, struct timeval *timestamp);
 
@@ -91,9 +138,18 @@ pkt_t *pkt_fill(node_t *node, unsigned long long pos, void *bytes, int size, int
  */
 extern int (*pkt_dissect)(pkt_t *pkt);
 
+// dissect n packets in a row, prefetching the next ones if copied (number dissected without errors)
+int pkt_dissect_batch(pkt_t **pkts, int n);
+
 // copy the contents of pkt1 in pkt2 with (copyTs=1) or without (copyTs=0) changing the timestamp
 int pkt_copy(pkt_t *src, pkt_t *dst, int copyTs);
 
+// keep the frame bytes overwritten by pkt_copy() in pkt.orig (e.g. to write them out)
+void pkt_keep_original(int keep);
+
+// give the frame bytes back to the slab (buffer release callback)
+void pkt_release(void *load);
+
 // free all memory
 void pkt_destroy();
 
@@ -0,0 +1,285 @@
+/*
+ * ring.c
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#include "../config.h"
+#include "ring.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#if defined(HAVE_LINUX_FUTEX_H) && defined(HAVE_SYS_SYSCALL_H)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define RING_FUTEX
+#endif
+
+#define RING_CACHELINE 64
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ring_relax() __builtin_ia32_pause()
+#else
+#define ring_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+
+/**
+ * Private ring structure (single producer, single consumer)
+ *
+ * Producer and consumer indexes live in separate cache lines. Each side keeps a
+ * cached copy of the other side's index, so the shared line is only read when
+ * the ring looks full (producer) or empty (consumer).
+ */
+struct ring {
+    char                *elems;         /**< array of elements */
+    unsigned int        mask;           /**< number of elements - 1 */
+    unsigned int        size;           /**< size of an element */
+    int                 mode;           /**< consumer wait mode */
+
+    struct {
+        unsigned int    head;           /**< next element to write */
+        unsigned int    tail;           /**< cached consumer index */
+    } __attribute__((aligned(RING_CACHELINE))) prod;
+
+    struct {
+        unsigned int    tail;           /**< next element to read */
+        unsigned int    head;           /**< cached producer index */
+    } __attribute__((aligned(RING_CACHELINE))) cons;
+
+    int                 sleeping __attribute__((aligned(RING_CACHELINE)));  /**< the consumer is (about to be) asleep */
+    int                 killed;         /**< no more elements will be pushed */
+    pthread_mutex_t     mutex;          /**< ring mutex (RING_WAIT_BLOCK) */
+    pthread_cond_t      cond;           /**< ring condition (RING_WAIT_BLOCK) */
+};
+
+#ifdef RING_FUTEX
+static inline void ring_futex_wait(int *addr, int val) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static inline void ring_futex_wake(int *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+#endif
+
+/**
+ * @brief Initializes a new ring
+ *
+ * @param count number of elements (rounded up to a power of two)
+ * @param size  size of each element
+ * @param mode  consumer wait mode
+ * - RING_WAIT_SPIN
+ * - RING_WAIT_FUTEX (same as RING_WAIT_BLOCK if futexes are not available)
+ * - RING_WAIT_BLOCK
+ * @return a pointer to the ring (NULL if error)
+ */
+ring_t *ring_init(unsigned int count, unsigned int size, int mode) {
+    UTILS_CHECK(!count || !size, EINVAL, return NULL);
+
+    ring_t *ring;
+    if (posix_memalign((void **)&ring, RING_CACHELINE, sizeof(ring_t))) {
+        perror("Error: ring_init > posix_memalign");
+        return NULL;
+    }
+
+    unsigned int n = 1;
+    while (n < count) n <<= 1;
+    ring->elems = (char *) malloc((size_t)n*size);
+    if (!ring->elems) {
+        perror("Error: ring_init > malloc");
+        free(ring);
+        return NULL;
+    }
+    ring->mask = n-1;
+    ring->size = size;
+    ring->mode = mode;
+    ring->prod.head = ring->prod.tail = 0;
+    ring->cons.head = ring->cons.tail = 0;
+    ring->sleeping = 0;
+    ring->killed = 0;
+    pthread_mutex_init(&ring->mutex, NULL);
+    pthread_cond_init(&ring->cond, NULL);
+
+    return ring;
+}
+
+/**
+ * @brief Destroys a ring
+ *
+ * @param ring the ring
+ */
+void ring_destroy(ring_t *ring) {
+    UTILS_CHECK(!ring, EINVAL, return);
+
+    pthread_mutex_destroy(&ring->mutex);
+    pthread_cond_destroy(&ring->cond);
+    free(ring->elems);
+    free(ring);
+}
+
+/**
+ * @brief Pushes an element (producer)
+ *
+ * The consumer is not woken up: see ring_notify().
+ *
+ * @param ring  the ring
+ * @param elem  the element (it will be copied)
+ * @return 0 on success, -1 if the ring is full
+ */
+inline int ring_push(ring_t *ring, const void *elem) {
+    unsigned int head = ring->prod.head;
+
+    if (head - ring->prod.tail > ring->mask) {
+        ring->prod.tail = __atomic_load_n(&ring->cons.tail, __ATOMIC_ACQUIRE);
+        if (head - ring->prod.tail > ring->mask) return -1;
+    }
+    memcpy(ring->elems + (size_t)(head & ring->mask)*ring->size, elem, ring->size);
+    __atomic_store_n(&ring->prod.head, head+1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+// private: wakes up the consumer
+static inline void ring_wake(ring_t *ring) {
+#ifdef RING_FUTEX
+    if (ring->mode == RING_WAIT_FUTEX) {
+        if (__atomic_exchange_n(&ring->sleeping, 0, __ATOMIC_SEQ_CST))
+            ring_futex_wake(&ring->sleeping);
+        return;
+    }
+#endif
+    pthread_mutex_lock(&ring->mutex);
+    pthread_cond_signal(&ring->cond);
+    pthread_mutex_unlock(&ring->mutex);
+}
+
+/**
+ * @brief Wakes up the consumer if it is asleep and there are enough pending elements (producer)
+ *
+ * Wakeups are batched this way: a sleeping consumer costs one syscall per batch instead of one per element.
+ *
+ * @param ring  the ring
+ * @param batch minimum number of pending elements (0: any)
+ */
+inline void ring_notify(ring_t *ring, unsigned int batch) {
+    if (ring->mode == RING_WAIT_SPIN) return;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&ring->sleeping, __ATOMIC_RELAXED)) return;
+    if (ring->prod.head - __atomic_load_n(&ring->cons.tail, __ATOMIC_RELAXED) < (batch ? batch : 1)) return;
+
+    ring_wake(ring);
+}
+
+/**
+ * @brief Tells the consumer that no more elements will be pushed (producer)
+ *
+ * @param ring the ring
+ */
+void ring_kill(ring_t *ring) {
+    __atomic_store_n(&ring->killed, 1, __ATOMIC_SEQ_CST);
+    if (ring->mode != RING_WAIT_SPIN) ring_wake(ring);
+}
+
+/**
+ * @brief Gets the oldest element without removing it (consumer)
+ *
+ * @param ring the ring
+ * @return a pointer to the element or NULL if the ring is empty
+ */
+inline void *ring_peek(ring_t *ring) {
+    unsigned int tail = ring->cons.tail;
+
+    if (tail == ring->cons.head) {
+        ring->cons.head = __atomic_load_n(&ring->prod.head, __ATOMIC_ACQUIRE);
+        if (tail == ring->cons.head) return NULL;
+    }
+
+    return ring->elems + (size_t)(tail & ring->mask)*ring->size;
+}
+
+/**
+ * @brief Removes the oldest element (consumer)
+ * @see ring_peek()
+ *
+ * @param ring the ring
+ */
+inline void ring_drop(ring_t *ring) {
+    __atomic_store_n(&ring->cons.tail, ring->cons.tail+1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Pops the oldest element (consumer)
+ *
+ * @param ring  the ring
+ * @param elem  where to copy the element
+ * @return 0 on success, -1 if the ring is empty
+ */
+inline int ring_pop(ring_t *ring, void *elem) {
+    void *ptr = ring_peek(ring);
+    if (!ptr) return -1;
+
+    memcpy(elem, ptr, ring->size);
+    ring_drop(ring);
+
+    return 0;
+}
+
+// private: checks if there is something to do for the consumer
+static inline int ring_ready(ring_t *ring) {
+    return ring_peek(ring) || __atomic_load_n(&ring->killed, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Waits until an element is available (consumer)
+ *
+ * @param ring the ring
+ * @return 1 if an element is available, 0 if the ring is empty and killed
+ */
+int ring_wait(ring_t *ring) {
+    unsigned int spin = (ring->mode == RING_WAIT_BLOCK) ? 0 : RING_SPIN;
+
+    for (unsigned int i=0; !ring_ready(ring); i++) {
+        if (ring->mode == RING_WAIT_SPIN || i < spin) {
+            ring_relax();
+            continue;
+        }
+
+#ifdef RING_FUTEX
+        if (ring->mode == RING_WAIT_FUTEX) {
+            __atomic_store_n(&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (!ring_ready(ring)) ring_futex_wait(&ring->sleeping, 1);
+            __atomic_store_n(&ring->sleeping, 0, __ATOMIC_RELAXED);
+            continue;
+        }
+#endif
+        pthread_mutex_lock(&ring->mutex);
+        __atomic_store_n(&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        while (!ring_ready(ring))
+            pthread_cond_wait(&ring->cond, &ring->mutex);
+        __atomic_store_n(&ring->sleeping, 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&ring->mutex);
+    }
+
+    return ring_peek(ring) != NULL;
+}
+
+/**
+ * @brief Gets the number of elements in a ring
+ *
+ * @param ring the ring
+ * @return the number of elements
+ */
+inline unsigned int ring_get_count(ring_t *ring) {
+    UTILS_CHECK(!ring, EINVAL, return 0);
+
+    return __atomic_load_n(&ring->prod.head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->cons.tail, __ATOMIC_ACQUIRE);
+}
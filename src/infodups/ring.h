@@ -0,0 +1,44 @@
+/*
+ * ring.h
+ *
+ *  This file is part of NaNTools
+ *  See http://github.com/Enchufa2/nantools for more information
+ *  Copyright 2013 Iñaki Úcar <i.ucar86@gmail.com>
+ *  This program is published under a GPLv3 license
+ */
+
+#ifndef RING_H_
+#define RING_H_
+
+// consumer wait modes
+#define RING_WAIT_SPIN      0   /**< busy wait */
+#define RING_WAIT_FUTEX     1   /**< busy wait for a while, then sleep */
+#define RING_WAIT_BLOCK     2   /**< sleep on a condition variable */
+
+#ifndef RING_SPIN
+#define RING_SPIN 4096          /**< iterations before sleeping in RING_WAIT_FUTEX mode */
+#endif
+
+typedef struct ring ring_t;
+
+// initializer
+ring_t *ring_init(unsigned int count, unsigned int size, int mode);
+
+// free all memory
+void ring_destroy(ring_t *ring);
+
+// producer side
+int ring_push(ring_t *ring, const void *elem);
+void ring_notify(ring_t *ring, unsigned int batch);
+void ring_kill(ring_t *ring);
+
+// consumer side
+int ring_pop(ring_t *ring, void *elem);
+void *ring_peek(ring_t *ring);
+void ring_drop(ring_t *ring);
+int ring_wait(ring_t *ring);
+
+// number of elements in the ring
+unsigned int ring_get_count(ring_t *ring);
+
+#endif /* RING_H_ */
@@ -9,14 +9,30 @@
 
 #include "worker.h"
 #include "dups.h"
+#include "ring.h"
 #include "../common/utils.h"
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
-#include <fcntl.h>
 #include <pthread.h>
-#include <poll.h>
-#include <limits.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef WORKER_QUEUE
+#define WORKER_QUEUE 4096   /**< maximum number of pending tasks per worker */
+#endif
+
+#ifndef WORKER_BATCH
+#define WORKER_BATCH 32     /**< pending tasks needed to wake up a sleeping worker */
+#endif
+
+#ifndef WORKER_OUTPUT
+#define WORKER_OUTPUT 4096  /**< maximum number of pending duplicate records per worker */
+#endif
+
+#ifndef WORKER_NAP
+#define WORKER_NAP 50       /**< nap of the writer thread with nothing to print (us) */
+#endif
 
 /**
  * Job struct
@@ -25,12 +41,14 @@ typedef struct {
     unsigned int     id;        /**< thread identifier */
     workerPool_t    *pool;      /**< pointer to the pool */
 
-    buffer_t        *buffer;    /**< list of tasks */
-    node_t          *cur;       /**< current task */
+    ring_t          *tasks;     /**< queue of tasks (nodes) */
+    ring_t          *output;    /**< queue of duplicate records */
 
-    int             tube[2];    /**< pipe */
+    unsigned long long  dispatched; /**< position of the last task added (main thread, atomic) */
+    unsigned long long  done;       /**< position of the last task finished (worker) */
+    int                 exited;     /**< the worker has finished */
 
-    pthread_mutex_t kill_mutex; /**< kill mutex */
+    dupsRecord_t        *head;      /**< oldest record in the output queue (NULL: not in the merge heap) */
 } job_t;
 
 /**
@@ -39,38 +57,23 @@ typedef struct {
 struct workerPool {
     pthread_t       threads [BUFFER_MAX_WORKERS];   /**< array of threads */
     job_t           jobs    [BUFFER_MAX_WORKERS];   /**< array of jobs */
-    struct pollfd   pollin  [BUFFER_MAX_WORKERS];   /**< array of poll structs for POLLIN event (ready to read) */
-    struct pollfd   pollhup [BUFFER_MAX_WORKERS];   /**< array of poll structs for POLLHUP event (closed pipe) */
+    job_t           *heap   [BUFFER_MAX_WORKERS];   /**< merge heap of jobs, keyed on the position of their head record */
+    unsigned int    heapSize;                       /**< number of jobs in the heap */
 
     unsigned int    num;                            /**< number of threads */
     unsigned int    next;                           /**< next thread*/
 
     int             debug;                          /**< debug flag */
-};
 
-/**
- * @brief Waits for a signal
- *
- * @param job thread's job
- */
-static inline void worker_wait(job_t *job) {
-    while (!job->cur){
-        // check kill mutex
-        if (!pthread_mutex_trylock(&job->kill_mutex)) {
-            pthread_mutex_unlock(&job->kill_mutex);
-
-            // close writer side and exit
-            close(job->tube[1]);
-            pthread_exit(NULL);
-        }
+    unsigned long long  dispatched;                 /**< position of the last task added to any worker (atomic) */
+    pthread_t       writer;                         /**< output thread */
+    int             writing;                        /**< records are printed by the output thread */
+    int             stop;                           /**< the output thread must stop (atomic) */
 
-        // wait for another task or kill signal
-        buffer_wait(job->buffer);
-
-        // next task
-        job->cur = buffer_get_first(job->buffer);
-    }
-}
+    int             waiting;                        /**< the main thread waits for a task to be finished (atomic) */
+    pthread_mutex_t mutex;                          /**< mutex for the wait */
+    pthread_cond_t  cond;                           /**< signaled when a task is finished while waiting */
+};
 
 /**
  * @brief Thread function
@@ -82,27 +85,30 @@ void *worker_searcher(void *arg) {
     UTILS_CHECK(!arg, EINVAL, exit(EXIT_FAILURE));
 
     job_t *job = (job_t *)arg;
-    char line[PIPE_BUF];
-    int bufSize = 0;
-
-    while (1) {
-        // no work to do
-        worker_wait(job);
-
-        // do job
-        dups_search((node_t *)job->cur->load, job->id, line, &bufSize);
-        if (bufSize) {
-            write(job->tube[1], &bufSize, sizeof(bufSize));
-            write(job->tube[1], line, bufSize+1);
+    node_t *task;
+    pkt_t *pkt;
+    unsigned long long pos;
+
+    // wait for another task or kill signal
+    while (ring_wait(job->tasks)) {
+        ring_pop(job->tasks, &task);
+        pkt = (pkt_t *)task->load;
+        pos = pkt->pos;     // a fragment merged with its first copy gets the position of the latter
+
+        // do job (records and the duplicate flag are published before the task is marked as done)
+        if (dups_search(task, job->id, job->output) == 1) pkt->dupe = 1;
+        __atomic_store_n(&job->done, pos, __ATOMIC_SEQ_CST);
+
+        // the main thread may be waiting for old packets to be released (see worker_wait())
+        if (__atomic_load_n(&job->pool->waiting, __ATOMIC_SEQ_CST) && __atomic_exchange_n(&job->pool->waiting, 0, __ATOMIC_SEQ_CST)) {
+            pthread_mutex_lock(&job->pool->mutex);
+            pthread_cond_signal(&job->pool->cond);
+            pthread_mutex_unlock(&job->pool->mutex);
         }
-
-        // clean
-        buffer_lock(job->buffer);
-        buffer_remove(job->cur);
-        job->cur = buffer_get_first(job->buffer);
-        buffer_unlock(job->buffer);
     }
 
+    // exit
+    __atomic_store_n(&job->exited, 1, __ATOMIC_RELEASE);
     return NULL;
 }
 
@@ -110,11 +116,14 @@ void *worker_searcher(void *arg) {
  * @brief Initializes the library
  *
  * @param num       number of workers (default: 2)
- * @param prefix    prefix for the temp files
+ * @param mode      how idle workers wait for tasks
+ * - RING_WAIT_SPIN busy wait
+ * - RING_WAIT_FUTEX busy wait for a while, then sleep
+ * - RING_WAIT_BLOCK sleep
  * @param debug     debug mode (!=0 to enable)
  * @return a pointer to a new pool of workers or NULL
  */
-workerPool_t *worker_init(unsigned int num, int debug) {
+workerPool_t *worker_init(unsigned int num, int mode, int debug) {
     workerPool_t *newPool = (workerPool_t *) malloc(sizeof(workerPool_t));
     if (!newPool) {
         perror("Error: worker_init > malloc");
@@ -127,32 +136,33 @@ workerPool_t *worker_init(unsigned int num, int debug) {
     if (num > 1 && num <= BUFFER_MAX_WORKERS) newPool->num = num;
     else newPool->num = 2;
     newPool->next = 0;
+    newPool->heapSize = 0;
     newPool->debug = debug;
+    newPool->dispatched = 0;
+    newPool->writing = 0;
+    newPool->stop = 0;
+    newPool->waiting = 0;
+    pthread_mutex_init(&newPool->mutex, NULL);
+    pthread_condattr_t condAttr;
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+    pthread_cond_init(&newPool->cond, &condAttr);
+    pthread_condattr_destroy(&condAttr);
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
 
     for (int i=0; i<newPool->num; i++) {
         newPool->jobs[i].id = i;
         newPool->jobs[i].pool = newPool;
-        newPool->jobs[i].buffer = buffer_init(0, 0);
-        newPool->jobs[i].cur = NULL;
-        pthread_mutex_init(&newPool->jobs[i].kill_mutex, NULL);
-        pthread_mutex_lock(&newPool->jobs[i].kill_mutex);
-
-        // create a pipe
-        ret = pipe(newPool->jobs[i].tube);
-        if (ret) {
-            perror("Error: worker_init > pipe");
-            exit(ret);
-        }
-        // reader side monitoring
-        newPool->pollin[i].fd = newPool->jobs[i].tube[0];
-        newPool->pollin[i].events = POLLIN;
-        newPool->pollin[i].revents = 0;
-
-        newPool->pollhup[i].fd = newPool->jobs[i].tube[0];
-        newPool->pollhup[i].events = POLLHUP;
-        newPool->pollhup[i].revents = 0;
+        newPool->jobs[i].tasks = ring_init(WORKER_QUEUE, sizeof(node_t *), mode);
+        if (!newPool->jobs[i].tasks) exit(EXIT_FAILURE);
+        // the main thread polls this queue, it never sleeps on it
+        newPool->jobs[i].output = ring_init(WORKER_OUTPUT, sizeof(dupsRecord_t), RING_WAIT_SPIN);
+        if (!newPool->jobs[i].output) exit(EXIT_FAILURE);
+        newPool->jobs[i].dispatched = 0;
+        newPool->jobs[i].done = 0;
+        newPool->jobs[i].exited = 0;
+        newPool->jobs[i].head = NULL;
 
         ret = pthread_create(&newPool->threads[i], &attr, worker_searcher, (void *)(&newPool->jobs[i]));
         if (ret) {
@@ -166,64 +176,187 @@ workerPool_t *worker_init(unsigned int num, int debug) {
 }
 
 /**
- * @brief Output multiplexer
+ * @brief Wakes up every sleeping worker with pending tasks
+ *
+ * @param pool the pool
+ */
+void worker_flush(workerPool_t *pool) {
+    UTILS_CHECK(!pool, EINVAL, return);
+
+    for (int i=0; i<pool->num; i++)
+        ring_notify(pool->jobs[i].tasks, 0);
+}
+
+/**
+ * @brief Restores the heap property from a given node downwards
+ *
+ * @param pool  the pool
+ * @param i     heap node
+ */
+static inline void worker_heap_down(workerPool_t *pool, unsigned int i) {
+    job_t **heap = pool->heap, *job = heap[i];
+    unsigned int child;
+
+    while ((child = 2*i+1) < pool->heapSize) {
+        if (child+1 < pool->heapSize && heap[child+1]->head->pos < heap[child]->head->pos)
+            child++;
+        if (job->head->pos <= heap[child]->head->pos) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = job;
+}
+
+/**
+ * @brief Inserts a job with a head record into the heap
+ *
+ * @param pool  the pool
+ * @param job   the job
+ */
+static inline void worker_heap_push(workerPool_t *pool, job_t *job) {
+    job_t **heap = pool->heap;
+    unsigned int i = pool->heapSize++, parent;
+
+    while (i) {
+        parent = (i-1)/2;
+        if (heap[parent]->head->pos <= job->head->pos) break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = job;
+}
+
+// private: the worker has tasks not finished yet (done: output, the position of the last one finished)
+static inline int worker_is_busy(job_t *job, unsigned long long *done) {
+    unsigned long long dispatched = __atomic_load_n(&job->dispatched, __ATOMIC_ACQUIRE);
+
+    *done = __atomic_load_n(&job->done, __ATOMIC_ACQUIRE);
+    return *done != dispatched;
+}
+
+/**
+ * @brief One pass of the output multiplexer
+ *
+ * Records are printed in position order, merging the output queues of the workers
+ * through a min-heap keyed on the position of their oldest record. A worker with
+ * pending tasks and no records in its queue could still report any position after
+ * its last finished task, so nothing beyond that point is printed until the worker
+ * catches up.
+ *
+ * From the output thread, tasks may be added meanwhile: nothing beyond the last
+ * task added before the pass is printed either. That position is read first, and
+ * the progress of every worker after it, so a worker found idle has no task older
+ * than it still running.
  *
  * @param pool      the pool
- * @param finish    last lines
+ * @param finish    last lines (all workers have finished)
+ * @return the number of records printed
  */
-inline void worker_mux(workerPool_t *pool, int finish) {
-    static unsigned long long next[BUFFER_MAX_WORKERS];
-    static char line[BUFFER_MAX_WORKERS][PIPE_BUF];
-    int min, flag=1, bufSize;
-
-    // mux while a line from each thread is available
-    while (flag) {
-        // select the minimum number
-        min = 0;
-        for (int i=0; i<pool->num; i++) {
-            // if there is no line read and there are data in the pipe, get the next line
-            if (!next[i] && poll(&pool->pollin[i], 1, 0) && read(pool->jobs[i].tube[0], &bufSize, sizeof(bufSize))) {
-                read(pool->jobs[i].tube[0], line[i], bufSize+1);
-                next[i] = strtoull(line[i], NULL, 10);
-            }
-
-            if (next[i] < next[min]) min = i;
-        }
+static inline unsigned int worker_mux_pass(workerPool_t *pool, int finish) {
+    unsigned long long bound = ~0ULL, done;
+    unsigned int printed = 0;
+    job_t *job;
 
-        // output
-        if (next[min]) {
-            fputs(line[min], stdout);
+    if (pool->writing && !finish) bound = __atomic_load_n(&pool->dispatched, __ATOMIC_ACQUIRE);
 
-            // reset
-            line[min][0] = '\0';
-            next[min] = 0;
-        } else flag = 0;
+    // add workers with new records to the heap and bound the rest
+    for (int i=0; i<pool->num; i++) {
+        job = &pool->jobs[i];
+        if (job->head) continue;
+
+        // read progress before the queue: an empty queue is then up to date
+        int busy = worker_is_busy(job, &done);
+        job->head = (dupsRecord_t *) ring_peek(job->output);
+        if (job->head) worker_heap_push(pool, job);
+        else if (!finish && busy && done < bound)
+            bound = done;
     }
 
-    // mux the last lines
-    while (finish) {
-        // select the minimum number
-        min = -1;
-        for (int i=0; i<pool->num; i++) {
-            if (next[i] && (min < 0 || (min >= 0 && next[i] < next[min])))
-                min = i;
+    // output
+    while (pool->heapSize && pool->heap[0]->head->pos <= bound) {
+        job = pool->heap[0];
+        dups_print(stdout, job->head);
+        ring_drop(job->output);
+        printed++;
+
+        int busy = worker_is_busy(job, &done);
+        job->head = (dupsRecord_t *) ring_peek(job->output);
+        if (!job->head) {
+            pool->heap[0] = pool->heap[--pool->heapSize];
+            if (!finish && busy && done < bound)
+                bound = done;
         }
+        if (pool->heapSize) worker_heap_down(pool, 0);
+    }
+
+    return printed;
+}
+
+/**
+ * @brief Output thread function
+ *
+ * @param arg the pool
+ * @return NULL
+ */
+static void *worker_writer(void *arg) {
+    workerPool_t *pool = (workerPool_t *)arg;
+
+    while (!__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE))
+        if (!worker_mux_pass(pool, 0)) usleep(WORKER_NAP);
+
+    return NULL;
+}
+
+/**
+ * @brief Moves the output multiplexer to a thread of its own
+ *
+ * Records are then formatted and printed while the main thread reads, and
+ * worker_mux() does nothing. Nothing else may write to stdout until worker_destroy().
+ *
+ * @param pool the pool
+ * @return 0 on success, -1 on error
+ */
+int worker_start_writer(workerPool_t *pool) {
+    UTILS_CHECK(!pool || pool->writing, EINVAL, return -1);
 
-        // output
-        if (min >= 0) {
-            fputs(line[min], stdout);
+    pool->writing = 1;
+    if (pthread_create(&pool->writer, NULL, worker_writer, (void *)pool)) {
+        perror("Error: worker_start_writer > pthread_create");
+        pool->writing = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Output multiplexer (see worker_mux_pass())
+ *
+ * @param pool      the pool
+ * @param finish    last lines (all workers have finished)
+ */
+inline void worker_mux(workerPool_t *pool, int finish) {
+    if (!pool->writing) worker_mux_pass(pool, finish);
+}
+
+/**
+ * @brief Gets the occupancy of the queues
+ *
+ * @param pool      the pool
+ * @param tasks     output: pending tasks (fraction of the queues)
+ * @param output    output: pending duplicate records (fraction of the queues)
+ */
+void worker_get_load(workerPool_t *pool, double *tasks, double *output) {
+    UTILS_CHECK(!pool || !tasks || !output, EINVAL, return);
 
-            // reset
-            line[min][0] = '\0';
-            next[min] = 0;
+    unsigned long long t = 0, o = 0;
 
-            // read another line if available
-            if (poll(&pool->pollin[min], 1, 0) && read(pool->jobs[min].tube[0], &bufSize, sizeof(bufSize))) {
-                read(pool->jobs[min].tube[0], line[min], bufSize+1);
-                next[min] = strtoull(line[min], NULL, 10);
-            }
-        } else finish = 0;
+    for (int i=0; i<pool->num; i++) {
+        t += ring_get_count(pool->jobs[i].tasks);
+        o += ring_get_count(pool->jobs[i].output);
     }
+    *tasks = (double)t / (pool->num * WORKER_QUEUE);
+    *output = (double)o / (pool->num * WORKER_OUTPUT);
 }
 
 /**
@@ -235,30 +368,36 @@ void worker_destroy(workerPool_t *pool) {
     UTILS_CHECK(!pool, EINVAL, return);
 
     // signal
-    for (int i=0; i<pool->num; i++) {
-        pthread_mutex_unlock(&pool->jobs[i].kill_mutex);
-        buffer_signal(pool->jobs[i].buffer);
-    }
+    for (int i=0; i<pool->num; i++)
+        ring_kill(pool->jobs[i].tasks);
 
-    // wait POLLHUP and mux last lines
-    while (poll(pool->pollhup, pool->num, 0) != pool->num)
-        worker_mux(pool, 0);
-    worker_mux(pool, 1);
-
-    // join
+    // wait for the workers and mux last lines
     for (int i=0; i<pool->num; i++) {
+        while (!__atomic_load_n(&pool->jobs[i].exited, __ATOMIC_ACQUIRE)) {
+            worker_mux(pool, 0);
+            sched_yield();
+        }
         pthread_join(pool->threads[i], NULL);
+    }
+    if (pool->writing) {
+        __atomic_store_n(&pool->stop, 1, __ATOMIC_RELEASE);
+        pthread_join(pool->writer, NULL);
+    }
+    worker_mux_pass(pool, 1);
 
-        // destroy
-        pthread_mutex_destroy(&pool->jobs[i].kill_mutex);
-        buffer_destroy(pool->jobs[i].buffer);
+    // destroy
+    for (int i=0; i<pool->num; i++) {
+        ring_destroy(pool->jobs[i].tasks);
+        ring_destroy(pool->jobs[i].output);
     }
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->cond);
 
     free(pool);
 }
 
 /**
- * @brief Adds a new task to a worker
+ * @brief Adds a new task to the next worker (round-robin)
  *
  * @param pool the pool
  * @param load task content
@@ -271,25 +410,105 @@ inline int worker_add_task(workerPool_t *pool, void *load) {
     unsigned int n = pool->next++;
     if (pool->next == pool->num) pool->next = 0;
 
-    // new task
-    buffer_lock(pool->jobs[n].buffer);
-    buffer_t *buffer = pool->jobs[n].buffer;
-    node_t * task_new = buffer_new(buffer);
-    if (!task_new) {
-        perror("Error: worker_add_task > buffer_new");
-        buffer_unlock(pool->jobs[n].buffer);
-        return -1;
-    }
-    task_new->load = load;
+    return worker_add_task_to(pool, n, load);
+}
 
-    // append task
-    buffer_append(buffer, task_new);
-    buffer_unlock(pool->jobs[n].buffer);
+/**
+ * @brief Adds a new task to a given worker
+ *
+ * @param pool the pool
+ * @param n    worker identifier
+ * @param load task content
+ * @return 0 on success, -1 on error
+ */
+inline int worker_add_task_to(workerPool_t *pool, unsigned int n, void *load) {
+    UTILS_CHECK(!pool || !load || n >= pool->num, EINVAL, return -1);
+
+    // its position is read first: the worker may change it (merged fragments)
+    unsigned long long pos = ((pkt_t *)((node_t *)load)->load)->pos;
+
+    // new task (if the queue is full, wake the workers up and let them run: the output may wait for any of them)
+    while (ring_push(pool->jobs[n].tasks, &load)) {
+        worker_flush(pool);
+        worker_mux(pool, 0);
+        sched_yield();
+    }
+    __atomic_store_n(&pool->jobs[n].dispatched, pos, __ATOMIC_RELEASE);
+    __atomic_store_n(&pool->dispatched, pos, __ATOMIC_RELEASE);
 
     // signal
-    buffer_signal(pool->jobs[n].buffer);
+    ring_notify(pool->jobs[n].tasks, WORKER_BATCH);
 
     //if (pool->debug) buffer_debug(buffer, pkt_print);
     //if (pool->debug) buffer_print(buffer);
     return 0;
 }
+
+/**
+ * @brief Gets the position up to which every task has been finished
+ *
+ * @param pool the pool
+ * @return the position (~0ULL if there are no pending tasks)
+ */
+inline unsigned long long worker_get_done(workerPool_t *pool) {
+    UTILS_CHECK(!pool, EINVAL, return 0);
+
+    unsigned long long bound = ~0ULL, done;
+
+    for (int i=0; i<pool->num; i++) {
+        done = __atomic_load_n(&pool->jobs[i].done, __ATOMIC_ACQUIRE);
+        if (done != pool->jobs[i].dispatched && done < bound)
+            bound = done;
+    }
+
+    return bound;
+}
+
+/**
+ * @brief Waits until the workers make progress, for a while at most (flow control)
+ *
+ * The main thread calls it when the window is full: every task finished while it
+ * waits wakes it up once, so it can release the packets no longer needed.
+ *
+ * @param pool      the pool
+ * @param bound     last result of worker_get_done()
+ * @param timeout   maximum wait (nanoseconds)
+ * @return the new result of worker_get_done()
+ */
+unsigned long long worker_wait(workerPool_t *pool, unsigned long long bound, long timeout) {
+    UTILS_CHECK(!pool, EINVAL, return ~0ULL);
+
+    struct timespec ts;
+    unsigned long long done;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_nsec += timeout % 1000000000;
+    ts.tv_sec += timeout / 1000000000 + ts.tv_nsec / 1000000000;
+    ts.tv_nsec %= 1000000000;
+
+    // announce the wait before checking, as the workers finish first and then check
+    pthread_mutex_lock(&pool->mutex);
+    __atomic_store_n(&pool->waiting, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    done = worker_get_done(pool);
+    if (done == bound) {
+        pthread_cond_timedwait(&pool->cond, &pool->mutex, &ts);
+        done = worker_get_done(pool);
+    }
+    __atomic_store_n(&pool->waiting, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&pool->mutex);
+
+    return done;
+}
+
+/**
+ * @brief Gets the number of workers in a pool
+ *
+ * @param pool the pool
+ * @return the number of workers
+ */
+inline unsigned int worker_get_num(workerPool_t *pool) {
+    UTILS_CHECK(!pool, EINVAL, return 0);
+
+    return pool->num;
+}
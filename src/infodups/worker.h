@@ -13,7 +13,7 @@
 typedef struct workerPool workerPool_t;
 
 // initializer
-workerPool_t *worker_init(unsigned int num, int debug);
+workerPool_t *worker_init(unsigned int num, int mode, int debug);
 
 // free all memory
 void worker_destroy(workerPool_t *pool);
@@ -21,7 +21,28 @@ void worker_destroy(workerPool_t *pool);
 // add a new task
 int worker_add_task(workerPool_t *pool, void *load);
 
+// add a new task to a given worker
+int worker_add_task_to(workerPool_t *pool, unsigned int n, void *load);
+
+// number of workers
+unsigned int worker_get_num(workerPool_t *pool);
+
+// position up to which every task has been finished
+unsigned long long worker_get_done(workerPool_t *pool);
+
+// wait until the position returned by worker_get_done() moves from bound, or timeout (ns) expires
+unsigned long long worker_wait(workerPool_t *pool, unsigned long long bound, long timeout);
+
+// wake up idle workers with pending tasks
+void worker_flush(workerPool_t *pool);
+
 // output multiplexer
 void worker_mux(workerPool_t *pool, int finish);
 
+// print the output from a thread of its own (worker_mux() does nothing then)
+int worker_start_writer(workerPool_t *pool);
+
+// occupancy of the queues, from 0 to 1 (tasks and duplicate records)
+void worker_get_load(workerPool_t *pool, double *tasks, double *output);
+
 #endif /* WORKER_H_ */
@@ -9,13 +9,15 @@
 
 #include "series.h"
 #include "DSTries.h"
-#include "../common/eth.h"
-#include "../common/ip.h"
+#include "../common/parse.h"
+#include "../common/utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 
+#define SERIES_NSEC_PER_MSEC 1000000LL
+
 unsigned int series_mode = SERIES_BPF;
-unsigned long long series_initTime = 0;
+int64_t series_initTime = 0;
 unsigned int series_msecsPointInTimeSeries = 1000;
 unsigned int series_dumpZeros = 1;
 unsigned int series_breakAtFirstMatch = 0;
@@ -24,13 +26,13 @@ typedef struct {
     int                 id;
     filter_t            *filter;
     struct bpf_program  bpf;
-    long long           intervalStartTime;
+    int64_t             intervalStartTime;  // ns
     long long           bytesInInterval;
     long long           packetsInInterval;
 } series_t;
 
 typedef struct {
-    const struct timeval    *time;
+    int64_t                 time;   // ns
     int                     bytes;
     int                     endSeries;
 } seriesData_t;
@@ -38,53 +40,19 @@ typedef struct {
 // private
 static series_t     *series;
 static int          num_series;
-static ethFrame_t   *eth;
-static IPPacket_t   *ip;
 static filterList_t *filterList;
 static dstNode_t    *triesTree;
 
-static inline ethFrame_t *series_new_eth(ethFrame_t *frame, void *bytes, int size, int caplen, struct timeval *timestamp) {
-    if (!frame) frame = malloc(sizeof(ethFrame_t));
-
-    // init
-    if (frame) {
-        frame->bytes = bytes;
-        frame->size = size;
-        frame->caplen = caplen;
-        frame->frameType = ETH_FRAMETYPE_NOTCHECKED;
-        if (timestamp) frame->timestamp = *timestamp;
-    } else
-        perror("Error: series_new_eth > malloc");
-
-    return frame;
-}
-
-static inline IPPacket_t *series_new_ipPkt(IPPacket_t *ipPkt, void *bytes, int caplen) {
-    if (!ipPkt) ipPkt = malloc(sizeof(IPPacket_t));
-
-    // init
-    if (ipPkt) {
-        ipPkt->bytes = bytes;
-        ipPkt->caplen = caplen;
-    } else
-        perror("Error: series_new_ipPkt > malloc");
-
-    return ipPkt;
-}
-
 // Extrae las IPs de un paquete Ethernet a las variables srcIP y dstIP. Devuelve 1 en caso de éxito, 0 en caso contrario.
 static inline int series_unpack_addresses(void *header, const u_char *bytes, unsigned int *srcIP, unsigned int *dstIP) {
     if (!header || !bytes) return 0;
 
-    eth = series_new_eth(eth, (void *)bytes, ((const struct pcap_pkthdr *)header)->len, ((const struct pcap_pkthdr *)header)->caplen, (struct timeval *)&((const struct pcap_pkthdr *)header)->ts);
-    if (eth_get_ethertype(eth) != ETH_PROTO_IPv4) return 0;
-
-    int bufSize;
-    void *ipData = (void *)eth_get_data(eth, &bufSize);
-    ip = series_new_ipPkt(ip, ipData, bufSize);
+    parsed_hdr_t hdr;
+    if (nan_parse((const char *)bytes, ((const struct pcap_pkthdr *)header)->caplen, &hdr)) return 0;
+    if (hdr.ethertype != ETH_PROTO_IPv4) return 0;
 
-    *srcIP = ip_get_src(ip);
-    *dstIP = ip_get_dst(ip);
+    *srcIP = hdr.srcIP;
+    *dstIP = hdr.dstIP;
 
     return 1;
 }
@@ -97,16 +65,13 @@ int series_init() {
             perror("Error: series_init > DSTries_insert_filterList");
             return -1;
         }
-
-        eth = series_new_eth(NULL, NULL, 0, 0, NULL);
-        ip = series_new_ipPkt(NULL, NULL, 0);
     }
     return 0;
 }
 
 void series_destroy() {
     seriesData_t data;
-    data.time = NULL;
+    data.time = 0;
     data.bytes = 0;
     data.endSeries = 1;
 
@@ -116,8 +81,6 @@ void series_destroy() {
     }
 
     if (series_mode == SERIES_NETS) {
-        free(eth);
-        free(ip);
         DSTries_destroy_tree(triesTree);
         DSTries_destroy_filterList(filterList);
     }
@@ -156,24 +119,25 @@ inline void series_compute(void *arg, int i) {
     seriesData_t *data = (seriesData_t *) arg;
 
     if ((data->endSeries)&&(series[i].bytesInInterval>0)&&(series[i].intervalStartTime>-1)) {
-        fprintf(stdout, "%i %llu %llu %llu\n", i, series[i].intervalStartTime, series[i].bytesInInterval, series[i].packetsInInterval);
+        fprintf(stdout, "%i %lld %llu %llu\n", i, (long long)(series[i].intervalStartTime/SERIES_NSEC_PER_MSEC), series[i].bytesInInterval, series[i].packetsInInterval);
         return;
     }
 
-    if (data->time == NULL) return;
+    if (data->endSeries) return;
 
-    double  pktTime = data->time->tv_sec*1000.0+data->time->tv_usec/1000.0;
+    int64_t pktTime = data->time;
+    int64_t width = series_msecsPointInTimeSeries*SERIES_NSEC_PER_MSEC;
 
     if (series[i].intervalStartTime == -1) series[i].intervalStartTime = series_initTime;
 
-    if (pktTime >= series[i].intervalStartTime + series_msecsPointInTimeSeries) {
+    if (pktTime >= series[i].intervalStartTime + width) {
         // Cambio de intervalo
-        fprintf(stdout, "%i %llu %llu %llu\n", i, series[i].intervalStartTime, series[i].bytesInInterval, series[i].packetsInInterval);
-        series[i].intervalStartTime += series_msecsPointInTimeSeries;
+        fprintf(stdout, "%i %lld %llu %llu\n", i, (long long)(series[i].intervalStartTime/SERIES_NSEC_PER_MSEC), series[i].bytesInInterval, series[i].packetsInInterval);
+        series[i].intervalStartTime += width;
 
-        while (pktTime > series[i].intervalStartTime + series_msecsPointInTimeSeries) {
-            if (series_dumpZeros) fprintf(stdout, "%i %llu %llu %llu\n", i, series[i].intervalStartTime, 0LL, 0LL);
-            series[i].intervalStartTime += series_msecsPointInTimeSeries;
+        while (pktTime > series[i].intervalStartTime + width) {
+            if (series_dumpZeros) fprintf(stdout, "%i %lld %llu %llu\n", i, (long long)(series[i].intervalStartTime/SERIES_NSEC_PER_MSEC), 0LL, 0LL);
+            series[i].intervalStartTime += width;
         }
 
         series[i].bytesInInterval = data->bytes;
@@ -196,7 +160,7 @@ static inline int _filter(struct bpf_program *fp, const struct pcap_pkthdr *h, c
 
 inline void series_filter(const struct pcap_pkthdr *header, const u_char *bytes) {
     static seriesData_t data;
-    data.time = &header->ts;
+    data.time = utils_ts2ns(&header->ts);
     data.bytes = header->len+4;
 
     if (series_mode == SERIES_BPF) {
@@ -14,9 +14,10 @@
 #define SERIES_NETS 1
 
 #include <pcap/pcap.h>
+#include <stdint.h>
 
 extern unsigned int        series_mode;
-extern unsigned long long  series_initTime;
+extern int64_t             series_initTime;                // Instante de referencia en nanosegundos
 extern unsigned int        series_msecsPointInTimeSeries;  // Anchura del cubo de la serie temporal en milisegundos
 extern unsigned int        series_dumpZeros;               // Volcar en la serie temporal todas muestras que se queden a 0 entre dos muestras con valor
 extern unsigned int        series_breakAtFirstMatch;
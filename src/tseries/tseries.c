@@ -16,6 +16,7 @@
 #include <unistd.h>
 #include <pcap/pcap.h>
 #include "../common/utils.h"
+#include "../common/trace.h"
 #include "series.h"
 
 #define MAX_LINE 1000
@@ -86,20 +87,20 @@ void print_help() {
 
 // globals
 static int showProgress;
-static pcap_t *traceFile;
+static trace_t *traceFile;
 static unsigned long long fileSize;
 
 void update(u_char *user, const struct pcap_pkthdr *header, const u_char *bytes) {
     static unsigned long long pos;
     pos++;
     if (pos == 1 && !series_initTime)
-        series_initTime = header->ts.tv_sec*1000.0+header->ts.tv_usec/1000.0;
+        series_initTime = utils_ts2ns(&header->ts)/1000000*1000000;   // ms resolution
 
     // filter
     series_filter(header, bytes);
 
     // progress
-    if (showProgress) utils_print_progress(traceFile, fileSize);
+    if (showProgress) utils_print_progress(trace_tell(traceFile), fileSize);
     return;
 }
 
@@ -109,7 +110,6 @@ int main (int argc, char **argv) {
     char *prefilter = NULL;
     char *filtersPath = NULL;
     char filter[MAX_LINE];
-    struct bpf_program fp;
     FILE *fileOfFilters = NULL;
     int    ret, snaplen = 65535;
 
@@ -144,7 +144,7 @@ int main (int argc, char **argv) {
                 series_dumpZeros = 0;
                 break;
             case 't':
-                series_initTime = atoll(optarg);
+                series_initTime = atoll(optarg)*1000000LL;
                 break;
             case 'N':
                 series_mode = SERIES_NETS;
@@ -176,7 +176,7 @@ int main (int argc, char **argv) {
     if (showProgress) fileSize = utils_fsize(pcapFilePath);
     
     // open
-    traceFile = pcap_open_offline(pcapFilePath, errbuf);
+    traceFile = trace_open(pcapFilePath, errbuf);
     if (!traceFile) {
         fprintf(stderr, "Error: cannot open trace file %s\n", pcapFilePath);
         fprintf(stderr, "%s\n", errbuf);
@@ -184,21 +184,16 @@ int main (int argc, char **argv) {
     }
     
     // prefilter
-    if (pcap_compile(traceFile, &fp, prefilter, 1, 0)) {
-        fprintf(stderr, "Error: couldn't parse filter %s: %s\n", prefilter, pcap_geterr(traceFile));
-        return EXIT_FAILURE;
-    }
-    if (pcap_setfilter(traceFile, &fp)) {
-        fprintf(stderr, "Error: couldn't install filter %s: %s\n", prefilter, pcap_geterr(traceFile));
+    if (trace_setfilter(traceFile, prefilter, errbuf)) {
+        fprintf(stderr, "Error: couldn't install filter %s: %s\n", prefilter, errbuf);
         return EXIT_FAILURE;
     }
     
     // loop
-    ret = pcap_loop(traceFile, -1, update, NULL);
+    ret = trace_loop(traceFile, -1, update, NULL);
     
     // clean
-    pcap_freecode(&fp);
-    pcap_close(traceFile);
+    trace_close(traceFile);
     series_destroy();
     
     return ret;